@@ -21,6 +21,7 @@ Rectangle
     Row
     {
         id: nodeChannels
+        visible: !node.isCollapsed
         spacing: 0
         layoutDirection: Qt.RightToLeft
         anchors.top: parent.top
@@ -52,6 +53,19 @@ Rectangle
                 }
             }
         }
+
+        Repeater
+        {
+            id: comparisons
+
+            // Node.ChainComparison, the chains are in their own strips
+            model: node.nodes.filter(n => n.type === 4)
+
+            delegate: O.ChainComparison
+            {
+                node: modelData
+            }
+        }
     }
 
     Item
@@ -89,6 +103,9 @@ Rectangle
             anchors.horizontalCenter: parent.horizontalCenter
 
             clip: true
+            // Its nodes are the render's, or not running at all
+            enabled: !node.isFrozen && !node.isRendering
+            opacity: enabled? 1 : 0.5
 
             color: "#3b4750"
             border.color: "#aA262A2E"
@@ -112,7 +129,7 @@ Rectangle
 
                 onItemsReordered: (fromIndex, toIndex) =>
                 {
-                    control.node.reorder(fromIndex, toIndex)
+                    control.node.movePlugin(fromIndex, toIndex)
                 }
             }
 
@@ -134,6 +151,91 @@ Rectangle
 
                 onClicked: app.openPluginBrowserWindow(control.node, null)
             }
+
+            O.LightButton
+            {
+                y: pluginSlots.childrenRect.bottom + 8
+                anchors.right: parent.right
+                anchors.rightMargin: 4
+
+                bgHoveredColor: "#2f3338"
+                bgPressedColor: "#262A2E"
+
+                textColor: "#dddddd"
+                textPressedColor: "#bbbbbb"
+
+                font.pointSize: 11
+
+                text: "A|B"
+
+                onClicked: control.node.addComparison()
+            }
+        }
+
+        Row
+        {
+            id: midiInput
+
+            anchors.left: parent.left
+            anchors.right: parent.right
+            anchors.bottom: fader.top
+            anchors.margins: 4
+            spacing: 4
+
+            O.ComboBox
+            {
+                width: (parent.width - parent.spacing) / 2
+                height: 22
+
+                textRole: "text"
+                model: [{ text: "All" }].concat(audioEngine.midiInputPorts.map(portName => ({ text: portName })))
+
+                currentIndex: node.midiInputPort + 1
+                onActivated: (index) => node.midiInputPort = index - 1
+            }
+
+            O.ComboBox
+            {
+                width: (parent.width - parent.spacing) / 2
+                height: 22
+
+                textRole: "text"
+                model: [{ text: "Omni" }].concat(Array.from({ length: 16 }, (_, i) => ({ text: `Ch ${i + 1}` })))
+
+                currentIndex: node.midiInputChannel
+                onActivated: (index) => node.midiInputChannel = index
+            }
+        }
+
+        O.SnapshotButtons
+        {
+            anchors.bottom: midiOutput.top
+            anchors.horizontalCenter: parent.horizontalCenter
+            anchors.margins: 4
+
+            node: control.node
+
+            bgHoveredColor: "#2f3338"
+            bgPressedColor: "#262A2E"
+            textColor: "#dddddd"
+            textPressedColor: "#bbbbbb"
+        }
+
+        O.ComboBox
+        {
+            id: midiOutput
+
+            anchors.left: parent.left
+            anchors.right: parent.right
+            anchors.bottom: midiInput.top
+            anchors.margins: 4
+            height: 22
+
+            textRole: "text"
+            model: [{ text: "No MIDI out" }].concat(audioEngine.midiOutputPorts.map(portName => ({ text: portName })))
+
+            currentIndex: node.midiOutputPort + 1
+            onActivated: (index) => node.midiOutputPort = index - 1
         }
 
         O.Fader
@@ -170,15 +272,40 @@ Rectangle
 
             font.pointSize: 14
 
-            visible: node.channels.length > 0
+            visible: node.channels.length > 0 || comparisons.count > 0
             text: checked? "<" : "v"
 
-            checked: nodeChannels.visible
-            onClicked: nodeChannels.visible = !nodeChannels.visible
+            checked: !node.isCollapsed
+            onClicked: node.isCollapsed = !node.isCollapsed
+        }
+
+        // Freezes to a render of the strip; held, toggles whether its plugins also get unloaded
+        O.LightButton
+        {
+            anchors.bottom: parent.bottom
+            anchors.right: muteButton.left
+            anchors.margins: 3
+
+            bgHoveredColor: "#2f3338"
+            bgPressedColor: "#262A2E"
+
+            textColor: "#dddddd"
+            textPressedColor: "#bbbbbb"
+
+            font.pointSize: node.isRendering? 10 : 14
+            font.underline: node.unloadsWhenFrozen
+
+            text: node.isRendering? `${Math.round(node.renderProgress * 100)}%` : "F"
+
+            checked: node.isFrozen || node.isRendering
+            onClicked: node.isFrozen = !checked
+            onPressAndHold: node.unloadsWhenFrozen = !node.unloadsWhenFrozen
         }
 
         O.LightButton
         {
+            id: muteButton
+
             anchors.bottom: parent.bottom
             anchors.right: parent.right
             anchors.margins: 3
@@ -0,0 +1,127 @@
+import QtQuick
+import QtQuick.Controls.Basic
+import ClapWorkbench
+import "." as O
+
+
+// The two chains of a comparison side by side, with what's monitored and how far
+// apart they are
+Rectangle
+{
+    id: control
+
+    property QtObject node
+
+    width: chains.width + 101
+    height: parent?.height
+
+    color: "#36404a"
+    border.color: "#30373f"
+    border.width: 1
+
+    Row
+    {
+        id: chains
+        spacing: 0
+        anchors.top: parent.top
+        anchors.bottom: parent.bottom
+
+        Repeater
+        {
+            model: node.nodes
+            delegate: channelStripDelegate
+        }
+    }
+
+    Column
+    {
+        anchors.left: chains.right
+        anchors.right: parent.right
+        anchors.top: parent.top
+        anchors.margins: 4
+        spacing: 6
+
+        TextInput
+        {
+            width: contentWidth
+            height: contentHeight
+            anchors.horizontalCenter: parent.horizontalCenter
+
+            text: node.name
+
+            color: "#dddddd"
+
+            onEditingFinished: node.name = text
+        }
+
+        Row
+        {
+            anchors.horizontalCenter: parent.horizontalCenter
+            spacing: 1
+
+            Repeater
+            {
+                // In the order of ChainComparison::Monitor
+                model: ["A", "B", "Δ"]
+
+                delegate: O.LightButton
+                {
+                    required property string modelData
+                    required property int index
+
+                    width: 24
+                    height: 20
+
+                    bgHoveredColor: "#2f3338"
+                    bgPressedColor: "#262A2E"
+                    textColor: "#dddddd"
+                    textPressedColor: "#bbbbbb"
+
+                    font.pointSize: 11
+
+                    text: modelData
+
+                    checked: control.node.monitor === index
+                    onClicked: control.node.monitor = index
+                }
+            }
+        }
+
+        Text
+        {
+            width: parent.width
+
+            color: "#dddddd"
+            font.pointSize: 9
+            lineHeight: 1.3
+
+            text: `null rms ${control.node.nullRms.toFixed(1)} dB\n` +
+                  `null peak ${control.node.nullPeak.toFixed(1)} dB\n` +
+                  `corr ${control.node.correlation.toFixed(3)}\n\n` +
+                  `cpu A ${control.node.costA.toFixed(1)}%\n` +
+                  `cpu B ${control.node.costB.toFixed(1)}%\n\n` +
+                  `lat A ${control.node.latencyA}\n` +
+                  `lat B ${control.node.latencyB}`
+        }
+    }
+
+    O.LightButton
+    {
+        anchors.bottom: parent.bottom
+        anchors.right: parent.right
+        anchors.margins: 3
+
+        bgHoveredColor: "#2f3338"
+        bgPressedColor: "#262A2E"
+
+        textColor: "#dddddd"
+        textPressedColor: "#bbbbbb"
+
+        font.pointSize: 14
+
+        text: "M"
+
+        checked: node.isByPassed
+        onClicked: node.isByPassed = !node.isByPassed
+    }
+}
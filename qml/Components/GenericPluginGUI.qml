@@ -33,8 +33,29 @@ ListView
                 width: rowItemWidth
                 anchors.verticalCenter: parent.verticalCenter
 
+                readonly property bool isLearning: audioEngine.midiMapping.learnTarget === control.plugin &&
+                    audioEngine.midiMapping.learnParamId === model.id
+
                 horizontalAlignment: Text.AlignRight
-                text: model.name
+                text: isLearning ? "(move a controller) " + model.name : model.name
+                color: isLearning ? "#d08a20" : "#000000"
+
+                // Right click: MIDI learn, again to cancel; with Ctrl it drops the mapping
+                MouseArea
+                {
+                    anchors.fill: parent
+                    acceptedButtons: Qt.RightButton
+
+                    onClicked: (mouse) =>
+                    {
+                        if (mouse.modifiers & Qt.ControlModifier)
+                            audioEngine.midiMapping.unbind(control.plugin, model.id)
+                        else if (parent.isLearning)
+                            audioEngine.midiMapping.cancelLearn()
+                        else
+                            audioEngine.midiMapping.learn(control.plugin, model.id)
+                    }
+                }
             }
 
             Slider
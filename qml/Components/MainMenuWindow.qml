@@ -93,6 +93,28 @@ Window
                 }
             }
 
+            MainMenuWindowItem
+            {
+                text: (audioEngine.sessionLoader.isLazy ? "\u2713 " : "    ") + "Load plugins only when needed"
+                onClicked: audioEngine.sessionLoader.isLazy = !audioEngine.sessionLoader.isLazy
+            }
+
+            Item
+            {
+                height: 9
+                width: parent.width
+
+                Rectangle
+                {
+                    x: 4
+                    y: 4
+                    height: 1
+                    width: parent.width - 8
+
+                    color: "#30373f"
+                }
+            }
+
             MainMenuWindowItem
             {
                 text: "Quit"
@@ -35,11 +35,39 @@ Rectangle
 
     Text
     {
-        anchors.centerIn: parent
+        anchors.left: parent.left
+        anchors.right: parent.right
+        anchors.verticalCenter: parent.verticalCenter
+        anchors.margins: 4
 
         color: "#dddddd"
-        font.pointSize: 38
+        elide: Text.ElideMiddle
+        horizontalAlignment: Text.AlignHCenter
+        wrapMode: Text.WrapAnywhere
+        maximumLineCount: 3
 
-        text: "[WIP]"
+        text: node.isLoading ? "loading..." :
+              node.filePath === "" ? "no file" :
+              node.filePath.split("/").pop() + "\n" + node.eventCount + " events\n" +
+              Math.ceil(node.lengthInBeats) + " beats"
+    }
+
+    Button
+    {
+        anchors.horizontalCenter: parent.horizontalCenter
+        anchors.bottom: parent.bottom
+        anchors.bottomMargin: 8
+
+        text: "Open"
+
+        onClicked: fileDialog.open()
+    }
+
+    FileDialog
+    {
+        id: fileDialog
+
+        nameFilters: ["MIDI files (*.mid *.midi *.smf)"]
+        onAccepted: node.filePath = selectedFile
     }
 }
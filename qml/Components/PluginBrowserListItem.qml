@@ -61,6 +61,12 @@ MouseArea
         }
     }
 
+    onContainsMouseChanged:
+    {
+        if (containsMouse)
+            audioEngine.pluginManager.warm(modelData.path)
+    }
+
     onClicked:
     {
         control.channelStrip.load(control.plugin, modelData.path, modelData.index)
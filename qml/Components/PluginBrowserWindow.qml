@@ -199,6 +199,8 @@ Rectangle
         }
     }
 
+    Component.onCompleted: audioEngine.pluginManager.prefetchLikelyPicks()
+
     function resetWindowHeight()
     {
         let newY = y - ((height - lastHeight) / 2)
@@ -58,6 +58,13 @@ Rectangle
         spacing: 1
         padding: 3
 
+        O.SnapshotButtons
+        {
+            anchors.verticalCenter: parent.verticalCenter
+
+            node: control.plugin
+        }
+
         O.LightButton
         {
             text: "UI"
@@ -12,6 +12,8 @@ MouseArea
     property QtObject channelStrip
     property QtObject modelData
     property int buttonHeight: height + 1
+    // Node.PluginHost; a comparison has no window and isn't swapped for a plugin
+    readonly property bool isPlugin: modelData?.type === 2
 
     height: 21
 
@@ -41,7 +43,7 @@ MouseArea
 
         onPressed: (event) =>
         {
-            app.mainWindowPlugin = control.modelData
+            app.mainWindowPlugin = control.isPlugin? control.modelData.instantiate() : null
             event.accepted = false
         }
     }
@@ -65,6 +67,8 @@ MouseArea
             visible: !control.containsMouse
 
             opacity: control.modelData?.isByPassed? 0.4 : 1
+            // Not loaded yet, only its saved state is
+            font.italic: control.modelData?.isPlaceholder ?? false
         }
 
         Row
@@ -75,6 +79,7 @@ MouseArea
             {
                 id: btnOpenBrowser
 
+                visible: control.isPlugin
                 width: parent.parent.buttonWidth
                 height: control.buttonHeight
 
@@ -93,6 +98,7 @@ MouseArea
             {
                 id: btnPlugin
 
+                visible: control.isPlugin
                 width: parent.parent.buttonWidth
                 height: control.buttonHeight
 
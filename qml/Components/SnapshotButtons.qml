@@ -0,0 +1,53 @@
+import QtQuick
+import QtQuick.Controls.Basic
+import ClapWorkbench
+import "." as O
+
+
+// A/B/C: clicking an empty slot captures into it, a filled one recalls it; holding a
+// slot captures into it again
+Row
+{
+    id: control
+
+    property QtObject node
+
+    property color bgHoveredColor: "#dadada"
+    property color bgPressedColor: "#c4c4c4"
+    property color textColor: "#515151"
+    property color textPressedColor: "#454545"
+
+    spacing: 1
+
+    Repeater
+    {
+        model: ["A", "B", "C"]
+
+        delegate: O.LightButton
+        {
+            required property string modelData
+            required property int index
+
+            readonly property var snapshots: audioEngine.snapshots
+            readonly property bool isFilled: snapshots.revision, snapshots.hasSnapshot(control.node, index)
+
+            width: 20
+            height: 20
+
+            bgHoveredColor: control.bgHoveredColor
+            bgPressedColor: control.bgPressedColor
+            textColor: control.textColor
+            textPressedColor: control.textPressedColor
+
+            font.pointSize: 11
+            font.bold: isFilled
+
+            text: modelData
+
+            checked: snapshots.revision, snapshots.currentSlot(control.node) === index
+
+            onClicked: isFilled? snapshots.recall(control.node, index) : snapshots.capture(control.node, index)
+            onPressAndHold: snapshots.capture(control.node, index)
+        }
+    }
+}
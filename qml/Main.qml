@@ -38,6 +38,26 @@ Rectangle
         }
     }
 
+    Shortcut
+    {
+        sequences: [StandardKey.Undo]
+        onActivated: audioEngine.undo()
+    }
+
+    Shortcut
+    {
+        sequences: [StandardKey.Redo]
+        onActivated: audioEngine.redo()
+    }
+
+    // To the next snapshot of whatever was last captured or recalled, from any window
+    Shortcut
+    {
+        sequence: "Ctrl+B"
+        context: Qt.ApplicationShortcut
+        onActivated: audioEngine.snapshots.toggle()
+    }
+
     TopBar
     {
         id: topBar
@@ -97,7 +117,7 @@ Rectangle
     {
         id: loadSessionFileDialog
 
-        nameFilters: ["Session files (*.js)"]
+        nameFilters: ["Session files (*.cws *.js *.json)"]
         fileMode: FileDialog.OpenFile
 
         onAccepted: app.loadSession(selectedFile)
@@ -107,9 +127,9 @@ Rectangle
     {
         id: saveSessionAsFileDialog
 
-        nameFilters: ["Session files (*.js)"]
+        nameFilters: ["Session files (*.cws)", "JSON session files (*.js *.json)"]
         fileMode: FileDialog.SaveFile
-        defaultSuffix: "js"
+        defaultSuffix: "cws"
 
         onAccepted: app.saveSession(selectedFile)
     }
@@ -62,6 +62,68 @@ WindowContainer {
                 checked: audioEngine.isRunning
                 onClicked: audioEngine.isRunning = !audioEngine.isRunning
             }
+
+            O.Button {
+                id: togglePlaying
+
+                width: 42
+                height: 28
+
+                text: audioEngine.transport.isPlaying ? "\u25A0" : "\u25B6"
+
+                checked: audioEngine.transport.isPlaying
+                onClicked: audioEngine.transport.isPlaying = !audioEngine.transport.isPlaying
+                onDoubleClicked: audioEngine.transport.seek(0)
+            }
+
+            O.Button {
+                id: toggleLooping
+
+                width: 42
+                height: 28
+
+                text: "\u21BB"
+
+                checked: audioEngine.transport.isLooping
+                onClicked: audioEngine.transport.isLooping = !audioEngine.transport.isLooping
+            }
+
+            Text {
+                id: sessionLoadingProgress
+
+                height: 28
+                leftPadding: 6
+                verticalAlignment: Text.AlignVCenter
+
+                visible: audioEngine.sessionLoader.isLoading
+
+                color: "#dddddd"
+                font.pointSize: 11
+                text: {
+                    const loader = audioEngine.sessionLoader
+                    if (loader.pluginCount === 0)
+                        return "Loading session..."
+
+                    return "Loading " + (loader.loadedPluginCount + 1) + "/" + loader.pluginCount
+                        + (loader.currentPluginName.length > 0 ? ": " + loader.currentPluginName : "")
+                }
+            }
+
+            Text {
+                id: snapshotRecallLatency
+
+                height: 28
+                leftPadding: 6
+                verticalAlignment: Text.AlignVCenter
+
+                visible: !audioEngine.sessionLoader.isLoading && audioEngine.snapshots.recallLatency > 0
+
+                color: "#dddddd"
+                font.pointSize: 11
+                text: "Recalled in " + audioEngine.snapshots.recallLatency.toFixed(1) + " ms"
+                    + (audioEngine.snapshots.loadedStateCount > 0
+                        ? " (" + audioEngine.snapshots.loadedStateCount + " states loaded)" : "")
+            }
         }
 
         O.Fader
@@ -76,8 +138,8 @@ WindowContainer {
             from: 40.0
             to: 240.0
 
-            value: audioEngine.bpm
-            onPositionChanged: audioEngine.bpm = value
+            value: audioEngine.transport.bpm
+            onPositionChanged: audioEngine.transport.bpm = value
 
             orientation: Qt.Horizontal
         }
@@ -1,15 +1,14 @@
 #include "App.h"
 #include <QBuffer>
+#include <QDir>
 #include <QFileInfo>
 #include <QFontDatabase>
 #include <QGuiApplication>
-#include <QJsonArray>
-#include <QJsonDocument>
-#include <QJsonObject>
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
 #include <QQuickWindow>
 #include <QSettings>
+#include <QStandardPaths>
 #include "Utils.h"
 #include "Nodes/ChannelStrip.h"
 #include "Nodes/PluginHost.h"
@@ -18,6 +17,9 @@
 
 QString getViewTitleFromSessionName(const QString& filePath)
 {
+    if (filePath.isEmpty())
+        return "Clap Workbench - new session";
+
     const QFileInfo fileInfo(filePath);
     QString title = "Clap Workbench - ";
     title += fileInfo.completeBaseName();
@@ -71,6 +73,12 @@ App::App(int& argc, char** argv) : QGuiApplication(argc, argv)
     m_mainView.setMinimumWidth(480);
     m_mainView.setMinimumHeight(320);
 
+    m_audioEngine.sessionLoader()->setIsLazy(settings.value("session/isLazy", false).toBool());
+    m_sessionAutosaver.setInterval(settings.value("session/autosaveInterval", 60).toInt());
+    m_sessionAutosaver.setPath(autosavePath(m_currentSessionPath));
+
+    connect(&m_audioEngine, &AudioEngine::hasUnsavedChangesChanged, this, &App::updateTitle);
+
     if (const auto lastLoadedSession = settings.value("lastLoadedSession").toString();
         !lastLoadedSession.isEmpty())
     {
@@ -90,6 +98,8 @@ App::~App()
 
     settings.setValue("mainWindow/geometry", geomm);
     settings.setValue("audioEngine/isRunning", m_audioEngine.isRunning());
+    settings.setValue("session/isLazy", m_audioEngine.sessionLoader()->isLazy());
+    settings.setValue("session/autosaveInterval", m_sessionAutosaver.interval());
     settings.setValue("lastLoadedSession", m_currentSessionPath);
 }
 
@@ -103,7 +113,8 @@ void App::newSession()
     m_audioEngine.loadSession("");
 
     m_currentSessionPath = "";
-    m_mainView.setTitle("Clap Workbench - new session");
+    m_sessionAutosaver.setPath(autosavePath(m_currentSessionPath));
+    updateTitle();
 }
 
 void App::saveSession()
@@ -113,26 +124,12 @@ void App::saveSession()
 
 void App::saveSession(const QString& path)
 {
-    QJsonArray channelStripsArray;
-
-    for (const auto* channel : m_audioEngine.channelStrips())
-    {
-        QJsonObject channelObject = channel->getState();
-        channelStripsArray.append(channelObject);
-    }
-
-    const QJsonDocument jsonDoc(channelStripsArray);
-    QFile file(path.startsWith("file://")? path.mid(7) : path);
-    if (!file.open(QIODevice::WriteOnly))
-    {
-        qWarning() << "Failed to open file for writing:" << path;
+    if (!m_audioEngine.saveSession(path))
         return;
-    }
-
-    file.write(jsonDoc.toJson());
 
     m_currentSessionPath = path;
-    m_mainView.setTitle(getViewTitleFromSessionName(m_currentSessionPath));
+    m_sessionAutosaver.setPath(autosavePath(m_currentSessionPath));
+    updateTitle();
 }
 
 void App::loadSession(const QString& path)
@@ -140,7 +137,8 @@ void App::loadSession(const QString& path)
     m_audioEngine.loadSession(path);
 
     m_currentSessionPath = path;
-    m_mainView.setTitle(getViewTitleFromSessionName(m_currentSessionPath));
+    m_sessionAutosaver.setPath(autosavePath(m_currentSessionPath));
+    updateTitle();
 }
 
 void App::openPluginBrowserWindow(Node* channelStrip, Node* pluginHostToLoadInto)
@@ -168,3 +166,27 @@ void App::openPluginBrowserWindow(Node* channelStrip, Node* pluginHostToLoadInto
         pluginBrowserView->close();
     }, Qt::SingleShotConnection);
 }
+
+QString App::autosavePath(const QString& sessionPath)
+{
+    if (sessionPath.isEmpty())
+    {
+        const QDir dataDir{QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)};
+        if (!dataDir.mkpath("."))
+            return {};
+
+        return dataDir.filePath("new session.autosave.cws");
+    }
+
+    const QFileInfo fileInfo{sessionPath.startsWith("file://")? sessionPath.mid(7) : sessionPath};
+    return fileInfo.dir().filePath(fileInfo.completeBaseName() + ".autosave.cws");
+}
+
+void App::updateTitle()
+{
+    auto title = getViewTitleFromSessionName(m_currentSessionPath);
+    if (m_audioEngine.hasUnsavedChanges())
+        title += " *";
+
+    m_mainView.setTitle(title);
+}
@@ -2,6 +2,7 @@
 #include <QQmlApplicationEngine>
 #include <QQuickView>
 #include "AudioEngine.h"
+#include "SessionAutosaver.h"
 
 
 class App final : public QGuiApplication
@@ -39,6 +40,11 @@ class App final : public QGuiApplication
     QString m_currentSessionPath;
 
     AudioEngine m_audioEngine;
+    SessionAutosaver m_sessionAutosaver{m_audioEngine};
     QQmlApplicationEngine m_qmlEngine;
     QQuickView m_mainView{&m_qmlEngine, nullptr};
+
+    // Next to the session file, or in the app's data folder for a session never saved
+    [[nodiscard]] static QString autosavePath(const QString& sessionPath);
+    void updateTitle();
 };
@@ -1,16 +1,20 @@
 #include "AudioEngine.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
 #include <QAction>
-#include <QFile>
+#include <QFileInfo>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QQuickView>
-#include <QTimer>
+#include <QSaveFile>
 #include <QUndoStack>
 #include <rtaudio/RtAudio.h>
-#include <rtmidi/RtMidi.h>
+#include "Commands.h"
 #include "Nodes/ChannelStrip.h"
 #include "Nodes/PluginHost.h"
+#include "Utils/EpochReclaimer.h"
 
 AudioEngine* inst_ = nullptr;
 
@@ -26,6 +30,25 @@ AudioEngine::AudioEngine(QObject* parent) : QObject{parent}
     m_outputBuffer[0] = static_cast<float*>(std::calloc(1, m_bufferSize * 4));
     m_outputBuffer[1] = static_cast<float*>(std::calloc(1, m_bufferSize * 4));
 
+    connect(&m_sessionLoader, &SessionLoader::graphReady, this,
+        [this](const QJsonObject& transportState, const QList<Node*>& channelStrips)
+    {
+        m_transport.loadState(transportState);
+
+        for (auto* channelStrip : channelStrips)
+            appendChannelStrip(channelStrip);
+
+        emit channelStripsChanged();
+    });
+
+    // What the session was loaded with isn't a change
+    connect(&m_sessionLoader, &SessionLoader::finished, this, [this]() { markSessionClean(); });
+
+    connect(&m_transport, &Transport::tempoMapChanged, this, &AudioEngine::markSessionDirty);
+    connect(&m_transport, &Transport::timeSignatureChanged, this, &AudioEngine::markSessionDirty);
+    connect(&m_transport, &Transport::loopChanged, this, &AudioEngine::markSessionDirty);
+    connect(&m_midiMapping, &MidiMapping::bindingsChanged, this, &AudioEngine::markSessionDirty);
+
     connect(this, &AudioEngine::stopRequested, this, [this]()
     {
         qDebug() << "AudioEngine::stopRequested:";
@@ -39,6 +62,10 @@ AudioEngine::AudioEngine(QObject* parent) : QObject{parent}
             m_audio->closeStream();
         }
 
+        EpochReclaimer::instance()->setIsAudioThreadActive(false);
+        m_midiInput.close();
+        m_midiOutput.close();
+
         for (auto* channelStrip : m_channelStrips)
             channelStrip->deactivate();
 
@@ -48,6 +75,18 @@ AudioEngine::AudioEngine(QObject* parent) : QObject{parent}
     });
 
     m_undoStack = new QUndoStack(this);
+    // Plugin states in it are shared and compressed, gestures merge; this caps the rest
+    m_undoStack->setUndoLimit(500);
+
+    connect(PluginManager::instance(), &PluginManager::libraryLoaded, this, [this](const QString& path)
+    {
+        // A bundle is a directory we can watch directly, a plain binary gets rewritten inside its parent
+        const QFileInfo pluginInfo{path};
+        m_pluginWatcher.addPath(pluginInfo.isDir()? pluginInfo.absoluteFilePath() : pluginInfo.absolutePath());
+    });
+
+    connect(&m_pluginWatcher, &RecursiveFileSystemWatcher::directoryChanged,
+            this, &AudioEngine::reloadChangedPlugins);
 }
 
 AudioEngine::~AudioEngine()
@@ -58,13 +97,19 @@ AudioEngine::~AudioEngine()
         m_audio->closeStream();
     }
 
+    EpochReclaimer::instance()->setIsAudioThreadActive(false);
+    m_sessionLoader.cancel();
+
     free(m_outputBuffer[0]);
     free(m_outputBuffer[1]);
 
     m_outputBuffer[0] = nullptr;
     m_outputBuffer[1] = nullptr;
 
+    m_undoStack->clear();
     clearPluginsList();
+    PluginManager::instance()->hostPool().clear();
+    EpochReclaimer::instance()->synchronize();
 }
 
 PluginManager* AudioEngine::pluginManager() const
@@ -84,30 +129,105 @@ void AudioEngine::stop()
 
 void AudioEngine::loadSession(const QString& path)
 {
+    m_undoStack->clear();
+    m_snapshots.clear();
     clearPluginsList();
 
     if (path.isEmpty())
-        return;
-
-    QFile file(path.startsWith("file://")? path.mid(7) : path);
-    if (!file.open(QIODevice::ReadOnly))
     {
-        qWarning() << "Failed to open file for reading:" << path;
+        m_sessionLoader.cancel();
+        m_transport.loadState({});
+        markSessionClean();
         return;
     }
 
-    const auto jsonData = file.readAll();
-    const auto jsonDoc = QJsonDocument::fromJson(jsonData);
+    m_sessionLoader.load(path.startsWith("file://")? path.mid(7) : path);
+}
+
+bool AudioEngine::saveSession(const QString& path)
+{
+    const auto filePath = path.startsWith("file://")? path.mid(7) : path;
+    const bool isJson = filePath.endsWith(".js") || filePath.endsWith(".json");
+
+    bool isSaved = false;
 
-    for (const auto channels = jsonDoc.array(); const auto& jsChannelRef : channels)
+    if (isJson)
     {
-        auto jsChannel = jsChannelRef.toObject();
+        QSaveFile file(filePath);
+        if (!file.open(QIODevice::WriteOnly))
+        {
+            qWarning() << "Failed to open file for writing:" << path;
+            return false;
+        }
 
-        auto* newChannelStrip = Node::create(nullptr, jsChannel);
-        m_channelStrips.append(newChannelStrip);
+        file.write(QJsonDocument(sessionState(nullptr)).toJson());
+        isSaved = file.commit();
+    }
+    else
+    {
+        SessionFile::Writer sessionWriter;
+        const auto sessionObject = sessionState(&sessionWriter);
+        isSaved = sessionWriter.write(filePath, sessionObject);
     }
 
-    emit channelStripsChanged();
+    if (!isSaved)
+    {
+        // Still to be written, by the next autosave at least
+        markSessionDirty();
+        return false;
+    }
+
+    m_hasUnsavedChanges = false;
+    emit hasUnsavedChangesChanged();
+
+    return true;
+}
+
+QJsonObject AudioEngine::sessionState(SessionFile::Writer* sessionWriter)
+{
+    // While it's set, plugins hand their state to it instead of base64 encoding it
+    m_sessionWriter = sessionWriter;
+
+    QJsonArray channelStripsArray;
+    for (auto* channel : m_channelStrips)
+    {
+        channelStripsArray.append(channel->getState());
+        channel->markClean();
+    }
+
+    m_sessionWriter = nullptr;
+    m_isSessionDirty = false;
+
+    QJsonObject sessionObject;
+    sessionObject["transport"] = m_transport.getState();
+    sessionObject["channelStrips"] = channelStripsArray;
+
+    return sessionObject;
+}
+
+void AudioEngine::markSessionDirty()
+{
+    m_isSessionDirty = true;
+
+    if (m_hasUnsavedChanges)
+        return;
+
+    m_hasUnsavedChanges = true;
+    emit hasUnsavedChangesChanged();
+}
+
+void AudioEngine::markSessionClean()
+{
+    for (auto* channel : m_channelStrips)
+        channel->markClean();
+
+    m_isSessionDirty = false;
+
+    if (!m_hasUnsavedChanges)
+        return;
+
+    m_hasUnsavedChanges = false;
+    emit hasUnsavedChangesChanged();
 }
 
 QList<Node*> AudioEngine::channelStrips() const
@@ -120,6 +240,10 @@ void AudioEngine::clearPluginsList()
     for (auto* channelStrip : m_channelStrips)
     {
         channelStrip->clearNodes();
+
+        if (auto* strip = qobject_cast<ChannelStrip*>(channelStrip))
+            strip->publishChain();
+
         emit channelStrip->nodesChanged();
     }
 }
@@ -138,15 +262,13 @@ void AudioEngine::start()
         return;
     }
 
-    m_midiIn = std::make_unique<RtMidiIn>();
-    for (unsigned int i = 0; i < m_midiIn->getPortCount(); ++i)
-    {
-        std::string portName = m_midiIn->getPortName(i);
-        std::cout << "  Input Port #" << i << ": " << portName << '\n';
+    m_midiInput.open();
+    m_midiMapping.setPortNames(m_midiInput.portNames());
+    emit midiInputPortsChanged();
 
-        if (i > 0)
-            m_midiIn->openPort(i);
-    }
+    m_midiOutput.open();
+    m_midiOutput.resetJitterStats();
+    emit midiOutputPortsChanged();
 
     RtAudio::StreamParameters inParams;
     inParams.deviceId = m_audio->getDefaultInputDevice();
@@ -178,24 +300,44 @@ void AudioEngine::start()
                        &AudioEngine::audioCallback,
                        this);
 
+    m_workerPool.setPeriod(m_bufferSize, m_sampleRate);
+
     for (unsigned int i = 0; i < m_bufferSize; ++i)
     {
         m_outputBuffer[0][i] = 0.0f;
         m_outputBuffer[1][i] = 0.0f;
     }
 
+    // Placeholders about to be processed load one per event loop turn once it runs, and
+    // get swapped in like any plugin; what's folded away in collapsed strips goes last
+    QList<PluginHost*> placeholders;
+    for (auto* channelStrip : m_channelStrips)
+    {
+        for (auto* plugin : channelStrip->findChildren<PluginHost*>())
+        {
+            if (plugin->isPlaceholder() && !plugin->isByPassed() && !ChannelStrip::isInFrozenStrip(plugin))
+                placeholders.append(plugin);
+        }
+    }
+
+    std::ranges::stable_partition(placeholders, [](const PluginHost* plugin) { return !ChannelStrip::isInCollapsedStrip(plugin); });
+
     for (auto* channelStrip : m_channelStrips)
     {
         channelStrip->setPorts(2, m_outputBuffer, 2, m_outputBuffer);
         channelStrip->activate(m_sampleRate, static_cast<int>(m_bufferSize));
     }
 
+    EpochReclaimer::instance()->setIsAudioThreadActive(true);
     m_audio->startStream();
 
     auto curStatus = m_status.load();
     curStatus.status = S::Starting;
     m_status.store(curStatus);
     emit isRunningChanged();
+
+    for (auto* plugin : placeholders)
+        m_sessionLoader.instantiateLater(*plugin);
 }
 
 void AudioEngine::pause()
@@ -208,21 +350,36 @@ void AudioEngine::pause()
 }
 
 void AudioEngine::addNewChannelStrip()
+{
+    QJsonObject pluginStateJson;
+    pluginStateJson["type"] = "ChannelStrip";
+
+    appendChannelStrip(Node::create(nullptr, pluginStateJson));
+    emit channelStripsChanged();
+    markSessionDirty();
+}
+
+void AudioEngine::appendChannelStrip(Node* channelStrip)
 {
     auto oldStatus = m_status.load();
     const auto curStatusStatus = oldStatus.status;
     oldStatus.status = S::Stopped;
     m_status.store(oldStatus);
 
-    QJsonObject pluginStateJson;
-    pluginStateJson["type"] = "ChannelStrip";
+    if (curStatusStatus > S::Stopped)
+    {
+        channelStrip->setPorts(2, m_outputBuffer, 2, m_outputBuffer);
+        channelStrip->activate(m_sampleRate, static_cast<int>(m_bufferSize));
 
-    auto* newChannelStrip = Node::create(nullptr, pluginStateJson);
-    m_channelStrips.append(newChannelStrip);
+        auto stripStatus = channelStrip->status.load();
+        stripStatus.status = S::Starting;
+        channelStrip->status.store(stripStatus);
+    }
+
+    m_channelStrips.append(channelStrip);
 
     oldStatus.status = curStatusStatus;
     m_status.store(oldStatus);
-    emit channelStripsChanged();
 }
 
 void AudioEngine::unload(Node* pluginToUnload)
@@ -234,9 +391,26 @@ void AudioEngine::unload(Node* pluginToUnload)
     if (!parent)
         return;
 
+    auto* channelStrip = dynamic_cast<ChannelStrip*>(parent);
+    if (auto* plugin = dynamic_cast<PluginHost*>(pluginToUnload); channelStrip && plugin)
+    {
+        // Goes to the warm pool instead of being destroyed, so undo is instant
+        m_undoStack->push(new RemovePluginCommand(*channelStrip, *plugin));
+        return;
+    }
+
+    if (channelStrip)
+    {
+        channelStrip->deleteNode(pluginToUnload);
+        return;
+    }
+
+    ChannelStrip::cancelRender(parent);
     ++parent->pendingTopologyChanges;
 
-    QTimer::singleShot(700, this, [parent, pluginToUnload]()
+    // Only touch the parent's node list once the audio thread is guaranteed
+    // to have seen the pending topology change
+    EpochReclaimer::instance()->retire([parent, pluginToUnload]()
     {
         parent->m_nodes.removeAll(pluginToUnload);
         emit parent->nodesChanged();
@@ -246,6 +420,47 @@ void AudioEngine::unload(Node* pluginToUnload)
     });
 }
 
+void AudioEngine::reloadChangedPlugins(const QString& changedPath)
+{
+    auto* pluginManager = PluginManager::instance();
+
+    std::function<void(Node*)> reloadIn = [&](Node* node)
+    {
+        auto* channelStrip = dynamic_cast<ChannelStrip*>(node);
+        if (!channelStrip)
+            return;
+
+        for (auto* child : channelStrip->m_channels)
+            reloadIn(child);
+
+        // Copied, reloadPlugin() swaps entries in m_nodes
+        for (const auto nodes = channelStrip->m_nodes; auto* child : nodes)
+        {
+            auto* plugin = dynamic_cast<PluginHost*>(child);
+            if (!plugin)
+            {
+                // The chains of a comparison
+                for (auto* grandChild : child->m_nodes)
+                    reloadIn(grandChild);
+
+                continue;
+            }
+
+            if (!pluginManager->isBinaryOutdated(*plugin))
+                continue;
+
+            const QFileInfo pluginInfo{plugin->path()};
+            if (!changedPath.startsWith(pluginInfo.absoluteFilePath()) && changedPath != pluginInfo.absolutePath())
+                continue;
+
+            channelStrip->reloadPlugin(plugin);
+        }
+    };
+
+    for (auto* channelStrip : m_channelStrips)
+        reloadIn(channelStrip);
+}
+
 bool AudioEngine::isRunning() const
 {
     return m_status.load().status > S::Stopped;
@@ -301,25 +516,37 @@ void AudioEngine::setIsByPassed(const bool newValue)
     emit isByPassedChanged();
 }
 
-double AudioEngine::bpm() const { return m_bpm; }
-
-void AudioEngine::setBpm(const double newBpm)
+QVariantMap AudioEngine::midiOutputJitter() const
 {
-    if (qFuzzyCompare(newBpm, m_bpm))
-        return;
-
-    m_bpm = newBpm;
+    const auto jitter = m_midiOutput.jitterStats();
+
+    return {
+        {"sent", static_cast<qulonglong>(jitter.sentCount)},
+        {"dropped", static_cast<qulonglong>(jitter.droppedCount)},
+        {"mean", jitter.meanMicroseconds},
+        {"max", jitter.maxMicroseconds},
+    };
+}
 
-    emit bpmChanged();
+void AudioEngine::setMidiOutputFile(const QString& path)
+{
+    m_midiOutput.setFileSink(path.startsWith("file://")? path.mid(7) : path);
 }
 
 void AudioEngine::undo() const { m_undoStack->undo(); }
 
+void AudioEngine::redo() const { m_undoStack->redo(); }
+
 int AudioEngine::audioCallback(void* outputBuffer, void*, const unsigned int frameCount,
-                               const double currentTime, RtAudioStreamStatus,
+                               double /*streamTime*/, RtAudioStreamStatus,
                                void* data)
 {
     auto* engine = static_cast<AudioEngine*>(data);
+    EpochReclaimer::instance()->advance();
+
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    engine->m_blockStartTime = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+
     auto status = engine->m_status.load();
 
     auto* out = static_cast<float*>(outputBuffer);
@@ -356,27 +583,18 @@ int AudioEngine::audioCallback(void* outputBuffer, void*, const unsigned int fra
         engine->m_status.store(status);
     }
 
-    // Midi
-    {
-        auto& midiBuffer = engine->m_midiInBuffer;
-        while (engine->m_midiIn && engine->m_midiIn->isPortOpen())
+    engine->m_midiInput.drain(engine->m_blockStartTime, engine->m_sampleRate, frameCount,
+        [engine](const int port, const int sampleOffset, const std::span<const unsigned char> data)
         {
-            const auto msgTime = engine->m_midiIn->getMessage(&midiBuffer);
-            if (midiBuffer.empty())
-                break;
-
-            const double deltaMs = currentTime - msgTime;
-            double deltaSample = (deltaMs * engine->m_sampleRate) / 1000;
-
-            if (deltaSample >= frameCount)
-                deltaSample = frameCount - 1;
-
-            const int32_t sampleOffset = static_cast<int>(frameCount) - static_cast<int>(deltaSample);
+            // Mapped controllers still reach the plugins as MIDI too
+            engine->m_midiMapping.process(port, sampleOffset, data);
 
             for (auto* channelStrip : engine->m_channelStrips)
-                channelStrip->processNoteRawMidi(sampleOffset, midiBuffer);
-        }
-    }
+                channelStrip->processNoteRawMidi(sampleOffset, port, data);
+        });
+
+    // Every node reads the same transport event this block
+    engine->m_transport.advance(engine->m_sampleRate, frameCount);
 
     std::memset(engine->m_outputBuffer[0], 0, frameCount * sizeof(float));
     std::memset(engine->m_outputBuffer[1], 0, frameCount * sizeof(float));
@@ -1,13 +1,22 @@
 #pragma once
 #include <QObject>
+#include <QVariantMap>
+#include "MidiInput.h"
+#include "MidiMapping.h"
+#include "MidiOutput.h"
 #include "Nodes/Node.h"
 #include "PluginManager.h"
+#include "SessionLoader.h"
+#include "Snapshots.h"
+#include "Transport.h"
+#include "Utils/RealtimeWorkerPool.h"
 #include "Utils/RecursiveFileSystemWatcher.h"
+#include "Utils/SessionFile.h"
+#include "Utils/StateStore.h"
 
 
 typedef unsigned int RtAudioStreamStatus;
 class RtAudio;
-class RtMidiIn;
 class PluginInstanceWindow;
 class QUndoStack;
 class QAction;
@@ -20,9 +29,15 @@ class AudioEngine final : public QObject
     Q_PROPERTY(PluginManager* pluginManager READ pluginManager CONSTANT)
     Q_PROPERTY(bool isRunning READ isRunning WRITE setIsRunning NOTIFY isRunningChanged)
     Q_PROPERTY(QList<Node*> channelStrips READ channelStrips NOTIFY channelStripsChanged)
-    Q_PROPERTY(double bpm READ bpm WRITE setBpm NOTIFY bpmChanged)
+    Q_PROPERTY(Transport* transport READ transport CONSTANT)
     Q_PROPERTY(float outputVolume READ outputVolume WRITE setOutputVolume NOTIFY outputVolumeChanged)
     Q_PROPERTY(bool isByPassed READ isByPassed WRITE setIsByPassed NOTIFY isByPassedChanged)
+    Q_PROPERTY(QStringList midiInputPorts READ midiInputPorts NOTIFY midiInputPortsChanged)
+    Q_PROPERTY(QStringList midiOutputPorts READ midiOutputPorts NOTIFY midiOutputPortsChanged)
+    Q_PROPERTY(MidiMapping* midiMapping READ midiMapping CONSTANT)
+    Q_PROPERTY(SessionLoader* sessionLoader READ sessionLoader CONSTANT)
+    Q_PROPERTY(bool hasUnsavedChanges READ hasUnsavedChanges NOTIFY hasUnsavedChangesChanged)
+    Q_PROPERTY(Snapshots* snapshots READ snapshots CONSTANT)
 
 
   public:
@@ -37,7 +52,26 @@ class AudioEngine final : public QObject
     void pause();
     void stop();
 
+    // Sessions are written as JSON when the path ends in .js or .json, as a
+    // SessionFile otherwise; loading tells them apart by their contents and
+    // returns right away, the session comes in through the SessionLoader
     void loadSession(const QString& path);
+    [[nodiscard]] bool saveSession(const QString& path);
+
+    [[nodiscard]] SessionLoader* sessionLoader() { return &m_sessionLoader; }
+
+    // The session file being saved, null the rest of the time
+    [[nodiscard]] SessionFile::Writer* sessionWriter() const { return m_sessionWriter; }
+
+    // The session as it gets saved, with the plugin states handed to sessionWriter
+    // when there is one; leaves every node clean
+    [[nodiscard]] QJsonObject sessionState(SessionFile::Writer* sessionWriter);
+
+    // Changed since it was last written anywhere, an autosave included
+    [[nodiscard]] bool isSessionDirty() const { return m_isSessionDirty; }
+    // Changed since it was last loaded or saved by hand
+    [[nodiscard]] bool hasUnsavedChanges() const { return m_hasUnsavedChanges; }
+    void markSessionDirty();
 
     void clearPluginsList();
 
@@ -52,16 +86,41 @@ class AudioEngine final : public QObject
     [[nodiscard]] bool isByPassed() const;
     void setIsByPassed(bool newValue);
 
-    [[nodiscard]] double bpm() const;
-    void setBpm(double newBpm);
+    [[nodiscard]] QStringList midiInputPorts() const { return m_midiInput.portNames(); }
+    [[nodiscard]] QStringList midiOutputPorts() const { return m_midiOutput.portNames(); }
+
+    [[nodiscard]] MidiOutput& midiOutput() { return m_midiOutput; }
+    [[nodiscard]] MidiMapping* midiMapping() { return &m_midiMapping; }
+
+    // How far from their due time MIDI messages went out, in microseconds
+    [[nodiscard]] Q_INVOKABLE QVariantMap midiOutputJitter() const;
+
+    [[nodiscard]] Transport* transport() { return &m_transport; }
 
     [[nodiscard]] QUndoStack& undoStack() const { return *m_undoStack; }
 
+    // Where undo steps and snapshots keep the plugin states they hold on to
+    [[nodiscard]] StateStore& stateStore() { return m_stateStore; }
+
+    [[nodiscard]] Snapshots* snapshots() { return &m_snapshots; }
+
+    // Steady clock time, in nanoseconds, at which the current audio callback started
+    [[nodiscard]] std::int64_t blockStartTime() const noexcept { return m_blockStartTime; }
+
+    // Shared by everything on the audio thread that wants to go parallel
+    [[nodiscard]] RealtimeWorkerPool& workerPool() { return m_workerPool; }
+
 
   public slots:
     void addNewChannelStrip();
     void unload(Node* pluginToUnload);
     void undo() const;
+    void redo() const;
+
+    void reloadChangedPlugins(const QString& changedPath);
+
+    // Also writes every outgoing MIDI message to this file, an empty path stops it
+    void setMidiOutputFile(const QString& path);
 
 
   signals:
@@ -70,7 +129,10 @@ class AudioEngine final : public QObject
 
     void isRunningChanged();
     void outputVolumeChanged();
-    void bpmChanged();
+    void midiInputPortsChanged();
+    void midiOutputPortsChanged();
+
+    void hasUnsavedChangesChanged();
 
     void stopRequested();
 
@@ -85,12 +147,14 @@ class AudioEngine final : public QObject
                              RtAudioStreamStatus /*status*/,
                              void* data);
 
-    std::atomic<double> m_bpm = 120.0;
     int m_sampleRate = 48000;
+    std::int64_t m_blockStartTime = 0;
     unsigned int m_bufferSize = 4096;
     std::unique_ptr<RtAudio> m_audio;
-    std::unique_ptr<RtMidiIn> m_midiIn;
-    std::vector<unsigned char> m_midiInBuffer;
+    MidiInput m_midiInput;
+    MidiOutput m_midiOutput;
+    MidiMapping m_midiMapping;
+    Transport m_transport;
 
     int m_inputChannelCount = 0;
     int m_outputChannelCount = 0;
@@ -99,10 +163,23 @@ class AudioEngine final : public QObject
 
     QList<Node*> m_channelStrips;
 
+    SessionLoader m_sessionLoader;
+    SessionFile::Writer* m_sessionWriter = nullptr;
+    bool m_isSessionDirty = false;
+    bool m_hasUnsavedChanges = false;
+
+    void markSessionClean();
+
+    // Also gets it going when the engine already is
+    void appendChannelStrip(Node* channelStrip);
+
     std::atomic<float> m_outputVolume = 0.3f;
 
     QUndoStack* m_undoStack = nullptr;
+    StateStore m_stateStore;
+    Snapshots m_snapshots;
     double m_gestureInitialValue = 0.0;
 
     RecursiveFileSystemWatcher m_pluginWatcher;
+    RealtimeWorkerPool m_workerPool;
 };
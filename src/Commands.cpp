@@ -1,5 +1,55 @@
 #include "Commands.h"
+#include <utility>
+#include "AudioEngine.h"
 #include "ParameterModel.h"
+#include "PluginManager.h"
+#include "Nodes/ChannelStrip.h"
+#include "Nodes/PluginHost.h"
+
+
+namespace
+{
+
+// What a removal does with the plugin taken out; placeholders aren't worth keeping
+// loaded, their state is all there is to them
+std::function<void(PluginHost*)> parkUnder(std::shared_ptr<PendingRemoval> removal)
+{
+    return [removal = std::move(removal)](PluginHost* plugin)
+    {
+        if (removal->isCancelled)
+            return;
+
+        removal->isDone = true;
+
+        if (plugin->isPlaceholder())
+        {
+            plugin->deleteLater();
+            return;
+        }
+
+        removal->poolTicket = PluginManager::instance()->hostPool().park(plugin);
+    };
+}
+
+}
+
+
+StoredPluginState StoredPluginState::of(const PluginHost& plugin)
+{
+    // Without a session being saved, the state comes base64 encoded in the node
+    auto node = plugin.getState();
+    const auto blob = QByteArray::fromBase64(node.take("stateData").toString().toUtf8());
+
+    return {node, AudioEngine::instance()->stateStore().put(blob)};
+}
+
+PluginHost* StoredPluginState::restore(Node& parent) const
+{
+    auto* plugin = new PluginHost(&parent);
+    plugin->loadState(node, blob? blob->data() : QByteArray{});
+
+    return plugin;
+}
 
 
 ChangeParameterValueCommand::ChangeParameterValueCommand(ParameterModel& model, const unsigned int parameterId,
@@ -16,3 +66,149 @@ void ChangeParameterValueCommand::redo()
 {
     m_model.setValue(m_parameterId, newValue_);
 }
+
+bool ChangeParameterValueCommand::mergeWith(const QUndoCommand* other)
+{
+    const auto* next = static_cast<const ChangeParameterValueCommand*>(other);
+    if (&next->m_model != &m_model || next->m_parameterId != m_parameterId || next->m_time - m_time > mergeWindow)
+        return false;
+
+    newValue_ = next->newValue_;
+    m_time = next->m_time;
+
+    // Back where it started, nothing to undo
+    setObsolete(qFuzzyCompare(oldValue_, newValue_));
+
+    return true;
+}
+
+
+RemovePluginCommand::RemovePluginCommand(ChannelStrip& channelStrip, PluginHost& plugin, QUndoCommand* parent)
+    : QUndoCommand{parent}
+    , m_channelStrip{channelStrip}
+    , m_plugin{&plugin}
+    , m_index{static_cast<int>(channelStrip.m_nodes.indexOf(&plugin))}
+    , m_state{StoredPluginState::of(plugin)}
+{
+    setText("Remove " + plugin.name());
+}
+
+void RemovePluginCommand::undo()
+{
+    // Still on its way out, still active and started: it goes back in as it is
+    if (m_plugin && !m_removal->isDone)
+    {
+        m_removal->isCancelled = true;
+        m_removal = std::make_shared<PendingRemoval>();
+
+        m_channelStrip.insertPlugin(m_index, m_plugin);
+        return;
+    }
+
+    auto* plugin = PluginManager::instance()->hostPool().take(m_removal->poolTicket);
+    if (!plugin)
+        plugin = m_state.restore(m_channelStrip);
+
+    m_removal = std::make_shared<PendingRemoval>();
+    m_plugin = plugin;
+
+    m_channelStrip.startPlugin(plugin);
+    m_channelStrip.insertPlugin(m_index, plugin);
+}
+
+void RemovePluginCommand::redo()
+{
+    if (!m_plugin)
+        return;
+
+    m_channelStrip.removePlugin(m_plugin, parkUnder(m_removal));
+}
+
+
+ReplacePluginCommand::ReplacePluginCommand(ChannelStrip& channelStrip, const int index, PluginHost* oldPlugin,
+    PluginHost& newPlugin, QUndoCommand* parent)
+    : QUndoCommand{parent}
+    , m_channelStrip{channelStrip}
+    , m_index{index}
+    , m_newState{StoredPluginState::of(newPlugin)}
+    , m_current{&newPlugin}
+{
+    if (oldPlugin)
+    {
+        m_oldState = StoredPluginState::of(*oldPlugin);
+        setText("Replace " + oldPlugin->name() + " with " + newPlugin.name());
+    }
+    else
+    {
+        setText("Add " + newPlugin.name());
+    }
+}
+
+std::function<void(PluginHost*)> ReplacePluginCommand::parkTakenOut() const
+{
+    return parkUnder(m_removal);
+}
+
+void ReplacePluginCommand::undo()
+{
+    // Saved as it is now, for redo to bring it back like that
+    if (m_current)
+        m_newState = StoredPluginState::of(*m_current);
+
+    swapIn(m_oldState);
+}
+
+void ReplacePluginCommand::redo()
+{
+    if (std::exchange(m_isFirstRedo, false))
+        return;
+
+    if (m_current && m_oldState)
+        m_oldState = StoredPluginState::of(*m_current);
+
+    swapIn(m_newState);
+}
+
+void ReplacePluginCommand::swapIn(const std::optional<StoredPluginState>& state)
+{
+    auto* current = m_current.data();
+
+    PluginHost* next = nullptr;
+    if (state)
+    {
+        next = PluginManager::instance()->hostPool().take(m_removal->poolTicket);
+        if (!next)
+            next = state->restore(m_channelStrip);
+
+        m_channelStrip.startPlugin(next);
+    }
+
+    m_removal = std::make_shared<PendingRemoval>();
+
+    if (current && next)
+        m_channelStrip.replacePlugin(current, next, parkUnder(m_removal));
+    else if (current)
+        m_channelStrip.removePlugin(current, parkUnder(m_removal));
+    else if (next)
+        m_channelStrip.insertPlugin(m_index, next);
+
+    m_current = next;
+}
+
+
+MovePluginCommand::MovePluginCommand(ChannelStrip& channelStrip, const int from, const int to, QUndoCommand* parent)
+    : QUndoCommand{parent}, m_channelStrip{channelStrip}, m_from{from}, m_to{to}
+{
+    if (const auto* plugin = m_channelStrip.m_nodes.value(from))
+        setText("Move " + plugin->name());
+}
+
+void MovePluginCommand::undo()
+{
+    m_channelStrip.reorder(m_to, m_from);
+}
+
+void MovePluginCommand::redo()
+{
+    m_channelStrip.reorder(m_from, m_to);
+}
@@ -1,8 +1,43 @@
 #pragma once
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <QJsonObject>
+#include <QPointer>
 #include <QUndoCommand>
+#include "Utils/StateStore.h"
 
 
 class ParameterModel;
+class ChannelStrip;
+class Node;
+class PluginHost;
+
+
+// A plugin the way it saves itself, with the state blob itself in the engine's state store
+struct StoredPluginState
+{
+    QJsonObject node;
+    StateStore::Ref blob;
+
+    [[nodiscard]] static StoredPluginState of(const PluginHost& plugin);
+
+    // A new plugin, loaded and with its state back, not started yet
+    [[nodiscard]] PluginHost* restore(Node& parent) const;
+};
+
+
+// Shared by a command with the removal it started, which happens once the audio thread
+// is done with the plugin and may outlive the command
+struct PendingRemoval
+{
+    // Where the plugin was parked, 0 when it wasn't
+    quint64 poolTicket = 0;
+    bool isDone = false;
+    // Put back in before the removal got to it, which then leaves it alone
+    bool isCancelled = false;
+};
 
 
 class ChangeParameterValueCommand final : public QUndoCommand
@@ -15,10 +50,84 @@ class ChangeParameterValueCommand final : public QUndoCommand
     void redo() override;
     [[nodiscard]] int id() const override { return Id; }
 
+    // Changes of the same parameter in quick succession undo as one
+    bool mergeWith(const QUndoCommand* other) override;
+
 
   private:
+    static constexpr std::chrono::milliseconds mergeWindow{1500};
+
     ParameterModel& m_model;
     unsigned int m_parameterId;
     double oldValue_;
     double newValue_;
+    std::chrono::steady_clock::time_point m_time = std::chrono::steady_clock::now();
+};
+
+
+class RemovePluginCommand final : public QUndoCommand
+{
+  public:
+    RemovePluginCommand(ChannelStrip& channelStrip, PluginHost& plugin, QUndoCommand* parent = nullptr);
+
+    void undo() override;
+    void redo() override;
+
+
+  private:
+    ChannelStrip& m_channelStrip;
+    // In the strip, on its way out, or parked; none once it's evicted
+    QPointer<PluginHost> m_plugin;
+    int m_index;
+    // Used to recreate the plugin in case it was evicted from the pool in the meantime
+    StoredPluginState m_state;
+    std::shared_ptr<PendingRemoval> m_removal = std::make_shared<PendingRemoval>();
+};
+
+
+// A plugin loaded into a slot, an empty one or in place of another plugin. Pushed
+// once the new plugin is in, so the first redo has nothing left to do
+class ReplacePluginCommand final : public QUndoCommand
+{
+  public:
+    ReplacePluginCommand(ChannelStrip& channelStrip, int index, PluginHost* oldPlugin, PluginHost& newPlugin, QUndoCommand* parent = nullptr);
+
+    void undo() override;
+    void redo() override;
+
+    // For the plugin taken out, so it's the one that goes back in on undo
+    [[nodiscard]] std::function<void(PluginHost*)> parkTakenOut() const;
+
+
+  private:
+    ChannelStrip& m_channelStrip;
+    // Where it goes back in when the slot was empty
+    int m_index;
+    // None when the slot was empty
+    std::optional<StoredPluginState> m_oldState;
+    StoredPluginState m_newState;
+    // The plugin the last undo or redo put in, none for an empty slot
+    QPointer<PluginHost> m_current;
+    std::shared_ptr<PendingRemoval> m_removal = std::make_shared<PendingRemoval>();
+    bool m_isFirstRedo = true;
+
+    // Swaps m_current for the plugin parked under the ticket, or one restored from the
+    // state when it's gone from the pool; takes it out for none
+    void swapIn(const std::optional<StoredPluginState>& state);
+};
+
+
+class MovePluginCommand final : public QUndoCommand
+{
+  public:
+    MovePluginCommand(ChannelStrip& channelStrip, int from, int to, QUndoCommand* parent = nullptr);
+
+    void undo() override;
+    void redo() override;
+
+
+  private:
+    ChannelStrip& m_channelStrip;
+    int m_from;
+    int m_to;
 };
@@ -0,0 +1,85 @@
+#include "MidiInput.h"
+#include <algorithm>
+#include <chrono>
+#include <QtDebug>
+#include <rtmidi/RtMidi.h>
+
+
+MidiInput::MidiInput() = default;
+
+MidiInput::~MidiInput()
+{
+    close();
+}
+
+void MidiInput::open()
+{
+    close();
+
+    RtMidiIn portLister;
+    const auto portCount = portLister.getPortCount();
+
+    for (unsigned int i = 0; i < portCount; ++i)
+    {
+        auto port = std::make_unique<Port>();
+        port->index = static_cast<int>(m_ports.size());
+        port->name = QString::fromStdString(portLister.getPortName(i));
+        port->midiIn = std::make_unique<RtMidiIn>();
+
+        // Set before opening so nothing is queued inside RtMidi in the meantime
+        port->midiIn->setCallback(&MidiInput::onMidiMessage, port.get());
+        port->midiIn->ignoreTypes(false, true, true);
+        port->midiIn->openPort(i, "Clap Workbench");
+
+        if (!port->midiIn->isPortOpen())
+        {
+            qWarning() << "Could not open MIDI input port:" << port->name;
+            continue;
+        }
+
+        qDebug() << "MIDI input port #" << i << ":" << port->name;
+        m_ports.push_back(std::move(port));
+    }
+}
+
+void MidiInput::close()
+{
+    for (const auto& port : m_ports)
+    {
+        port->midiIn->cancelCallback();
+        port->midiIn->closePort();
+    }
+
+    m_ports.clear();
+}
+
+QStringList MidiInput::portNames() const
+{
+    QStringList names;
+    for (const auto& port : m_ports)
+        names.append(port->name);
+
+    return names;
+}
+
+std::uint64_t MidiInput::droppedMessageCount() const
+{
+    std::uint64_t count = 0;
+    for (const auto& port : m_ports)
+        count += port->ring.droppedCount();
+
+    return count;
+}
+
+void MidiInput::onMidiMessage(double, std::vector<unsigned char>* message, void* userData)
+{
+    auto& port = *static_cast<Port*>(userData);
+
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    const auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+
+    if (!message)
+        return;
+
+    port.ring.push(time, port.index, *message);
+}
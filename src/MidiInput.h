@@ -0,0 +1,77 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+#include <QStringList>
+#include "Utils/MidiMessageRing.h"
+
+
+class RtMidiIn;
+
+
+// Every MIDI input port, each one opened on its own RtMidiIn. Messages arrive on
+// RtMidi's thread, get a steady clock timestamp and go into a lock-free ring per
+// port, which the audio thread drains at the start of each block. SysEx comes
+// through the same way, its bytes are only valid during onMessage.
+class MidiInput
+{
+  public:
+    MidiInput();
+    ~MidiInput();
+    MidiInput(MidiInput&) = delete;
+    MidiInput(MidiInput&&) = delete;
+    MidiInput(const MidiInput&) = delete;
+    MidiInput(const MidiInput&&) = delete;
+
+    // Main thread, while the audio thread isn't draining
+    void open();
+    void close();
+
+    [[nodiscard]] QStringList portNames() const;
+
+    // audio thread: onMessage(int port, int sampleOffset, std::span<const unsigned char> data)
+    // Messages that came in during the previous block are placed at the same relative
+    // position in this one, so the latency is one block and doesn't jitter
+    template <typename Callback>
+    void drain(std::int64_t blockStartTime, std::int32_t sampleRate, std::uint32_t frameCount, Callback&& onMessage)
+    {
+        const auto blockDuration = static_cast<std::int64_t>(1'000'000'000.0 * frameCount / sampleRate);
+        const auto windowStart = blockStartTime - blockDuration;
+
+        for (const auto& port : m_ports)
+        {
+            // Anything newer than the block's start waits for the next one
+            for (auto message = port->ring.front(); message && message->time < blockStartTime; message = port->ring.front())
+            {
+                const auto position = blockDuration > 0
+                    ? (message->time - windowStart) * static_cast<std::int64_t>(frameCount) / blockDuration
+                    : 0;
+
+                onMessage(port->index, static_cast<int>(std::clamp<std::int64_t>(position, 0, frameCount - 1)),
+                          message->data);
+
+                port->ring.pop();
+            }
+        }
+    }
+
+    [[nodiscard]] std::uint64_t droppedMessageCount() const;
+
+
+  private:
+    struct Port
+    {
+        int index = 0;
+        std::unique_ptr<RtMidiIn> midiIn;
+        QString name;
+
+        // Enough for a few multi-kilobyte SysEx dumps in flight
+        MidiMessageRing ring{1024, 256 * 1024};
+    };
+
+    std::vector<std::unique_ptr<Port>> m_ports;
+
+    static void onMidiMessage(double deltaTime, std::vector<unsigned char>* message, void* userData);
+};
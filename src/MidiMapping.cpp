@@ -0,0 +1,409 @@
+#include "MidiMapping.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <QJsonObject>
+#include <QMetaEnum>
+#include "Nodes/ChannelStrip.h"
+#include "Nodes/PluginHost.h"
+#include "Utils/EpochReclaimer.h"
+
+
+MidiMapping::MidiMapping(QObject* parent) : QObject{parent}
+{
+    m_learnTimer.setInterval(16);
+    connect(&m_learnTimer, &QTimer::timeout, this, &MidiMapping::collectLearned);
+}
+
+MidiMapping::~MidiMapping()
+{
+    m_table.store(nullptr);
+}
+
+void MidiMapping::bind(const Binding& binding)
+{
+    if (!binding.plugin)
+        return;
+
+    std::erase_if(m_bindings, [&binding](const Binding& existing)
+    {
+        return existing.plugin == binding.plugin && existing.paramId == binding.paramId;
+    });
+
+    m_bindings.push_back(binding);
+    publish();
+}
+
+void MidiMapping::removeBindings(const PluginHost& plugin)
+{
+    if (m_learnTarget == &plugin)
+        cancelLearn();
+
+    if (std::erase_if(m_bindings, [&plugin](const Binding& binding) { return binding.plugin == &plugin; }) > 0)
+        publish();
+}
+
+void MidiMapping::refresh(const PluginHost& plugin)
+{
+    const auto* parameters = plugin.parameters();
+
+    std::erase_if(m_bindings, [&plugin, parameters](const Binding& binding)
+    {
+        return binding.plugin == &plugin && (!parameters || parameters->rowOf(binding.paramId) < 0);
+    });
+
+    publish();
+}
+
+void MidiMapping::suspendBindings(const PluginHost& plugin)
+{
+    if (m_learnTarget == &plugin)
+        cancelLearn();
+
+    setIsSuspended(plugin, true);
+}
+
+void MidiMapping::resumeBindings(const PluginHost& plugin)
+{
+    setIsSuspended(plugin, false);
+}
+
+void MidiMapping::updateStrips(const PluginHost& plugin)
+{
+    if (std::ranges::contains(m_bindings, &plugin, &Binding::plugin))
+        publishTable();
+}
+
+void MidiMapping::setIsSuspended(const PluginHost& plugin, const bool isSuspended)
+{
+    bool hasChanged = false;
+    for (auto& binding : m_bindings)
+    {
+        if (binding.plugin != &plugin || binding.isSuspended == isSuspended)
+            continue;
+
+        binding.isSuspended = isSuspended;
+        hasChanged = true;
+    }
+
+    // Not a change to what gets saved
+    if (hasChanged)
+        publishTable();
+}
+
+void MidiMapping::setPortNames(const QStringList& portNames)
+{
+    m_portNames = portNames;
+
+    // -1 for a port that isn't there, no message comes in on it
+    for (auto& binding : m_bindings)
+        binding.controller.port = static_cast<int>(m_portNames.indexOf(binding.portName));
+
+    publishTable();
+}
+
+QJsonArray MidiMapping::bindingsToJson(const PluginHost& plugin) const
+{
+    const auto curves = QMetaEnum::fromType<Curve>();
+
+    QJsonArray bindingsJson;
+    for (const auto& binding : m_bindings)
+    {
+        if (binding.plugin != &plugin)
+            continue;
+
+        QJsonObject bindingJson;
+        bindingJson["port"] = binding.portName;
+        bindingJson["channel"] = binding.controller.channel + 1;
+        bindingJson["isNrpn"] = binding.controller.isNrpn;
+        bindingJson["number"] = binding.controller.number;
+        bindingJson["paramId"] = static_cast<qint64>(binding.paramId);
+        bindingJson["curve"] = curves.valueToKey(static_cast<int>(binding.curve));
+
+        bindingsJson.append(bindingJson);
+    }
+
+    return bindingsJson;
+}
+
+void MidiMapping::bindingsFromJson(PluginHost& plugin, const QJsonArray& bindings)
+{
+    if (bindings.isEmpty())
+        return;
+
+    const auto curves = QMetaEnum::fromType<Curve>();
+
+    for (const auto& bindingRef : bindings)
+    {
+        const auto bindingJson = bindingRef.toObject();
+
+        Binding binding;
+        // Saved by name; sessions from before that have the index it had back then
+        const auto port = bindingJson["port"];
+        binding.portName = port.isString()? port.toString() : m_portNames.value(port.toInt());
+        binding.controller.port = static_cast<int>(m_portNames.indexOf(binding.portName));
+        binding.controller.channel = std::clamp(bindingJson["channel"].toInt(1) - 1, 0, 15);
+        binding.controller.isNrpn = bindingJson["isNrpn"].toBool();
+        binding.controller.number = bindingJson["number"].toInt();
+        binding.plugin = &plugin;
+        binding.paramId = static_cast<clap_id>(bindingJson["paramId"].toInteger(CLAP_INVALID_ID));
+
+        bool isKnownCurve = false;
+        const auto curve = curves.keyToValue(bindingJson["curve"].toString().toUtf8().constData(), &isKnownCurve);
+        binding.curve = isKnownCurve? static_cast<Curve>(curve) : Curve::Linear;
+
+        std::erase_if(m_bindings, [&binding](const Binding& existing)
+        {
+            return existing.plugin == binding.plugin && existing.paramId == binding.paramId;
+        });
+
+        m_bindings.push_back(binding);
+    }
+
+    publish();
+}
+
+void MidiMapping::process(const int port, const int sampleOffset, const std::span<const unsigned char> data) noexcept
+{
+    if (data.size() != 3 || (data[0] & 0xF0) != 0xB0)
+        return;
+
+    const int channel = data[0] & 0x0F;
+    const int cc = data[1];
+    const int value = data[2];
+
+    Controller controller{port, channel, false, cc};
+    double normalizedValue = value / 127.0;
+
+    if (port >= 0 && port < maxNrpnPorts)
+    {
+        auto& nrpn = m_nrpnStates[port * 16 + channel];
+
+        switch (cc)
+        {
+            case 99:
+                nrpn.numberMsb = value;
+                return;
+            case 98:
+                nrpn.numberLsb = value;
+                return;
+            // RPNs are left to the plugins, and also end the NRPN that was selected
+            case 101:
+            case 100:
+                nrpn.numberMsb = -1;
+                nrpn.numberLsb = -1;
+                return;
+            case 6:
+            case 38:
+            {
+                // Data entry with no NRPN selected is just another CC
+                if (nrpn.numberMsb < 0 || nrpn.numberLsb < 0)
+                    break;
+
+                if (cc == 6)
+                    nrpn.dataMsb = value;
+
+                controller.isNrpn = true;
+                controller.number = nrpn.numberMsb << 7 | nrpn.numberLsb;
+                normalizedValue = (nrpn.dataMsb << 7 | (cc == 38? value : 0)) / 16383.0;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    const auto key = keyOf(controller);
+
+    if (m_isLearning.load(std::memory_order_relaxed) && m_isLearning.exchange(false))
+        m_learned.store(learnedBit | key, std::memory_order_release);
+
+    dispatch(key, sampleOffset, normalizedValue);
+}
+
+void MidiMapping::learn(PluginHost* plugin, const uint paramId)
+{
+    if (!plugin)
+        return;
+
+    m_learnTarget = plugin;
+    m_learnParamId = paramId;
+    m_learned.store(0);
+    m_isLearning.store(true);
+    m_learnTimer.start();
+
+    emit learnTargetChanged();
+}
+
+void MidiMapping::cancelLearn()
+{
+    m_isLearning.store(false);
+    m_learnTimer.stop();
+
+    if (!m_learnTarget)
+        return;
+
+    m_learnTarget = nullptr;
+    m_learnParamId = CLAP_INVALID_ID;
+
+    emit learnTargetChanged();
+}
+
+void MidiMapping::unbind(PluginHost* plugin, const uint paramId)
+{
+    if (std::erase_if(m_bindings, [plugin, paramId](const Binding& binding)
+        {
+            return binding.plugin == plugin && binding.paramId == paramId;
+        }) > 0)
+    {
+        publish();
+    }
+}
+
+void MidiMapping::setCurve(PluginHost* plugin, const uint paramId, const Curve curve)
+{
+    const auto binding = std::ranges::find_if(m_bindings, [plugin, paramId](const Binding& existing)
+    {
+        return existing.plugin == plugin && existing.paramId == paramId;
+    });
+
+    if (binding == m_bindings.end() || binding->curve == curve)
+        return;
+
+    binding->curve = curve;
+    publish();
+}
+
+std::uint32_t MidiMapping::keyOf(const Controller& controller) noexcept
+{
+    return static_cast<std::uint32_t>(controller.port & 0xFFF) << 20
+         | static_cast<std::uint32_t>(controller.channel & 0xF) << 16
+         | static_cast<std::uint32_t>(controller.isNrpn) << 14
+         | static_cast<std::uint32_t>(controller.number & 0x3FFF);
+}
+
+MidiMapping::Controller MidiMapping::controllerOf(const std::uint32_t key) noexcept
+{
+    return {
+        static_cast<int>(key >> 20),
+        static_cast<int>(key >> 16 & 0xF),
+        (key >> 14 & 1) != 0,
+        static_cast<int>(key & 0x3FFF),
+    };
+}
+
+void MidiMapping::publish()
+{
+    publishTable();
+    emit bindingsChanged();
+}
+
+void MidiMapping::publishTable()
+{
+    auto table = std::make_unique<Table>();
+    table->entries.reserve(m_bindings.size());
+
+    for (const auto& binding : m_bindings)
+    {
+        if (binding.controller.port < 0 || binding.isSuspended)
+            continue;
+
+        const auto* parameters = binding.plugin->parameters();
+        const auto row = parameters? parameters->rowOf(binding.paramId) : -1;
+        if (row < 0)
+            continue;
+
+        const auto flags = parameters->infoFlags()[row];
+        if (flags & CLAP_PARAM_IS_READONLY)
+            continue;
+
+        Entry entry;
+        entry.key = keyOf(binding.controller);
+        entry.plugin = binding.plugin;
+        entry.paramId = binding.paramId;
+        entry.curve = binding.curve;
+        entry.isStepped = (flags & CLAP_PARAM_IS_STEPPED) != 0;
+        entry.min = parameters->minValues()[row];
+        entry.max = parameters->maxValues()[row];
+
+        for (const QObject* node = binding.plugin->parent(); node; node = node->parent())
+        {
+            if (const auto* channelStrip = qobject_cast<const ChannelStrip*>(node))
+                entry.strips.push_back(channelStrip);
+        }
+
+        table->entries.push_back(entry);
+    }
+
+    std::ranges::stable_sort(table->entries, {}, &Entry::key);
+
+    m_table.store(table.get(), std::memory_order_release);
+
+    if (std::shared_ptr<Table> oldTable = std::exchange(m_ownedTable, std::move(table)))
+        EpochReclaimer::instance()->retire([oldTable]() {});
+}
+
+void MidiMapping::collectLearned()
+{
+    const auto learned = m_learned.exchange(0, std::memory_order_acquire);
+    if (!(learned & learnedBit) || !m_learnTarget)
+        return;
+
+    Binding binding;
+    binding.controller = controllerOf(static_cast<std::uint32_t>(learned));
+    binding.portName = m_portNames.value(binding.controller.port);
+    binding.plugin = m_learnTarget;
+    binding.paramId = m_learnParamId;
+
+    // Learning again only moves the parameter to another controller
+    if (const auto existing = std::ranges::find_if(m_bindings, [&binding](const Binding& other)
+        {
+            return other.plugin == binding.plugin && other.paramId == binding.paramId;
+        }); existing != m_bindings.end())
+    {
+        binding.curve = existing->curve;
+    }
+
+    cancelLearn();
+    bind(binding);
+}
+
+void MidiMapping::dispatch(const std::uint32_t key, const int sampleOffset, const double normalizedValue) noexcept
+{
+    const auto* table = m_table.load(std::memory_order_acquire);
+    if (!table)
+        return;
+
+    for (const auto& entry : std::ranges::equal_range(table->entries, key, {}, &Entry::key))
+    {
+        // Inactive, its event buffers may be getting sized for the next activation
+        if (entry.plugin->status.load().status < S::Stopped)
+            continue;
+
+        // The render thread is processing it, or it's deactivated under a frozen strip
+        if (!std::ranges::all_of(entry.strips, &ChannelStrip::isLive))
+            continue;
+
+        double value = entry.min + normalizedValue * (entry.max - entry.min);
+
+        switch (entry.curve)
+        {
+            case Curve::Linear:
+                break;
+            case Curve::Exponential:
+                // Frequencies, times: equal controller steps are equal ratios
+                value = entry.min > 0.0 && entry.max > entry.min
+                    ? entry.min * std::pow(entry.max / entry.min, normalizedValue)
+                    : entry.min + normalizedValue * normalizedValue * (entry.max - entry.min);
+                break;
+            case Curve::Toggle:
+                value = normalizedValue >= 0.5? entry.max : entry.min;
+                break;
+        }
+
+        if (entry.isStepped)
+            value = std::round(value);
+
+        entry.plugin->processParamValue(sampleOffset, entry.paramId, value);
+    }
+}
@@ -0,0 +1,166 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+#include <clap/id.h>
+#include <QJsonArray>
+#include <QObject>
+#include <QStringList>
+#include <QTimer>
+
+
+class ChannelStrip;
+class PluginHost;
+Q_MOC_INCLUDE("Nodes/PluginHost.h")
+
+
+// Controllers on the MIDI inputs, CCs and NRPNs, bound to plugin parameters. The
+// audio thread looks every incoming controller up in a flat table sorted by
+// (port, channel, controller) and turns the matches into CLAP_EVENT_PARAM_VALUE
+// for the plugins, no GUI round trip. The main thread owns the bindings and
+// publishes a new table on every change, the old one goes to the reclaimer.
+class MidiMapping final : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(PluginHost* learnTarget READ learnTarget NOTIFY learnTargetChanged)
+    Q_PROPERTY(uint learnParamId READ learnParamId NOTIFY learnTargetChanged)
+
+
+  public:
+    // How the controller's 0..1 range is spread over the parameter's
+    enum class Curve
+    {
+        Linear,
+        Exponential,
+        Toggle,
+    };
+    Q_ENUM(Curve)
+
+    struct Controller
+    {
+        int port = 0;
+        int channel = 0;
+        bool isNrpn = false;
+        int number = 0;
+    };
+
+    struct Binding
+    {
+        Controller controller;
+        // What the controller's port is saved as; its index changes with the devices around it
+        QString portName;
+        PluginHost* plugin = nullptr;
+        clap_id paramId = CLAP_INVALID_ID;
+        Curve curve = Curve::Linear;
+        // Kept, but left out of the table
+        bool isSuspended = false;
+    };
+
+    explicit MidiMapping(QObject* parent = nullptr);
+    ~MidiMapping() override;
+    MidiMapping(MidiMapping&) = delete;
+    MidiMapping(MidiMapping&&) = delete;
+    MidiMapping(const MidiMapping&) = delete;
+    MidiMapping(const MidiMapping&&) = delete;
+
+    [[nodiscard]] PluginHost* learnTarget() const { return m_learnTarget; }
+    [[nodiscard]] uint learnParamId() const { return m_learnParamId; }
+
+    // Main thread. A parameter has at most one controller, a controller can drive many parameters
+    void bind(const Binding& binding);
+    void removeBindings(const PluginHost& plugin);
+
+    // Re-reads the ranges after a rescan, dropping bindings to parameters that are gone
+    void refresh(const PluginHost& plugin);
+
+    // For a plugin parked out of the graph, which the controllers shouldn't reach until it's back
+    void suspendBindings(const PluginHost& plugin);
+    void resumeBindings(const PluginHost& plugin);
+    // Once the plugin is in a strip again, whose freeze states its controllers go by
+    void updateStrips(const PluginHost& plugin);
+
+    // After the inputs were opened, with their names in port order
+    void setPortNames(const QStringList& portNames);
+
+    [[nodiscard]] QJsonArray bindingsToJson(const PluginHost& plugin) const;
+    void bindingsFromJson(PluginHost& plugin, const QJsonArray& bindings);
+
+    // audio thread, every message drained from the inputs
+    void process(int port, int sampleOffset, std::span<const unsigned char> data) noexcept;
+
+
+  public slots:
+    // The next controller that moves gets bound to this parameter
+    void learn(PluginHost* plugin, uint paramId);
+    void cancelLearn();
+
+    void unbind(PluginHost* plugin, uint paramId);
+    void setCurve(PluginHost* plugin, uint paramId, Curve curve);
+
+
+  signals:
+    void learnTargetChanged();
+    void bindingsChanged();
+
+
+  private:
+    static constexpr int maxNrpnPorts = 16;
+
+    struct Entry
+    {
+        std::uint32_t key = 0;
+        PluginHost* plugin = nullptr;
+        clap_id paramId = CLAP_INVALID_ID;
+        Curve curve = Curve::Linear;
+        bool isStepped = false;
+        double min = 0.0;
+        double max = 1.0;
+        // Every strip the plugin is in; one that renders or plays frozen doesn't take controllers
+        std::vector<const ChannelStrip*> strips;
+    };
+
+    // Sorted by key, immutable once published
+    struct Table
+    {
+        std::vector<Entry> entries;
+    };
+
+    // Per port and channel, what the last NRPN select and data entry CCs said
+    struct NrpnState
+    {
+        int numberMsb = -1;
+        int numberLsb = -1;
+        int dataMsb = 0;
+    };
+
+    std::vector<Binding> m_bindings;
+    QStringList m_portNames;
+    std::atomic<Table*> m_table = nullptr;
+    std::unique_ptr<Table> m_ownedTable;
+
+    PluginHost* m_learnTarget = nullptr;
+    clap_id m_learnParamId = CLAP_INVALID_ID;
+    std::atomic<bool> m_isLearning = false;
+    // A key with learnedBit set once the audio thread caught a controller
+    std::atomic<std::uint64_t> m_learned = 0;
+    QTimer m_learnTimer;
+
+    // audio thread only
+    std::array<NrpnState, maxNrpnPorts * 16> m_nrpnStates{};
+
+    static constexpr std::uint64_t learnedBit = std::uint64_t{1} << 32;
+
+    [[nodiscard]] static std::uint32_t keyOf(const Controller& controller) noexcept;
+    [[nodiscard]] static Controller controllerOf(std::uint32_t key) noexcept;
+
+    void publish();
+    // Without telling anyone the bindings changed, when only the ports moved
+    void publishTable();
+    void setIsSuspended(const PluginHost& plugin, bool isSuspended);
+    void collectLearned();
+
+    void dispatch(std::uint32_t key, int sampleOffset, double normalizedValue) noexcept;
+};
@@ -0,0 +1,203 @@
+#include "MidiOutput.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <utility>
+#include <QtDebug>
+#include <rtmidi/RtMidi.h>
+
+
+namespace
+{
+
+std::int64_t steadyNow()
+{
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+}
+
+
+MidiOutput::MidiOutput() : m_thread{&MidiOutput::run, this} {}
+
+MidiOutput::~MidiOutput()
+{
+    m_shouldStop = true;
+    m_wakeups.fetch_add(1);
+    m_wakeups.notify_one();
+    m_thread.join();
+
+    close();
+}
+
+void MidiOutput::open()
+{
+    close();
+
+    RtMidiOut portLister;
+    const auto portCount = portLister.getPortCount();
+
+    auto ports = std::make_shared<Ports>();
+    QStringList portNames;
+
+    for (unsigned int i = 0; i < portCount; ++i)
+    {
+        const auto portName = QString::fromStdString(portLister.getPortName(i));
+
+        auto midiOut = std::make_shared<RtMidiOut>();
+        midiOut->openPort(i, "Clap Workbench");
+
+        if (!midiOut->isPortOpen())
+        {
+            qWarning() << "Could not open MIDI output port:" << portName;
+            continue;
+        }
+
+        qDebug() << "MIDI output port #" << i << ":" << portName;
+        ports->push_back(std::move(midiOut));
+        portNames.append(portName);
+    }
+
+    std::lock_guard lock{m_mutex};
+    m_ports = std::move(ports);
+    m_portNames = std::move(portNames);
+}
+
+void MidiOutput::close()
+{
+    std::shared_ptr<const Ports> ports;
+
+    {
+        std::lock_guard lock{m_mutex};
+        ports = std::exchange(m_ports, nullptr);
+        m_portNames.clear();
+    }
+
+    // Closed here, or on the sender thread once it's done with a message it's sending
+    ports.reset();
+}
+
+void MidiOutput::setFileSink(const QString& path)
+{
+    std::lock_guard lock{m_mutex};
+
+    if (m_file.is_open())
+        m_file.close();
+
+    if (path.isEmpty())
+        return;
+
+    m_file.open(path.toStdString(), std::ios::out | std::ios::app);
+    if (!m_file)
+        qWarning() << "Could not open MIDI output file:" << path;
+}
+
+QStringList MidiOutput::portNames() const
+{
+    std::lock_guard lock{m_mutex};
+    return m_portNames;
+}
+
+MidiOutput::JitterStats MidiOutput::jitterStats() const
+{
+    JitterStats stats;
+    stats.sentCount = m_sentCount.load(std::memory_order_relaxed);
+    stats.droppedCount = m_queue.droppedCount();
+    stats.maxMicroseconds = static_cast<double>(m_jitterMax.load(std::memory_order_relaxed)) / 1000.0;
+
+    if (stats.sentCount > 0)
+        stats.meanMicroseconds = static_cast<double>(m_jitterSum.load(std::memory_order_relaxed)) / 1000.0 / static_cast<double>(stats.sentCount);
+
+    return stats;
+}
+
+void MidiOutput::resetJitterStats()
+{
+    m_sentCount = 0;
+    m_jitterSum = 0;
+    m_jitterMax = 0;
+}
+
+void MidiOutput::send(const int port, const std::int64_t dueTime, const std::span<const unsigned char> data) noexcept
+{
+    if (!m_queue.push(dueTime, port, data))
+        return;
+
+    m_wakeups.fetch_add(1, std::memory_order_release);
+    m_wakeups.notify_one();
+}
+
+void MidiOutput::run()
+{
+    // How long a message queued while sleeping for a later one can wait past its time
+    constexpr auto pollInterval = std::chrono::milliseconds{1};
+
+    while (!m_shouldStop)
+    {
+        const auto seenWakeups = m_wakeups.load();
+        takeQueued();
+
+        if (m_pending.empty())
+        {
+            m_wakeups.wait(seenWakeups);
+            continue;
+        }
+
+        const auto& message = m_pending.top();
+
+        if (const auto now = steadyNow(); message.time > now)
+        {
+            const auto sleepTime = std::min<std::chrono::nanoseconds>(std::chrono::nanoseconds{message.time - now}, pollInterval);
+            std::this_thread::sleep_for(sleepTime);
+            continue;
+        }
+
+        // Early wakeups count too, it's the distance from when it was due that matters
+        const auto jitter = std::abs(steadyNow() - message.time);
+        m_jitterSum.fetch_add(jitter, std::memory_order_relaxed);
+        if (jitter > m_jitterMax.load(std::memory_order_relaxed))
+            m_jitterMax.store(jitter, std::memory_order_relaxed);
+
+        m_sentCount.fetch_add(1, std::memory_order_relaxed);
+
+        deliver(message);
+        m_pending.pop();
+    }
+}
+
+void MidiOutput::takeQueued()
+{
+    // Strips queue what they put out one after the other, so the ring isn't in time order
+    for (auto message = m_queue.front(); message; message = m_queue.front())
+    {
+        m_pending.push({message->time, m_sequence++, message->port, {message->data.begin(), message->data.end()}});
+        m_queue.pop();
+    }
+}
+
+void MidiOutput::deliver(const Pending& message)
+{
+    std::shared_ptr<const Ports> ports;
+
+    {
+        std::lock_guard lock{m_mutex};
+        ports = m_ports;
+    }
+
+    // Outside the lock, RtMidi may block while the main thread asks for the port names
+    if (ports && message.port >= 0 && message.port < static_cast<int>(ports->size()))
+        (*ports)[message.port]->sendMessage(message.data.data(), message.data.size());
+
+    std::lock_guard lock{m_mutex};
+
+    if (!m_file.is_open())
+        return;
+
+    m_file << message.time << ' ' << message.port << std::hex << std::setfill('0');
+    for (const auto byte : message.data)
+        m_file << ' ' << std::setw(2) << static_cast<int>(byte);
+
+    m_file << std::dec << '\n';
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <span>
+#include <thread>
+#include <vector>
+#include <QStringList>
+#include "Utils/MidiMessageRing.h"
+
+
+class RtMidiOut;
+
+
+// MIDI the plugins put out, on its way to hardware. The audio thread queues each
+// message with the wall-clock time it's due at; a sender thread moves them into a
+// queue ordered by that time, sleeps until the earliest is due and hands it to the
+// port's RtMidiOut, and to a file if one is set, keeping track of how late it
+// actually went out.
+class MidiOutput
+{
+  public:
+    struct JitterStats
+    {
+        std::uint64_t sentCount = 0;
+        std::uint64_t droppedCount = 0;
+        double meanMicroseconds = 0.0;
+        double maxMicroseconds = 0.0;
+    };
+
+    MidiOutput();
+    ~MidiOutput();
+    MidiOutput(MidiOutput&) = delete;
+    MidiOutput(MidiOutput&&) = delete;
+    MidiOutput(const MidiOutput&) = delete;
+    MidiOutput(const MidiOutput&&) = delete;
+
+    // main thread
+    void open();
+    void close();
+    void setFileSink(const QString& path);
+
+    [[nodiscard]] QStringList portNames() const;
+    [[nodiscard]] JitterStats jitterStats() const;
+    void resetJitterStats();
+
+    // audio thread; dueTime is on the steady clock, in nanoseconds
+    void send(int port, std::int64_t dueTime, std::span<const unsigned char> data) noexcept;
+
+
+  private:
+    // Sender thread only: taken off the ring, waiting for their time
+    struct Pending
+    {
+        std::int64_t time = 0;
+        // Messages due at the same time go out in the order they were sent
+        std::uint64_t sequence = 0;
+        int port = 0;
+        std::vector<unsigned char> data;
+
+        bool operator>(const Pending& other) const
+        {
+            return time != other.time? time > other.time : sequence > other.sequence;
+        }
+    };
+
+    using Ports = std::vector<std::shared_ptr<RtMidiOut>>;
+
+    MidiMessageRing m_queue{4096, 256 * 1024};
+    std::priority_queue<Pending, std::vector<Pending>, std::greater<>> m_pending;
+    std::uint64_t m_sequence = 0;
+
+    mutable std::mutex m_mutex;
+    // Replaced whole by open() and close(), the sender keeps the ports it sends to alive
+    std::shared_ptr<const Ports> m_ports;
+    QStringList m_portNames;
+    std::ofstream m_file;
+
+    std::atomic<std::uint64_t> m_sentCount = 0;
+    std::atomic<std::int64_t> m_jitterSum = 0;
+    std::atomic<std::int64_t> m_jitterMax = 0;
+
+    std::atomic<std::uint32_t> m_wakeups = 0;
+    std::atomic<bool> m_shouldStop = false;
+    std::thread m_thread;
+
+    void run();
+    void takeQueued();
+    void deliver(const Pending& message);
+};
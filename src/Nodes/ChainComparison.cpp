@@ -0,0 +1,338 @@
+#include "ChainComparison.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <QJsonArray>
+#include <QJsonObject>
+#include "AudioEngine.h"
+#include "ChannelStrip.h"
+#include "PluginHost.h"
+
+
+namespace
+{
+
+double toDecibels(const double value)
+{
+    return value > 0.0? std::max(-144.0, 20.0 * std::log10(value)) : -144.0;
+}
+
+}
+
+
+ChainComparison::ChainComparison(Node* parent) : Node(parent, Type::ChainComparison)
+{
+    for (std::size_t i = 0; i < m_chains.size(); ++i)
+    {
+        auto* chain = new ChannelStrip(this);
+        chain->setName(i == 0? "A" : "B");
+        // Compared as they come out, the strip's own volume is after the comparison
+        chain->m_outputVolume = 1.0;
+
+        m_chains[i] = chain;
+        m_nodes.push_back(chain);
+
+        for (auto*& delayLine : m_delayLines[i])
+            delayLine = static_cast<float*>(std::calloc(1, delayCapacity * sizeof(float)));
+    }
+
+    // Between activate() and deactivate(), there's nothing to measure otherwise
+    m_metricsTimer.setInterval(100);
+    connect(&m_metricsTimer, &QTimer::timeout, this, &ChainComparison::updateMetrics);
+}
+
+ChainComparison::~ChainComparison()
+{
+    for (auto& delayLines : m_delayLines)
+    {
+        for (auto*& delayLine : delayLines)
+        {
+            free(delayLine);
+            delayLine = nullptr;
+        }
+    }
+}
+
+void ChainComparison::setPorts(int, float** inputs, int, float** outputs)
+{
+    // Processed in place in the strip, like the plugins around it
+    m_io[0] = outputs? outputs[0] : inputs[0];
+    m_io[1] = outputs? outputs[1] : inputs[1];
+    buffer[0] = m_io[0];
+    buffer[1] = m_io[1];
+
+    for (auto* chain : m_chains)
+        chain->setPorts(2, nullptr, 2, nullptr);
+}
+
+void ChainComparison::activate(const std::int32_t sampleRate, const std::int32_t blockSize)
+{
+    m_sampleRate = sampleRate;
+    m_blockSize = blockSize;
+
+    for (auto* chain : m_chains)
+        chain->activate(sampleRate, blockSize);
+
+    for (auto& delayLines : m_delayLines)
+    {
+        for (auto* delayLine : delayLines)
+            std::memset(delayLine, 0, delayCapacity * sizeof(float));
+    }
+
+    updateLatencies();
+    m_metricsTimer.start();
+
+    auto curStatus = status.load();
+    curStatus.status = S::Stopped;
+    status.store(curStatus);
+}
+
+void ChainComparison::deactivate()
+{
+    for (auto* chain : m_chains)
+        chain->deactivate();
+
+    m_metricsTimer.stop();
+
+    auto curStatus = status.load();
+    curStatus.status = S::Inactive;
+    status.store(curStatus);
+}
+
+void ChainComparison::startProcessing()
+{
+    for (auto* chain : m_chains)
+    {
+        if (chain->status.load().status >= S::Stopped)
+            chain->startProcessing();
+    }
+
+    // Nothing to fade from yet
+    const auto monitor = static_cast<std::size_t>(m_monitor.load());
+    for (std::size_t i = 0; i < m_gains.size(); ++i)
+        m_gains[i] = i == monitor? 1.0f : 0.0f;
+
+    auto curStatus = status.load();
+    curStatus.status = S::Running;
+    status.store(curStatus);
+}
+
+void ChainComparison::stopProcessing()
+{
+    for (auto* chain : m_chains)
+        chain->stopProcessing();
+
+    auto curStatus = status.load();
+    curStatus.status = S::Stopped;
+    status.store(curStatus);
+}
+
+void ChainComparison::processNoteRawMidi(const int sampleOffset, const int port, const std::span<const unsigned char> data)
+{
+    for (auto* chain : m_chains)
+        chain->processNoteRawMidi(sampleOffset, port, data);
+}
+
+void ChainComparison::process()
+{
+    // The events the chains put out stay in them, they'd be two versions of one stream
+    m_hasOutputEvents = false;
+
+    const auto curStatus = status.load();
+    if (curStatus.status == S::Starting)
+    {
+        startProcessing();
+    }
+    else if (curStatus.status != S::Running)
+    {
+        return;
+    }
+
+    if (curStatus.isBypassed || m_blockSize <= 0)
+        return;
+
+    const auto frameCount = static_cast<std::uint32_t>(m_blockSize);
+    for (auto* chain : m_chains)
+    {
+        std::memcpy(chain->buffer[0], m_io[0], frameCount * sizeof(float));
+        std::memcpy(chain->buffer[1], m_io[1], frameCount * sizeof(float));
+    }
+
+    // One chain per task, so with a worker free they run at the same time
+    AudioEngine::instance()->workerPool().execute(static_cast<std::uint32_t>(m_chains.size()),
+        [](void* context, const std::uint32_t taskIndex)
+    {
+        static_cast<ChainComparison*>(context)->processChain(taskIndex);
+    }, this);
+
+    mix(frameCount);
+}
+
+void ChainComparison::processChain(const std::uint32_t chainIndex)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    m_chains[chainIndex]->processChain(m_upstreamEvents);
+
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    m_chainNanoseconds[chainIndex].fetch_add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), std::memory_order_relaxed);
+}
+
+void ChainComparison::mix(const std::uint32_t frameCount)
+{
+    constexpr auto mask = delayCapacity - 1;
+    static_assert((delayCapacity & mask) == 0);
+
+    const auto monitor = static_cast<std::size_t>(m_monitor.load(std::memory_order_relaxed));
+    const auto fadeStep = static_cast<float>(1.0 / std::max(1.0, fadeSeconds * m_sampleRate));
+    const std::uint32_t delays[2] = {m_delays[0].load(std::memory_order_relaxed), m_delays[1].load(std::memory_order_relaxed)};
+
+    double sumDifference = 0.0;
+    double sumA = 0.0;
+    double sumB = 0.0;
+    double sumAB = 0.0;
+    float peakDifference = 0.0f;
+
+    for (std::uint32_t i = 0; i < frameCount; ++i)
+    {
+        for (std::size_t g = 0; g < m_gains.size(); ++g)
+        {
+            const float target = g == monitor? 1.0f : 0.0f;
+            m_gains[g] = m_gains[g] < target? std::min(target, m_gains[g] + fadeStep)
+                                            : std::max(target, m_gains[g] - fadeStep);
+        }
+
+        const auto position = m_delayPosition;
+        m_delayPosition = (m_delayPosition + 1) & mask;
+
+        for (std::size_t channel = 0; channel < 2; ++channel)
+        {
+            float out[2];
+            for (std::size_t c = 0; c < 2; ++c)
+            {
+                auto* delayLine = m_delayLines[c][channel];
+                delayLine[position] = m_chains[c]->buffer[channel][i];
+                out[c] = delayLine[(position - delays[c]) & mask];
+            }
+
+            const float a = out[0];
+            const float b = out[1];
+            const float difference = a - b;
+
+            m_io[channel][i] = m_gains[0] * a + m_gains[1] * b + m_gains[2] * difference;
+
+            sumDifference += static_cast<double>(difference) * difference;
+            sumA += static_cast<double>(a) * a;
+            sumB += static_cast<double>(b) * b;
+            sumAB += static_cast<double>(a) * b;
+            peakDifference = std::max(peakDifference, std::abs(difference));
+        }
+    }
+
+    m_sumDifference.fetch_add(sumDifference, std::memory_order_relaxed);
+    m_sumA.fetch_add(sumA, std::memory_order_relaxed);
+    m_sumB.fetch_add(sumB, std::memory_order_relaxed);
+    m_sumAB.fetch_add(sumAB, std::memory_order_relaxed);
+    m_frames.fetch_add(frameCount, std::memory_order_relaxed);
+
+    auto peak = m_peakDifference.load(std::memory_order_relaxed);
+    while (peakDifference > peak && !m_peakDifference.compare_exchange_weak(peak, peakDifference, std::memory_order_relaxed)) {}
+}
+
+void ChainComparison::setMonitor(const Monitor newMonitor)
+{
+    if (newMonitor == m_monitor)
+        return;
+
+    m_monitor = newMonitor;
+    emit monitorChanged();
+    markDirty();
+}
+
+QJsonObject ChainComparison::getState() const
+{
+    QJsonObject state;
+    state["type"] = "ChainComparison";
+    state["name"] = m_name;
+    state["isBypassed"] = status.load().isBypassed;
+    state["monitor"] = static_cast<int>(m_monitor.load());
+
+    QJsonArray chainsArray;
+    for (const auto* chain : m_chains)
+        chainsArray.append(chain->getState());
+
+    state["chains"] = chainsArray;
+    state["nodes"] = {};
+
+    return state;
+}
+
+void ChainComparison::loadState(const QJsonObject& stateToLoad)
+{
+    Status status_;
+    status_.isBypassed = stateToLoad["isBypassed"].toBool();
+    status.store(status_);
+    m_name = stateToLoad["name"].toString();
+    setMonitor(static_cast<Monitor>(std::clamp(stateToLoad["monitor"].toInt(), 0, 2)));
+
+    const auto chains = stateToLoad["chains"].toArray();
+    for (std::size_t i = 0; i < m_chains.size() && i < static_cast<std::size_t>(chains.size()); ++i)
+        m_chains[i]->loadState(chains[static_cast<qsizetype>(i)].toObject());
+}
+
+void ChainComparison::updateMetrics()
+{
+    updateLatencies();
+
+    const auto frames = m_frames.exchange(0, std::memory_order_relaxed);
+    const std::int64_t nanoseconds[2] = {m_chainNanoseconds[0].exchange(0, std::memory_order_relaxed),
+                                         m_chainNanoseconds[1].exchange(0, std::memory_order_relaxed)};
+    const auto sumDifference = m_sumDifference.exchange(0.0, std::memory_order_relaxed);
+    const auto sumA = m_sumA.exchange(0.0, std::memory_order_relaxed);
+    const auto sumB = m_sumB.exchange(0.0, std::memory_order_relaxed);
+    const auto sumAB = m_sumAB.exchange(0.0, std::memory_order_relaxed);
+    const auto peakDifference = m_peakDifference.exchange(0.0f, std::memory_order_relaxed);
+
+    if (frames == 0)
+        return;
+
+    m_nullRms = toDecibels(std::sqrt(sumDifference / (2.0 * static_cast<double>(frames))));
+    m_nullPeak = toDecibels(peakDifference);
+    // Two silent chains are as alike as it gets
+    m_correlation = sumA > 0.0 && sumB > 0.0? sumAB / std::sqrt(sumA * sumB) : (sumA == sumB? 1.0 : 0.0);
+
+    const auto audioNanoseconds = static_cast<double>(frames) / m_sampleRate * 1e9;
+    for (std::size_t i = 0; i < m_costs.size(); ++i)
+        m_costs[i] = 100.0 * static_cast<double>(nanoseconds[i]) / audioNanoseconds;
+
+    emit metricsChanged();
+}
+
+void ChainComparison::updateLatencies()
+{
+    std::array<int, 2> latencies{};
+    for (std::size_t i = 0; i < m_chains.size(); ++i)
+    {
+        // A bypassed chain passes its input through as it is
+        if (m_chains[i]->isByPassed())
+            continue;
+
+        for (const auto* node : m_chains[i]->m_nodes)
+        {
+            if (const auto* plugin = dynamic_cast<const PluginHost*>(node); plugin && !plugin->isByPassed())
+                latencies[i] += static_cast<int>(plugin->latency());
+        }
+    }
+
+    const auto latest = std::max(latencies[0], latencies[1]);
+    for (std::size_t i = 0; i < m_delays.size(); ++i)
+        m_delays[i] = static_cast<std::uint32_t>(std::min<int>(latest - latencies[i], delayCapacity - 1));
+
+    if (latencies == m_latencies)
+        return;
+
+    m_latencies = latencies;
+    emit metricsChanged();
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <QTimer>
+#include "Node.h"
+
+
+class ChannelStrip;
+
+
+// Runs two chains of plugins, A and B, side by side on the same input (audio and
+// events) and monitors one of them, or what's left of their difference. Switching
+// fades over a few milliseconds on a per sample gain, so it never lands on a block
+// edge with a click; both chains keep running the whole time. The chains are
+// aligned on their reported latencies before they're compared or mixed.
+class ChainComparison final : public Node
+{
+    Q_OBJECT
+    Q_PROPERTY(Monitor monitor READ monitor WRITE setMonitor NOTIFY monitorChanged)
+    Q_PROPERTY(double nullRms READ nullRms NOTIFY metricsChanged)
+    Q_PROPERTY(double nullPeak READ nullPeak NOTIFY metricsChanged)
+    Q_PROPERTY(double correlation READ correlation NOTIFY metricsChanged)
+    Q_PROPERTY(double costA READ costA NOTIFY metricsChanged)
+    Q_PROPERTY(double costB READ costB NOTIFY metricsChanged)
+    Q_PROPERTY(int latencyA READ latencyA NOTIFY metricsChanged)
+    Q_PROPERTY(int latencyB READ latencyB NOTIFY metricsChanged)
+
+  public:
+    enum class Monitor
+    {
+        A,
+        B,
+        Difference,
+    };
+    Q_ENUM(Monitor)
+
+    explicit ChainComparison(Node* parent);
+    ~ChainComparison() override;
+
+    void setPorts(int numInputs, float** inputs, int numOutputs, float** outputs) override;
+    void activate(std::int32_t sampleRate, std::int32_t blockSize) override;
+    void deactivate() override;
+
+    void startProcessing() override;
+    void stopProcessing() override;
+
+    void processNoteRawMidi(int sampleOffset, int port, std::span<const unsigned char> data) override;
+    void process() override;
+
+    [[nodiscard]] QJsonObject getState() const override;
+    void loadState(const QJsonObject& stateToLoad) override;
+
+    [[nodiscard]] Monitor monitor() const { return m_monitor.load(); }
+    void setMonitor(Monitor newMonitor);
+
+    // Of A - B over the last metrics period, in dBFS
+    [[nodiscard]] double nullRms() const { return m_nullRms; }
+    [[nodiscard]] double nullPeak() const { return m_nullPeak; }
+    // Of A and B over the last metrics period, 1 when they only differ in level
+    [[nodiscard]] double correlation() const { return m_correlation; }
+
+    // Processing time of each chain, in percent of the time a block lasts
+    [[nodiscard]] double costA() const { return m_costs[0]; }
+    [[nodiscard]] double costB() const { return m_costs[1]; }
+
+    // In samples, as the chains' plugins report it
+    [[nodiscard]] int latencyA() const { return m_latencies[0]; }
+    [[nodiscard]] int latencyB() const { return m_latencies[1]; }
+
+
+  signals:
+    void monitorChanged();
+    void metricsChanged();
+
+
+  private:
+    // Enough for the latency of a linear phase EQ or a lookahead limiter or two
+    static constexpr std::uint32_t delayCapacity = 16384;
+    static constexpr double fadeSeconds = 0.005;
+
+    std::array<ChannelStrip*, 2> m_chains{};
+    // The strip's buffer: the input, and where the monitored output goes
+    float* m_io[2] = {nullptr, nullptr};
+
+    std::atomic<Monitor> m_monitor = Monitor::A;
+    std::int32_t m_sampleRate = 48000;
+    std::int32_t m_blockSize = 0;
+
+    // audio thread only: the gains of A, B and A - B, faded toward the monitor's
+    std::array<float, 3> m_gains{1.0f, 0.0f, 0.0f};
+    // Per chain and channel, to hold back the chain with less latency
+    std::array<std::array<float*, 2>, 2> m_delayLines{};
+    std::uint32_t m_delayPosition = 0;
+    std::array<std::atomic<std::uint32_t>, 2> m_delays{};
+
+    // Summed up by the audio thread, taken by the main thread every metrics period
+    std::atomic<double> m_sumDifference = 0.0;
+    std::atomic<float> m_peakDifference = 0.0f;
+    std::atomic<double> m_sumA = 0.0;
+    std::atomic<double> m_sumB = 0.0;
+    std::atomic<double> m_sumAB = 0.0;
+    std::atomic<std::int64_t> m_frames = 0;
+    std::array<std::atomic<std::int64_t>, 2> m_chainNanoseconds{};
+
+    // Main thread
+    double m_nullRms = -144.0;
+    double m_nullPeak = -144.0;
+    double m_correlation = 0.0;
+    std::array<double, 2> m_costs{};
+    std::array<int, 2> m_latencies{};
+    QTimer m_metricsTimer;
+
+    void processChain(std::uint32_t chainIndex);
+    void mix(std::uint32_t frameCount);
+    void updateMetrics();
+    void updateLatencies();
+};
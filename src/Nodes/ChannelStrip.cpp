@@ -1,21 +1,123 @@
 #include "ChannelStrip.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include "PluginManager.h"
 #include "QJsonArray"
+#include <QPointer>
+#include <QUndoStack>
+#include "AudioEngine.h"
+#include "Commands.h"
+#include "ChainComparison.h"
+#include "MidiFilePlayer.h"
+#include "Transport.h"
+#include "Utils/EpochReclaimer.h"
+
+
+namespace
+{
+
+// A MIDI port that was set by name but isn't among the ones open
+constexpr int missingPort = -2;
+
+// Saved by name; sessions from before that have the index it had back then
+QString portNameOf(const QJsonValue& port, const QStringList& portNames)
+{
+    return port.isString()? port.toString() : portNames.value(port.toInt(-1));
+}
+
+int portIndexOf(const QString& portName, const QStringList& portNames)
+{
+    if (portName.isEmpty())
+        return -1;
+
+    const auto index = static_cast<int>(portNames.indexOf(portName));
+    return index >= 0? index : missingPort;
+}
+
+// Placeholders for every plugin in the node, all the way down; nothing processes them
+// while the strip they're in is frozen, so they're swapped without the reclaimer
+void unloadPlugins(Node& node)
+{
+    bool hasChanged = false;
+
+    for (auto& child : node.m_nodes)
+    {
+        auto* plugin = dynamic_cast<PluginHost*>(child);
+        if (!plugin)
+        {
+            unloadPlugins(*child);
+            continue;
+        }
+
+        if (plugin->isPlaceholder())
+            continue;
+
+        child = plugin->placeholder(&node);
+        plugin->deleteLater();
+        hasChanged = true;
+    }
+
+    if (auto* channelStrip = dynamic_cast<ChannelStrip*>(&node))
+    {
+        for (auto* channel : channelStrip->m_channels)
+            unloadPlugins(*channel);
+    }
+
+    if (!hasChanged)
+        return;
+
+    if (auto* channelStrip = dynamic_cast<ChannelStrip*>(&node))
+        channelStrip->publishChain();
+
+    emit node.nodesChanged();
+}
+
+}
 
 
 ChannelStrip::ChannelStrip(Node* parent) : Node(parent, Type::ChannelStrip)
 {
     buffer[0] = static_cast<float*>(std::calloc(1, m_bufferSize * 4));
     buffer[1] = static_cast<float*>(std::calloc(1, m_bufferSize * 4));
+
+    m_crossfadeBuffer[0] = static_cast<float*>(std::calloc(1, m_bufferSize * 4));
+    m_crossfadeBuffer[1] = static_cast<float*>(std::calloc(1, m_bufferSize * 4));
+
+    m_chain = new Chain{};
+
+    m_crossfadeTimer.setInterval(20);
+    connect(&m_crossfadeTimer, &QTimer::timeout, this, [this]()
+    {
+        if (!m_isCrossfadeDone && status.load().status == S::Running)
+            return;
+
+        finishCrossfade();
+    });
+
+    m_renderTimer.setInterval(100);
+    connect(&m_renderTimer, &QTimer::timeout, this, &ChannelStrip::renderProgressChanged);
+
+    auto* audioEngine = AudioEngine::instance();
+    connect(audioEngine, &AudioEngine::midiInputPortsChanged, this, &ChannelStrip::resolveMidiPorts);
+    connect(audioEngine, &AudioEngine::midiOutputPortsChanged, this, &ChannelStrip::resolveMidiPorts);
 }
 
 ChannelStrip::~ChannelStrip()
 {
+    stopRender();
+
     free(buffer[0]);
     free(buffer[1]);
+    free(m_crossfadeBuffer[0]);
+    free(m_crossfadeBuffer[1]);
 
     buffer[0] = nullptr;
     buffer[1] = nullptr;
+    m_crossfadeBuffer[0] = nullptr;
+    m_crossfadeBuffer[1] = nullptr;
+
+    delete m_chain.exchange(nullptr);
 }
 
 void ChannelStrip::setPorts(const int numInputs, float**, const int numOutputs, float**)
@@ -29,16 +131,26 @@ void ChannelStrip::setPorts(const int numInputs, float**, const int numOutputs,
 
 void ChannelStrip::activate(const std::int32_t sampleRate, const std::int32_t blockSize)
 {
+    m_sampleRate = sampleRate;
     m_bufferSize = blockSize;
 
     std::memset(buffer[0], 0, m_bufferSize * sizeof(float));
     std::memset(buffer[1], 0, m_bufferSize * sizeof(float));
 
-    for (auto* node : m_nodes)
-        node->activate(sampleRate, blockSize);
+    // Its nodes stay deactivated while it plays its render
+    if (m_freezeState.load() != Freeze::Frozen)
+    {
+        for (auto* node : m_nodes)
+            node->activate(sampleRate, blockSize);
 
-    for (auto* node : m_channels)
-        node->activate(sampleRate, blockSize);
+        for (auto* node : m_channels)
+            node->activate(sampleRate, blockSize);
+    }
+    else if (m_frozenAudio && m_frozenAudio->sampleRate != sampleRate)
+    {
+        qWarning() << "ChannelStrip:" << m_name << "was frozen at" << m_frozenAudio->sampleRate
+                   << "Hz and stays silent at" << sampleRate << "until it's frozen again";
+    }
 
     auto curStatus = status.load();
     curStatus.status = S::Stopped;
@@ -47,6 +159,8 @@ void ChannelStrip::activate(const std::int32_t sampleRate, const std::int32_t bl
 
 void ChannelStrip::deactivate()
 {
+    stopRender();
+
     for (auto* node: m_nodes)
         node->deactivate();
 
@@ -56,16 +170,20 @@ void ChannelStrip::deactivate()
 
 void ChannelStrip::startProcessing()
 {
-    for (auto* plugin : m_nodes)
+    // Rendering or frozen, its nodes aren't the audio thread's to start or stop
+    if (m_freezeState.load() == Freeze::Live)
     {
-        if (plugin->status.load().status >= S::Stopped)
-            plugin->startProcessing();
-    }
+        for (auto* plugin : m_chain.load(std::memory_order_acquire)->nodes)
+        {
+            if (plugin->status.load().status >= S::Stopped)
+                plugin->startProcessing();
+        }
 
-    for (auto* plugin : m_channels)
-    {
-        if (plugin->status.load().status >= S::Stopped)
-            plugin->startProcessing();
+        for (auto* plugin : m_channels)
+        {
+            if (plugin->status.load().status >= S::Stopped)
+                plugin->startProcessing();
+        }
     }
 
     auto curStatus = status.load();
@@ -75,24 +193,46 @@ void ChannelStrip::startProcessing()
 
 void ChannelStrip::stopProcessing()
 {
-    for (auto* plugin : m_nodes)
-        plugin->stopProcessing();
+    if (m_freezeState.load() == Freeze::Live)
+    {
+        for (auto* plugin : m_chain.load(std::memory_order_acquire)->nodes)
+            plugin->stopProcessing();
 
-    for (auto* plugin : m_channels)
-        plugin->stopProcessing();
+        for (auto* plugin : m_channels)
+            plugin->stopProcessing();
+    }
 
     auto curStatus = status.load();
     curStatus.status = S::Stopped;
     status.store(curStatus);
 }
 
-void ChannelStrip::processNoteRawMidi(const int sampleOffset, const std::vector<unsigned char>& data)
+void ChannelStrip::processNoteRawMidi(const int sampleOffset, const int port, const std::span<const unsigned char> data)
 {
-    for (auto* plugin : m_nodes)
-        plugin->processNoteRawMidi(sampleOffset, data);
+    if (m_freezeState.load(std::memory_order_relaxed) != Freeze::Live)
+        return;
+
+    // Sub strips have their own routing
+    for (auto* node : m_channels)
+        node->processNoteRawMidi(sampleOffset, port, data);
 
-    for (auto* plugin : m_channels)
-        plugin->processNoteRawMidi(sampleOffset, data);
+    const auto midiInputPort = m_midiInputPort.load(std::memory_order_relaxed);
+    if (midiInputPort != -1 && midiInputPort != port)
+        return;
+
+    // System messages have no channel and always go through
+    const auto midiInputChannel = m_midiInputChannel.load(std::memory_order_relaxed);
+    const bool isChannelMessage = !data.empty() && data[0] >= 0x80 && data[0] < 0xF0;
+    if (isChannelMessage && midiInputChannel > 0 && (data[0] & 0x0F) + 1 != midiInputChannel)
+        return;
+
+    processNodesRawMidi(sampleOffset, port, data);
+}
+
+void ChannelStrip::processNodesRawMidi(const int sampleOffset, const int port, const std::span<const unsigned char> data)
+{
+    for (auto* plugin : m_chain.load(std::memory_order_acquire)->nodes)
+        plugin->processNoteRawMidi(sampleOffset, port, data);
 }
 
 void ChannelStrip::process()
@@ -100,10 +240,7 @@ void ChannelStrip::process()
     std::memset(buffer[0], 0, m_bufferSize * sizeof(float));
     std::memset(buffer[1], 0, m_bufferSize * sizeof(float));
 
-    auto curStatus = status.load();
-    if (pendingTopologyChanges > 0)
-        return;
-
+    const auto curStatus = status.load();
     if (curStatus.status == S::Starting)
     {
         startProcessing();
@@ -113,6 +250,18 @@ void ChannelStrip::process()
         return;
     }
 
+    // Silent while it renders, its nodes are the render's
+    if (m_freezeState.load(std::memory_order_acquire) != Freeze::Live)
+    {
+        if (!curStatus.isBypassed)
+        {
+            playFrozenAudio();
+            applyOutputVolume();
+        }
+
+        return;
+    }
+
     for (auto* node : m_channels)
     {
         node->process();
@@ -124,37 +273,65 @@ void ChannelStrip::process()
         }
     }
 
-    const clap::helpers::EventList* lastPluginEventsOut = nullptr;
-    for (auto* plugin : m_nodes)
+    const auto* upstreamEvents = processPlugins(nullptr);
+
+    if (curStatus.isBypassed)
     {
-        if (lastPluginEventsOut)
-        {
-            for (uint32_t i = 0; i < lastPluginEventsOut->size(); ++i)
-            {
-                const clap_event_header_t* ev = lastPluginEventsOut->get(i);
-                if (!ev)
-                    continue;
+        std::memset(buffer[0], 0, m_bufferSize * sizeof(float));
+        std::memset(buffer[1], 0, m_bufferSize * sizeof(float));
 
-                plugin->m_evIn.tryPush(ev);
-            }
-        }
+        return;
+    }
 
-        plugin->process();
+    sendMidiOutput(upstreamEvents);
+    applyOutputVolume();
+}
 
-        if (plugin->m_process.out_events)
-            lastPluginEventsOut = static_cast<clap::helpers::EventList*>(plugin->m_process.out_events->ctx);
-        else
-            lastPluginEventsOut = nullptr;
+void ChannelStrip::processChain(const EventArena* upstreamEvents)
+{
+    // What's in the buffer goes through as it is while the chain can't run
+    const auto curStatus = status.load();
+    if (curStatus.status == S::Starting)
+    {
+        startProcessing();
+    }
+    else if (curStatus.status != S::Running)
+    {
+        return;
     }
 
     if (curStatus.isBypassed)
+        return;
+
+    processPlugins(upstreamEvents);
+    applyOutputVolume();
+}
+
+const EventArena* ChannelStrip::processPlugins(const EventArena* upstreamEvents)
+{
+    // Read once, the chain stays the same for the whole block
+    const auto& chain = *m_chain.load(std::memory_order_acquire);
+
+    // A plugin that didn't run this block (bypassed, stopped) is skipped over: the
+    // next one sees whatever came out of the last one that did
+    for (auto* plugin : chain.nodes)
     {
-        std::memset(buffer[0], 0, m_bufferSize * sizeof(float));
-        std::memset(buffer[1], 0, m_bufferSize * sizeof(float));
+        plugin->m_upstreamEvents = upstreamEvents;
 
-        return;
+        if (plugin == chain.crossfade.incoming)
+            processCrossfade(chain.crossfade);
+        else
+            plugin->process();
+
+        if (plugin->m_hasOutputEvents)
+            upstreamEvents = &plugin->m_evOut;
     }
 
+    return upstreamEvents;
+}
+
+void ChannelStrip::applyOutputVolume()
+{
     const auto outputVolume = m_outputVolume.load();
 
     for (unsigned int i = 0; i < m_bufferSize; ++i)
@@ -171,6 +348,11 @@ QJsonObject ChannelStrip::getState() const
     state["name"] = m_name;
     state["isBypassed"] = status.load().isBypassed;
     state["outputVolume"] = m_outputVolume.load();
+    state["midiInputPort"] = m_midiInputPortName;
+    state["midiInputChannel"] = m_midiInputChannel.load();
+    state["midiOutputPort"] = m_midiOutputPortName;
+    state["unloadsWhenFrozen"] = m_unloadsWhenFrozen;
+    state["isCollapsed"] = m_isCollapsed;
 
     QJsonArray channelsArray;
     for (const auto* node : m_channels)
@@ -195,6 +377,14 @@ void ChannelStrip::loadState(const QJsonObject& stateToLoad)
     status_.isBypassed = stateToLoad["isBypassed"].toBool();
     status.store(status_);
     setOutputVolume(stateToLoad["outputVolume"].toDouble());
+    const auto* audioEngine = AudioEngine::instance();
+    m_midiInputPortName = portNameOf(stateToLoad["midiInputPort"], audioEngine->midiInputPorts());
+    setMidiInputChannel(stateToLoad["midiInputChannel"].toInt(0));
+    m_midiOutputPortName = portNameOf(stateToLoad["midiOutputPort"], audioEngine->midiOutputPorts());
+    resolveMidiPorts();
+    setUnloadsWhenFrozen(stateToLoad["unloadsWhenFrozen"].toBool());
+    // Before the sub strips, so their plugins know they're out of sight
+    setIsCollapsed(stateToLoad["isCollapsed"].toBool());
     setName(stateToLoad["name"].toString());
 
     for (const auto plugins = stateToLoad["channels"].toArray(); const auto& jsPluginRef : plugins)
@@ -211,6 +401,7 @@ void ChannelStrip::loadState(const QJsonObject& stateToLoad)
         m_nodes.push_back(plugin);
     }
 
+    publishChain();
     emit nodesChanged();
 }
 
@@ -227,6 +418,81 @@ void ChannelStrip::setOutputVolume(const double newOutputVolume)
     m_outputVolume = newOutputVolume;
 
     emit outputVolumeChanged();
+    markDirty();
+}
+
+void ChannelStrip::setMidiInputPort(const int newPort)
+{
+    if (newPort == m_midiInputPort)
+        return;
+
+    m_midiInputPortName = AudioEngine::instance()->midiInputPorts().value(newPort);
+    m_midiInputPort = newPort;
+
+    emit midiInputPortChanged();
+    markDirty();
+}
+
+void ChannelStrip::setMidiOutputPort(const int newPort)
+{
+    if (newPort == m_midiOutputPort)
+        return;
+
+    m_midiOutputPortName = AudioEngine::instance()->midiOutputPorts().value(newPort);
+    m_midiOutputPort = newPort;
+
+    emit midiOutputPortChanged();
+    markDirty();
+}
+
+void ChannelStrip::resolveMidiPorts()
+{
+    const auto* audioEngine = AudioEngine::instance();
+
+    if (const auto port = portIndexOf(m_midiInputPortName, audioEngine->midiInputPorts()); port != m_midiInputPort)
+    {
+        m_midiInputPort = port;
+        emit midiInputPortChanged();
+    }
+
+    if (const auto port = portIndexOf(m_midiOutputPortName, audioEngine->midiOutputPorts()); port != m_midiOutputPort)
+    {
+        m_midiOutputPort = port;
+        emit midiOutputPortChanged();
+    }
+}
+
+void ChannelStrip::setMidiInputChannel(const int newChannel)
+{
+    if (newChannel == m_midiInputChannel || newChannel < 0 || newChannel > 16)
+        return;
+
+    m_midiInputChannel = newChannel;
+
+    emit midiInputChannelChanged();
+    markDirty();
+}
+
+void ChannelStrip::setUnloadsWhenFrozen(const bool value)
+{
+    if (value == m_unloadsWhenFrozen)
+        return;
+
+    m_unloadsWhenFrozen = value;
+
+    emit unloadsWhenFrozenChanged();
+    markDirty();
+}
+
+void ChannelStrip::setIsCollapsed(const bool value)
+{
+    if (value == m_isCollapsed)
+        return;
+
+    m_isCollapsed = value;
+
+    emit isCollapsedChanged();
+    markDirty();
 }
 
 void ChannelStrip::addNode(const QJsonObject& state)
@@ -241,50 +507,722 @@ void ChannelStrip::removeNode(const QJsonObject& state)
 
 void ChannelStrip::load(PluginHost* plugin, const QString& path, const int pluginIndex)
 {
-    if (plugin)
-        plugin->setIsByPassed(true);
+    const auto pluginPath = path.startsWith("file://")? path.mid(7) : path;
+    auto* pluginManager = PluginManager::instance();
+
+    if (auto* warmPlugin = pluginManager->hostPool().take(pluginPath, pluginIndex))
+    {
+        installPlugin(plugin, warmPlugin);
+        return;
+    }
+
+    // Reading the binary and dlopen happen on the preloader's thread; what's left for the
+    // main thread are the CLAP calls the spec wants there (entry init, create, init, activate).
+    // The plugin being replaced keeps playing until the new one is swapped in.
+    pluginManager->prepareLibrary(pluginPath.toStdString(), this,
+        [this, plugin = QPointer{plugin}, pluginPath, pluginIndex]()
+    {
+        auto* newPlugin = new PluginHost{this};
+
+        if (!PluginManager::instance()->load(*newPlugin, pluginPath, pluginIndex))
+        {
+            qWarning() << "ChannelStrip::load: could not load" << pluginPath;
+            delete newPlugin;
+
+            return;
+        }
+
+        installPlugin(plugin, newPlugin);
+    });
+}
+
+void ChannelStrip::installPlugin(PluginHost* pluginToReplace, PluginHost* newPlugin)
+{
+    startPlugin(newPlugin);
+    markDirty();
+
+    const auto index = static_cast<int>(pluginToReplace? m_nodes.indexOf(pluginToReplace) : m_nodes.size());
+    auto* command = new ReplacePluginCommand(*this, index, pluginToReplace, *newPlugin);
+
+    if (pluginToReplace)
+        replacePlugin(pluginToReplace, newPlugin, command->parkTakenOut());
+    else
+        insertPlugin(index, newPlugin);
+
+    // Done already, pushing it only makes it undoable
+    AudioEngine::instance()->undoStack().push(command);
+
+    emit newPlugin->nameChanged();
+    emit newPlugin->hasNativeGUIChanged();
+}
+
+void ChannelStrip::insertPlugin(const int index, PluginHost* plugin)
+{
+    markDirty();
+
+    changeTopology([this, index, plugin]()
+    {
+        m_nodes.insert(std::clamp(index, 0, static_cast<int>(m_nodes.size())), plugin);
+    });
+}
+
+void ChannelStrip::replacePlugin(PluginHost* oldPlugin, PluginHost* newPlugin,
+    std::function<void(PluginHost*)> onReplaced)
+{
+    // Replaced again before it's done fading in: the new crossfade starts from it
+    if (oldPlugin == m_crossfade.incoming)
+        finishCrossfade();
+
+    const auto index = m_nodes.indexOf(oldPlugin);
+    if (index < 0)
+    {
+        changeTopology([this, newPlugin]() { m_nodes.push_back(newPlugin); });
+        return;
+    }
+
+    const bool canCrossfade = status.load().status == S::Running
+        && oldPlugin->status.load().status == S::Running
+        && m_crossfade.outgoing == nullptr;
+
+    if (!canCrossfade)
+    {
+        changeTopology([this, index, newPlugin]() { m_nodes[index] = newPlugin; },
+            [oldPlugin, onReplaced = std::move(onReplaced)]()
+        {
+            if (onReplaced)
+                onReplaced(oldPlugin);
+        });
+
+        return;
+    }
+
+    // The old plugin stays in the chain, as the crossfade's outgoing one, until it's done
+    changeTopology([this, index, oldPlugin, newPlugin, onReplaced = std::move(onReplaced)]()
+    {
+        m_nodes[index] = newPlugin;
+
+        constexpr double crossfadeSeconds = 0.02;
+        m_crossfade = {oldPlugin, newPlugin, static_cast<std::int32_t>(m_sampleRate * crossfadeSeconds),
+                       m_crossfade.generation + 1};
+        m_onCrossfadeDone = onReplaced;
+        m_isCrossfadeDone = false;
+        m_crossfadeTimer.start();
+    });
+}
+
+void ChannelStrip::removePlugin(PluginHost* plugin, std::function<void(PluginHost*)> onRemoved)
+{
+    if (plugin == m_crossfade.incoming)
+        finishCrossfade();
+
+    if (!m_nodes.contains(plugin))
+        return;
+
+    markDirty();
+
+    changeTopology([this, plugin]() { m_nodes.removeAll(plugin); },
+        [plugin, onRemoved = std::move(onRemoved)]()
+    {
+        if (onRemoved)
+            onRemoved(plugin);
+    });
+}
+
+void ChannelStrip::deleteNode(Node* node)
+{
+    if (!m_nodes.contains(node))
+        return;
+
+    if (node == m_crossfade.incoming)
+        finishCrossfade();
 
-    PluginHost* pluginToReload = plugin;
+    markDirty();
+
+    changeTopology([this, node]() { m_nodes.removeAll(node); }, [node]() { node->deleteLater(); });
+}
 
-    if (pluginToReload == nullptr)
+void ChannelStrip::addComparison()
+{
+    auto* comparison = new ChainComparison(this);
+    comparison->setPorts(2, buffer, 2, buffer);
+
+    if (status.load().status > S::Stopped)
     {
-        pluginToReload = new PluginHost{this};
-        m_nodes.push_back(pluginToReload);
+        comparison->activate(m_sampleRate, static_cast<int>(m_bufferSize));
+
+        auto comparisonStatus = comparison->status.load();
+        comparisonStatus.status = S::Starting;
+        comparison->status.store(comparisonStatus);
     }
 
-    auto* m_pluginManager = PluginManager::instance();
+    markDirty();
 
-    m_pluginManager->load(*pluginToReload, path, pluginIndex);
+    changeTopology([this, comparison]()
+    {
+        m_nodes.push_back(comparison);
+    });
+}
 
+void ChannelStrip::startPlugin(PluginHost* plugin)
+{
+    plugin->setParent(this);
+    plugin->setPorts(2, buffer, 2, buffer);
+    AudioEngine::instance()->midiMapping()->updateStrips(*plugin);
+
+    // Activated at the rate and block size the strip itself runs at, on the main
+    // thread, while the audio thread goes on with whatever the strip had
     if (status.load().status > S::Stopped)
     {
-        pluginToReload->setPorts(2, buffer, 2, buffer);
-        pluginToReload->activate(48000, static_cast<int>(m_bufferSize));
+        plugin->activate(m_sampleRate, static_cast<int>(m_bufferSize));
+
+        auto pluginStatus = plugin->status.load();
+        pluginStatus.status = S::Starting;
+        plugin->status.store(pluginStatus);
+    }
+}
+
+void ChannelStrip::reloadPlugin(PluginHost* plugin)
+{
+    if (!plugin || !m_nodes.contains(plugin))
+        return;
+
+    auto* pluginManager = PluginManager::instance();
+
+    // dlopen would just hand back the already loaded binary for the same path
+    const auto shadowPath = pluginManager->makeShadowCopy(plugin->path());
+    if (shadowPath.empty())
+        return;
+
+    qDebug() << "ChannelStrip::reloadPlugin:" << plugin->name();
+
+    pluginManager->prepareLibrary(shadowPath, this, [this, plugin = QPointer{plugin}, shadowPath]()
+    {
+        if (!plugin || !m_nodes.contains(plugin.data()))
+            return;
+
+        auto* pluginManager = PluginManager::instance();
+
+        auto* newPlugin = new PluginHost{this};
+        if (!pluginManager->load(*newPlugin, plugin->path(), plugin->index(), shadowPath))
+        {
+            qWarning() << "ChannelStrip::reloadPlugin: could not load the new binary of" << plugin->name();
+            delete newPlugin;
+
+            return;
+        }
+
+        newPlugin->loadStateBlob(plugin->saveStateBlob());
+        newPlugin->setIsByPassed(plugin->isByPassed());
+
+        startPlugin(newPlugin);
+
+        // The old binary is stale, so neither the old instance nor any pooled ones are worth keeping
+        pluginManager->hostPool().discard(plugin->path());
+        replacePlugin(plugin, newPlugin, [](PluginHost* oldPlugin) { oldPlugin->deleteLater(); });
+
+        emit newPlugin->nameChanged();
+        emit newPlugin->hasNativeGUIChanged();
+    });
+}
+
+void ChannelStrip::processCrossfade(const Crossfade& crossfade)
+{
+    const auto& [outgoing, incoming, length, generation] = crossfade;
+    auto& position = m_crossfadePosition;
+
+    // Its first block: the outgoing plugin ran on buffer up to the last one, from here
+    // on it runs on a copy of its input
+    if (generation != m_crossfadeGeneration)
+    {
+        m_crossfadeGeneration = generation;
+        position = 0;
+        outgoing->setPorts(2, m_crossfadeBuffer, 2, m_crossfadeBuffer);
+    }
 
-        auto tmpStatus = status.load();
-        tmpStatus.status = S::Starting;
-        pluginToReload->status.store(tmpStatus);
+    // Waiting for the main thread to retire the outgoing plugin
+    if (m_isCrossfadeDone.load(std::memory_order_relaxed))
+    {
+        incoming->process();
+        return;
     }
 
-    pluginToReload->setIsByPassed(false);
+    std::memcpy(m_crossfadeBuffer[0], buffer[0], m_bufferSize * sizeof(float));
+    std::memcpy(m_crossfadeBuffer[1], buffer[1], m_bufferSize * sizeof(float));
+
+    outgoing->m_upstreamEvents = incoming->m_upstreamEvents;
+    outgoing->process();
+    incoming->process();
 
+    for (unsigned int i = 0; i < m_bufferSize; ++i)
+    {
+        const float gain = position < length ? static_cast<float>(position) / static_cast<float>(length) : 1.0f;
+        if (position < length)
+            ++position;
+
+        buffer[0][i] = buffer[0][i] * gain + m_crossfadeBuffer[0][i] * (1.0f - gain);
+        buffer[1][i] = buffer[1][i] * gain + m_crossfadeBuffer[1][i] * (1.0f - gain);
+    }
+
+    if (position >= length)
+    {
+        // Has to be on the audio thread, the main thread deactivates it afterwards
+        outgoing->stopProcessing();
+        m_isCrossfadeDone.store(true, std::memory_order_release);
+    }
+}
+
+void ChannelStrip::sendMidiOutput(const EventArena* events) const
+{
+    const auto port = m_midiOutputPort.load(std::memory_order_relaxed);
+    if (!events || port < 0)
+        return;
+
+    auto* engine = AudioEngine::instance();
+
+    // One block later than it was played, same as the input, so it goes out in time
+    const double nanosecondsPerSample = 1'000'000'000.0 / m_sampleRate;
+    const auto blockDuration = static_cast<std::int64_t>(m_bufferSize * nanosecondsPerSample);
+    const auto blockEndTime = engine->blockStartTime() + blockDuration;
+
+    for (std::uint32_t i = 0; i < events->size(); ++i)
+    {
+        const auto* event = events->get(i);
+        if (!event || !ocp::isForwardedDownstream(*event))
+            continue;
+
+        const auto dueTime = blockEndTime + static_cast<std::int64_t>(event->time * nanosecondsPerSample);
+
+        std::array<unsigned char, 3> bytes{};
+        std::span<const unsigned char> message;
+
+        switch (event->type)
+        {
+            case CLAP_EVENT_NOTE_ON:
+            case CLAP_EVENT_NOTE_OFF:
+            {
+                const auto* note = reinterpret_cast<const clap_event_note*>(event);
+                const auto channel = static_cast<unsigned char>(std::clamp<int>(note->channel, 0, 15));
+                const auto velocity = static_cast<unsigned char>(std::clamp(std::lround(note->velocity * 127.0), 0l, 127l));
+
+                // A note on with velocity 0 would be a note off
+                bytes = {static_cast<unsigned char>((event->type == CLAP_EVENT_NOTE_ON? 0x90 : 0x80) | channel),
+                         static_cast<unsigned char>(note->key & 0x7F),
+                         event->type == CLAP_EVENT_NOTE_ON? std::max<unsigned char>(velocity, 1) : velocity};
+                message = bytes;
+                break;
+            }
+            case CLAP_EVENT_MIDI:
+            {
+                const auto* midi = reinterpret_cast<const clap_event_midi*>(event);
+                message = std::span<const unsigned char>{midi->data, ocp::midiMessageSize(midi->data[0])};
+                break;
+            }
+            case CLAP_EVENT_MIDI_SYSEX:
+            {
+                const auto* sysex = reinterpret_cast<const clap_event_midi_sysex*>(event);
+                message = std::span<const unsigned char>{sysex->buffer, sysex->size};
+                break;
+            }
+            default:
+                break;
+        }
+
+        if (!message.empty())
+            engine->midiOutput().send(port, dueTime, message);
+    }
+}
+
+void ChannelStrip::finishCrossfade()
+{
+    auto* outgoing = m_crossfade.outgoing;
+    auto onDone = std::move(m_onCrossfadeDone);
+
+    m_crossfade.outgoing = nullptr;
+    m_crossfade.incoming = nullptr;
+    m_onCrossfadeDone = nullptr;
+    m_crossfadeTimer.stop();
+
+    if (!outgoing)
+        return;
+
+    changeTopology([]() {}, [outgoing, onDone = std::move(onDone)]()
+    {
+        if (onDone)
+            onDone(outgoing);
+    });
+}
+
+void ChannelStrip::changeTopology(const std::function<void()>& change, std::function<void()> onRetired)
+{
+    cancelRender(this);
+    change();
+
+    publishChain(std::move(onRetired));
     emit nodesChanged();
-    emit pluginToReload->nameChanged();
-    emit pluginToReload->hasNativeGUIChanged();
+}
+
+void ChannelStrip::publishChain(std::function<void()> onRetired)
+{
+    const auto* retired = m_chain.exchange(new Chain{{m_nodes.cbegin(), m_nodes.cend()}, m_crossfade},
+        std::memory_order_acq_rel);
+
+    EpochReclaimer::instance()->retire([retired, onRetired = std::move(onRetired)]()
+    {
+        delete retired;
+
+        if (onRetired)
+            onRetired();
+    });
+}
+
+void ChannelStrip::movePlugin(const int from, const int to)
+{
+    if (from == to || from < 0 || to < 0 || from >= m_nodes.size() || to >= m_nodes.size())
+        return;
+
+    AudioEngine::instance()->undoStack().push(new MovePluginCommand(*this, from, to));
 }
 
 void ChannelStrip::reorder(const int from, const int to)
 {
-    const auto oldStatus = status.load();
-    auto tmpStatus = oldStatus;
-    tmpStatus.status = S::Inactive;
+    if (from == to || from < 0 || to < 0 || from >= m_nodes.size() || to >= m_nodes.size())
+        return;
 
-    status.store(tmpStatus);
+    markDirty();
 
-    const auto element = m_nodes.takeAt(from);
-    m_nodes.insert(to, element);
+    changeTopology([this, from, to]() { m_nodes.move(from, to); });
+}
 
-    status.store(oldStatus);
+void ChannelStrip::setIsFrozen(const bool value)
+{
+    if (value)
+        freeze();
+    else
+        unfreeze();
+}
 
-    emit nodesChanged();
+void ChannelStrip::cancelRender(Node* node)
+{
+    for (; node; node = qobject_cast<Node*>(node->parent()))
+    {
+        if (auto* channelStrip = qobject_cast<ChannelStrip*>(node))
+            channelStrip->stopRender();
+    }
+}
+
+bool ChannelStrip::isInFrozenStrip(const Node* node)
+{
+    for (; node; node = qobject_cast<const Node*>(node->parent()))
+    {
+        if (const auto* channelStrip = qobject_cast<const ChannelStrip*>(node); channelStrip && channelStrip->isFrozen())
+            return true;
+    }
+
+    return false;
+}
+
+bool ChannelStrip::isInCollapsedStrip(const Node* node)
+{
+    // A strip's own plugins show even while it's collapsed, only what's below it is hidden
+    const auto* strip = node? qobject_cast<const Node*>(node->parent()) : nullptr;
+
+    for (node = strip? qobject_cast<const Node*>(strip->parent()) : nullptr; node;
+         node = qobject_cast<const Node*>(node->parent()))
+    {
+        if (const auto* channelStrip = qobject_cast<const ChannelStrip*>(node); channelStrip && channelStrip->isCollapsed())
+            return true;
+    }
+
+    return false;
+}
+
+void ChannelStrip::freeze()
+{
+    if (m_freezeState.load() != Freeze::Live)
+        return;
+
+    if (!AudioEngine::instance()->isRunning() || status.load().status != S::Running)
+    {
+        qWarning() << "ChannelStrip::freeze:" << m_name << "renders only while the engine runs";
+        return;
+    }
+
+    if (m_crossfade.outgoing)
+    {
+        qWarning() << "ChannelStrip::freeze:" << m_name << "is replacing a plugin";
+        return;
+    }
+
+    // processChain() runs it, without a way to play a render
+    if (qobject_cast<ChainComparison*>(parent()))
+    {
+        qWarning() << "ChannelStrip::freeze:" << m_name << "is a chain of a comparison, freeze the strip it's in";
+        return;
+    }
+
+    const auto* transport = AudioEngine::instance()->transport();
+
+    auto lengthInBeats = transport->isLooping()? transport->loopEnd() : 0.0;
+    for (const auto* player : findChildren<MidiFilePlayer*>())
+        lengthInBeats = std::max(lengthInBeats, player->lengthInBeats());
+
+    if (lengthInBeats <= 0.0)
+    {
+        qWarning() << "ChannelStrip::freeze: nothing on the timeline to render in" << m_name;
+        return;
+    }
+
+    const auto seconds = transport->tempoMapSnapshot()->secondsAt(lengthInBeats) + freezeTailSeconds;
+    const auto frameCount = static_cast<std::int64_t>(std::ceil(seconds * m_sampleRate));
+
+    // Swapped in before the render starts, the swaps are ahead of it in the reclaimer
+    for (auto* plugin : findChildren<PluginHost*>())
+    {
+        if (plugin->isPlaceholder() && !plugin->isByPassed())
+            plugin->instantiate();
+    }
+
+    m_freezeState = Freeze::Rendering;
+    m_renderProgress = 0.0;
+
+    emit freezeChanged();
+    emit renderProgressChanged();
+
+    // Once the audio thread can't be in the middle of processing the nodes anymore
+    EpochReclaimer::instance()->retire([this, frameCount]() { startRender(frameCount); });
+}
+
+void ChannelStrip::startRender(const std::int64_t frameCount)
+{
+    // Cancelled in the meantime
+    if (m_freezeState.load() != Freeze::Rendering)
+        return;
+
+    m_render = std::make_unique<FrozenAudio>();
+    m_render->sampleRate = m_sampleRate;
+    m_render->frameCount = frameCount;
+
+    // Rounded up to whole blocks
+    for (auto& channel : m_render->samples)
+        channel.resize(static_cast<std::size_t>(frameCount + m_bufferSize));
+
+    for (std::size_t i = 0; i < m_renderBlock.size(); ++i)
+    {
+        m_renderBlock[i].assign(m_bufferSize, 0.0f);
+        m_renderBuffer[i] = m_renderBlock[i].data();
+    }
+
+    // buffer is still the audio thread's, it plays the strip's silence from it
+    for (auto* node : m_nodes)
+        node->setPorts(2, m_renderBuffer, 2, m_renderBuffer);
+
+    m_renderTimeline = std::make_unique<Transport>();
+    m_renderTimeline->loadState(AudioEngine::instance()->transport()->getState());
+    m_renderTimeline->setIsLooping(false);
+    m_renderTimeline->play();
+    m_renderTransport = m_renderTimeline.get();
+
+    m_shouldCancelRender = false;
+    m_isRenderComplete = false;
+    m_renderThread = std::thread{[this]() { render(); }};
+    m_renderTimer.start();
+}
+
+void ChannelStrip::render()
+{
+    // The plugins are started and processed from here, they ask which thread it is
+    PluginHost::markAudioThread();
+
+    auto& rendered = *m_render;
+    const auto blockSize = static_cast<std::int64_t>(m_bufferSize);
+
+    std::int64_t position = 0;
+    for (; position < rendered.frameCount && !m_shouldCancelRender.load(std::memory_order_relaxed); position += blockSize)
+    {
+        m_renderTimeline->advance(m_sampleRate, m_bufferSize);
+        renderBlock();
+
+        for (std::size_t channel = 0; channel < rendered.samples.size(); ++channel)
+            std::copy_n(m_renderBuffer[channel], blockSize, rendered.samples[channel].data() + position);
+
+        m_renderProgress.store(std::min(1.0, static_cast<double>(position + blockSize) / rendered.frameCount),
+            std::memory_order_relaxed);
+    }
+
+    // Stopped on the thread that processed them; deactivated or restarted on the main one
+    for (auto* node : m_channels)
+        node->stopProcessing();
+
+    for (auto* node : m_nodes)
+        node->stopProcessing();
+
+    m_isRenderComplete = position >= rendered.frameCount;
+
+    QMetaObject::invokeMethod(this, [this]()
+    {
+        if (m_renderThread.joinable())
+            endRender();
+    }, Qt::QueuedConnection);
+}
+
+void ChannelStrip::renderBlock()
+{
+    // Like process() up to the output volume, which stays live like the mute
+    std::memset(m_renderBuffer[0], 0, m_bufferSize * sizeof(float));
+    std::memset(m_renderBuffer[1], 0, m_bufferSize * sizeof(float));
+
+    for (auto* node : m_channels)
+    {
+        node->process();
+
+        for (unsigned int i = 0; i < m_bufferSize; ++i)
+        {
+            m_renderBuffer[0][i] += node->buffer[0][i];
+            m_renderBuffer[1][i] += node->buffer[1][i];
+        }
+    }
+
+    processPlugins(nullptr);
+}
+
+void ChannelStrip::stopRender()
+{
+    if (m_freezeState.load() != Freeze::Rendering)
+        return;
+
+    // Checked between blocks, so the join in endRender() waits out one block at most; a
+    // plugin that hangs in process() would hang the audio thread the same way
+    m_shouldCancelRender = true;
+    endRender();
+}
+
+void ChannelStrip::endRender()
+{
+    m_renderTimer.stop();
+
+    const bool hasStarted = m_renderThread.joinable();
+    if (hasStarted)
+    {
+        m_renderThread.join();
+
+        m_renderTransport = nullptr;
+        m_renderTimeline.reset();
+
+        for (auto* node : m_nodes)
+            node->setPorts(2, buffer, 2, buffer);
+
+        m_renderBlock = {};
+        m_renderBuffer[0] = nullptr;
+        m_renderBuffer[1] = nullptr;
+    }
+
+    auto rendered = std::move(m_render);
+
+    if (!hasStarted || !m_isRenderComplete)
+    {
+        if (hasStarted)
+            restartNodes();
+
+        m_freezeState = Freeze::Live;
+        emit freezeChanged();
+
+        return;
+    }
+
+    for (auto* node : m_channels)
+        node->deactivate();
+
+    for (auto* node : m_nodes)
+        node->deactivate();
+
+    if (m_unloadsWhenFrozen)
+        unloadPlugins(*this);
+
+    publishFrozenAudio(std::move(rendered));
+    m_freezeState = Freeze::Frozen;
+
+    emit freezeChanged();
+    emit renderProgressChanged();
+}
+
+void ChannelStrip::unfreeze()
+{
+    if (m_freezeState.load() == Freeze::Rendering)
+    {
+        stopRender();
+        return;
+    }
+
+    if (m_freezeState.load() != Freeze::Frozen)
+        return;
+
+    restartNodes();
+    m_freezeState = Freeze::Live;
+
+    // Unloaded ones load the way any placeholder does, swapped in once they're ready
+    auto* sessionLoader = AudioEngine::instance()->sessionLoader();
+    for (auto* plugin : findChildren<PluginHost*>())
+    {
+        if (plugin->isPlaceholder() && !plugin->isByPassed())
+            sessionLoader->instantiateLater(*plugin);
+    }
+
+    publishFrozenAudio(nullptr);
+
+    emit freezeChanged();
+}
+
+void ChannelStrip::restartNodes()
+{
+    // Left as they are while the engine isn't running, it activates them when it starts
+    if (status.load().status <= S::Stopped)
+        return;
+
+    const auto restart = [this](Node* node)
+    {
+        node->activate(m_sampleRate, static_cast<int>(m_bufferSize));
+
+        if (auto nodeStatus = node->status.load(); nodeStatus.status == S::Stopped)
+        {
+            nodeStatus.status = S::Starting;
+            node->status.store(nodeStatus);
+        }
+    };
+
+    for (auto* node : m_channels)
+        restart(node);
+
+    for (auto* node : m_nodes)
+        restart(node);
+}
+
+void ChannelStrip::publishFrozenAudio(std::unique_ptr<FrozenAudio> frozenAudio)
+{
+    auto* retired = m_frozenAudio.release();
+
+    m_frozenAudio = std::move(frozenAudio);
+    m_audioFrozenAudio.store(m_frozenAudio.get(), std::memory_order_release);
+
+    if (retired)
+        EpochReclaimer::instance()->retire([retired]() { delete retired; });
+}
+
+void ChannelStrip::playFrozenAudio()
+{
+    const auto* frozenAudio = m_audioFrozenAudio.load(std::memory_order_acquire);
+    if (!frozenAudio || frozenAudio->sampleRate != m_sampleRate)
+        return;
+
+    // A strip it's in could be rendering, with a timeline of its own
+    const auto* transport = transportEvent();
+    if (!(transport->flags & CLAP_TRANSPORT_IS_PLAYING))
+        return;
+
+    // The render starts at the start of the timeline, sample for sample
+    const auto blockStart = std::llround(static_cast<double>(transport->song_pos_seconds) / CLAP_SECTIME_FACTOR * m_sampleRate);
+    const auto from = std::clamp<std::int64_t>(blockStart, 0, frozenAudio->frameCount);
+    const auto to = std::clamp<std::int64_t>(blockStart + m_bufferSize, 0, frozenAudio->frameCount);
+
+    for (std::size_t channel = 0; channel < frozenAudio->samples.size(); ++channel)
+        std::copy(frozenAudio->samples[channel].begin() + from, frozenAudio->samples[channel].begin() + to, buffer[channel] + (from - blockStart));
 }
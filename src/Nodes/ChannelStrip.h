@@ -1,7 +1,13 @@
 #pragma once
+#include <array>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
 #include "Node.h"
 #include "PluginHost.h"
 #include <QJsonObject>
+#include <QTimer>
 
 
 class ChannelStrip final : public Node
@@ -9,6 +15,14 @@ class ChannelStrip final : public Node
     Q_OBJECT
     Q_PROPERTY(QList<Node*> channels READ channels NOTIFY channelsChanged)
     Q_PROPERTY(double outputVolume READ outputVolume WRITE setOutputVolume NOTIFY outputVolumeChanged)
+    Q_PROPERTY(int midiInputPort READ midiInputPort WRITE setMidiInputPort NOTIFY midiInputPortChanged)
+    Q_PROPERTY(int midiInputChannel READ midiInputChannel WRITE setMidiInputChannel NOTIFY midiInputChannelChanged)
+    Q_PROPERTY(int midiOutputPort READ midiOutputPort WRITE setMidiOutputPort NOTIFY midiOutputPortChanged)
+    Q_PROPERTY(bool isFrozen READ isFrozen WRITE setIsFrozen NOTIFY freezeChanged)
+    Q_PROPERTY(bool isRendering READ isRendering NOTIFY freezeChanged)
+    Q_PROPERTY(double renderProgress READ renderProgress NOTIFY renderProgressChanged)
+    Q_PROPERTY(bool unloadsWhenFrozen READ unloadsWhenFrozen WRITE setUnloadsWhenFrozen NOTIFY unloadsWhenFrozenChanged)
+    Q_PROPERTY(bool isCollapsed READ isCollapsed WRITE setIsCollapsed NOTIFY isCollapsedChanged)
 
   public:
     explicit ChannelStrip(Node* parent);
@@ -21,9 +35,13 @@ class ChannelStrip final : public Node
     void startProcessing() override;
     void stopProcessing() override;
 
-    void processNoteRawMidi(int sampleOffset, const std::vector<unsigned char>& data) override;
+    void processNoteRawMidi(int sampleOffset, int port, std::span<const unsigned char> data) override;
     void process() override;
 
+    // As a chain inside another node: the plugins run on what's in buffer already and
+    // start from the events given, instead of from the mix of the sub strips
+    void processChain(const EventArena* upstreamEvents);
+
     [[nodiscard]] QJsonObject getState() const override;
     void loadState(const QJsonObject& stateToLoad) override;
 
@@ -32,10 +50,57 @@ class ChannelStrip final : public Node
     [[nodiscard]] double outputVolume() const;
     void setOutputVolume(double newOutputVolume);
 
+    // -1 listens to every port. Saved by name and looked up again whenever the ports
+    // are, -2 while the one it was set to isn't there
+    [[nodiscard]] int midiInputPort() const { return m_midiInputPort.load(); }
+    void setMidiInputPort(int newPort);
+
+    // 1 to 16, 0 listens to every channel
+    [[nodiscard]] int midiInputChannel() const { return m_midiInputChannel.load(); }
+    void setMidiInputChannel(int newChannel);
+
+    // Where the notes and MIDI coming out of the last plugin go, -1 is nowhere; by name
+    // like the input port
+    [[nodiscard]] int midiOutputPort() const { return m_midiOutputPort.load(); }
+    void setMidiOutputPort(int newPort);
+
+    // Plays an offline render of itself instead of running its nodes, which get stopped
+    // and deactivated, and with unloadsWhenFrozen unloaded down to placeholders that
+    // keep their state. For strips with no live input: the render follows the timeline
+    // from the start to the end of the longest MIDI file in the strip, or of the loop
+    [[nodiscard]] bool isFrozen() const { return m_freezeState.load() == Freeze::Frozen; }
+    void setIsFrozen(bool value);
+    [[nodiscard]] bool isRendering() const { return m_freezeState.load() == Freeze::Rendering; }
+    // Any thread; neither frozen nor rendering
+    [[nodiscard]] bool isLive() const { return m_freezeState.load() == Freeze::Live; }
+    // 0 to 1
+    [[nodiscard]] double renderProgress() const { return m_renderProgress.load(); }
+
+    [[nodiscard]] bool unloadsWhenFrozen() const { return m_unloadsWhenFrozen; }
+    void setUnloadsWhenFrozen(bool value);
+
+    // With its sub strips and comparisons folded away; what's in there loads last
+    [[nodiscard]] bool isCollapsed() const { return m_isCollapsed; }
+    void setIsCollapsed(bool value);
+
+    // Main thread: stops the render of any strip the node is in, before its nodes change
+    static void cancelRender(Node* node);
+    // Whether the node is in a frozen strip, where nothing needs it loaded
+    [[nodiscard]] static bool isInFrozenStrip(const Node* node);
+    // Whether the node is folded away in a collapsed strip, out of sight
+    [[nodiscard]] static bool isInCollapsedStrip(const Node* node);
+
 
   signals:
     void channelsChanged();
     void outputVolumeChanged();
+    void midiInputPortChanged();
+    void midiInputChannelChanged();
+    void midiOutputPortChanged();
+    void freezeChanged();
+    void renderProgressChanged();
+    void unloadsWhenFrozenChanged();
+    void isCollapsedChanged();
 
 
   public slots:
@@ -43,12 +108,137 @@ class ChannelStrip final : public Node
     void removeNode(const QJsonObject& state) override;
 
     void load(PluginHost* plugin, const QString& path, int pluginIndex);
+    // Undoably, reorder() just moves it
+    void movePlugin(int from, int to);
     void reorder(int from, int to);
+    // A/B comparison of two chains, appended at the end of the plugins
+    void addComparison();
+
+
+  public:
+    // These change m_nodes right away; the audio thread picks the change up on its next
+    // block, and the callback gets the plugin once nothing can be processing it anymore
+    void insertPlugin(int index, PluginHost* plugin);
+    void replacePlugin(PluginHost* oldPlugin, PluginHost* newPlugin, std::function<void(PluginHost*)> onReplaced);
+    void removePlugin(PluginHost* plugin, std::function<void(PluginHost*)> onRemoved);
+    // Any node, deleted once nothing can be processing it anymore
+    void deleteNode(Node* node);
+
+    // Main thread, after m_nodes changed without the calls above: hands the audio thread
+    // the nodes as they are now, onRetired runs once it's done with the ones it had
+    void publishChain(std::function<void()> onRetired = {});
+
+    // audio thread: a message for the strip's nodes, past its MIDI input filter
+    void processNodesRawMidi(int sampleOffset, int port, std::span<const unsigned char> data);
+
+    void startPlugin(PluginHost* plugin);
+
+    // Loads the plugin's rebuilt binary side by side and crossfades to it
+    void reloadPlugin(PluginHost* plugin);
+
+
+  private:
+    void changeTopology(const std::function<void()>& change, std::function<void()> onRetired = {});
+    void installPlugin(PluginHost* pluginToReplace, PluginHost* newPlugin);
+
+    // While a plugin is being replaced the strip runs both: the outgoing one on a
+    // copy of its input, and mixes them over a short window
+    struct Crossfade
+    {
+        PluginHost* outgoing = nullptr;
+        PluginHost* incoming = nullptr;
+        std::int32_t length = 0;
+        // One more for every crossfade, for the audio thread to tell a new one
+        std::uint32_t generation = 0;
+    };
+
+    // What the audio thread runs: m_nodes and the crossfade as they were when published.
+    // Never changed once published, a change publishes a new one and retires the old
+    struct Chain
+    {
+        std::vector<Node*> nodes;
+        Crossfade crossfade;
+    };
+
+    std::atomic<const Chain*> m_chain = nullptr;
+
+    Crossfade m_crossfade;
+    std::atomic<bool> m_isCrossfadeDone = false;
+    std::function<void(PluginHost*)> m_onCrossfadeDone;
+    QTimer m_crossfadeTimer;
+    float* m_crossfadeBuffer[2] = {nullptr, nullptr};
+    // audio thread only
+    std::uint32_t m_crossfadeGeneration = 0;
+    std::int32_t m_crossfadePosition = 0;
+
+    void processCrossfade(const Crossfade& crossfade);
+    void finishCrossfade();
+
+    // Returns the events that came out of the last plugin that ran
+    const EventArena* processPlugins(const EventArena* upstreamEvents);
+    void applyOutputVolume();
+    void sendMidiOutput(const EventArena* events) const;
+
+    enum class Freeze : std::uint8_t
+    {
+        Live,
+        Rendering,
+        Frozen,
+    };
+
+    struct FrozenAudio
+    {
+        std::int32_t sampleRate = 0;
+        std::int64_t frameCount = 0;
+        std::array<std::vector<float>, 2> samples;
+    };
+
+    // Past the end of the last note, for releases and reverb tails
+    static constexpr double freezeTailSeconds = 3.0;
+
+    std::atomic<Freeze> m_freezeState = Freeze::Live;
+    bool m_unloadsWhenFrozen = false;
+    bool m_isCollapsed = false;
+    std::unique_ptr<FrozenAudio> m_frozenAudio;
+    std::atomic<const FrozenAudio*> m_audioFrozenAudio = nullptr;
+
+    // The render runs the strip's nodes on its own thread, on its own timeline and
+    // buffers, while the audio thread leaves them alone
+    std::unique_ptr<Transport> m_renderTimeline;
+    std::unique_ptr<FrozenAudio> m_render;
+    std::array<std::vector<float>, 2> m_renderBlock;
+    float* m_renderBuffer[2] = {nullptr, nullptr};
+    std::thread m_renderThread;
+    std::atomic<bool> m_shouldCancelRender = false;
+    std::atomic<bool> m_isRenderComplete = false;
+    std::atomic<double> m_renderProgress = 0.0;
+    QTimer m_renderTimer;
+
+    void freeze();
+    void unfreeze();
+    void startRender(std::int64_t frameCount);
+    void render();
+    void renderBlock();
+    void stopRender();
+    void endRender();
+    // Activates what isn't, for the audio thread to start it on its next block
+    void restartNodes();
+    void publishFrozenAudio(std::unique_ptr<FrozenAudio> frozenAudio);
+    void playFrozenAudio();
+    // After the engine opened its MIDI ports, in whatever order they're in now
+    void resolveMidiPorts();
 
 
   public:
     QList<Node*> m_channels;
     std::atomic<double> m_outputVolume = 0.7f;
-
+    std::atomic<int> m_midiInputPort = -1;
+    std::atomic<int> m_midiInputChannel = 0;
+    std::atomic<int> m_midiOutputPort = -1;
+    // Main thread; empty for every port, and no port
+    QString m_midiInputPortName;
+    QString m_midiOutputPortName;
+
+    std::int32_t m_sampleRate = 48000;
     unsigned int m_bufferSize = 4096;
 };
@@ -1,53 +1,205 @@
 #include "MidiFilePlayer.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include "AudioEngine.h"
+#include "ChannelStrip.h"
+#include "Utils/EpochReclaimer.h"
+#include "Utils/EventRouting.h"
 
 
-MidiFilePlayer::MidiFilePlayer(Node* parent) : Node(parent, Type::MidiFilePlayer) {}
-
-MidiFilePlayer::~MidiFilePlayer() = default;
+MidiFilePlayer::MidiFilePlayer(Node* parent) : Node(parent, Type::MidiFilePlayer), m_strip{qobject_cast<ChannelStrip*>(parent)}
+{
+    connect(AudioEngine::instance()->transport(), &Transport::tempoMapChanged, this, [this]()
+    {
+        if (m_midiFile)
+            load(false);
+    });
+}
 
-void MidiFilePlayer::setPorts(int, float**, int, float** outputs)
+MidiFilePlayer::~MidiFilePlayer()
 {
-    buffer[0] = outputs[0];
-    buffer[1] = outputs[1];
+    {
+        std::lock_guard lock{m_loadMutex};
+        m_shouldStopLoading = true;
+        m_pendingLoad.reset();
+    }
+
+    // At most for the one load it's in the middle of
+    m_loadCondition.notify_one();
+    if (m_loader.joinable())
+        m_loader.join();
+
+    m_audioSequence.store(nullptr);
+
+    free(m_silence[0]);
+    free(m_silence[1]);
 }
 
-void MidiFilePlayer::activate(std::int32_t /*sampleRate*/, std::int32_t /*blockSize*/)
+void MidiFilePlayer::setPorts(int, float**, int, float**) {}
+
+void MidiFilePlayer::activate(const std::int32_t sampleRate, const std::int32_t blockSize)
 {
-    qDebug() << "MidiFilePlayer::activate";
+    m_sampleRate = sampleRate;
+    m_blockSize = blockSize;
+
+    // It makes no sound of its own, but the strip mixes in every child's buffer, a block
+    // of it; the smaller ones go once the audio thread can't be reading them anymore
+    if (blockSize > m_silenceSize)
+    {
+        float* oldSilence[2] = {m_silence[0], m_silence[1]};
+
+        m_silence[0] = static_cast<float*>(std::calloc(static_cast<std::size_t>(blockSize), sizeof(float)));
+        m_silence[1] = static_cast<float*>(std::calloc(static_cast<std::size_t>(blockSize), sizeof(float)));
+        m_silenceSize = blockSize;
+        buffer[0] = m_silence[0];
+        buffer[1] = m_silence[1];
+
+        EpochReclaimer::instance()->retire([left = oldSilence[0], right = oldSilence[1]]()
+        {
+            free(left);
+            free(right);
+        });
+    }
+
+    if (m_midiFile && (!m_sequence || m_sequence->sampleRate != sampleRate))
+        load(false);
+
+    auto curStatus = status.load();
+    curStatus.status = S::Stopped;
+    status.store(curStatus);
 }
 
-void MidiFilePlayer::deactivate() {}
+void MidiFilePlayer::deactivate()
+{
+    auto curStatus = status.load();
+    curStatus.status = S::Inactive;
+    status.store(curStatus);
+}
 
 void MidiFilePlayer::startProcessing()
 {
-    qDebug() << "MidiFilePlayer::startProcessing";
+    m_nextBlockStart = -1;
+
+    auto curStatus = status.load();
+    curStatus.status = S::Running;
+    status.store(curStatus);
 }
 
-void MidiFilePlayer::stopProcessing() {}
+void MidiFilePlayer::stopProcessing()
+{
+    // The plugins are stopping too, nothing is left sounding
+    m_heldNotes = {};
+    m_hasHeldNotes = false;
+
+    auto curStatus = status.load();
+    curStatus.status = S::Stopped;
+    status.store(curStatus);
+}
+
+void MidiFilePlayer::processNoteRawMidi(int /*sampleOffset*/, int /*port*/, std::span<const unsigned char> /*data*/) {}
+
+void MidiFilePlayer::process()
+{
+    const auto curStatus = status.load();
+    if (curStatus.status == S::Starting)
+        startProcessing();
+    else if (curStatus.status != S::Running)
+        return;
+
+    const auto* transport = transportEvent();
+    const auto* sequence = m_audioSequence.load(std::memory_order_acquire);
+
+    const bool isPlaying = (transport->flags & CLAP_TRANSPORT_IS_PLAYING) && !curStatus.isBypassed
+        && sequence && sequence->sampleRate == m_sampleRate && m_blockSize > 0;
 
-void MidiFilePlayer::processNoteRawMidi(int /*sampleOffset*/, const std::vector<unsigned char>& /*data*/) {}
+    if (!isPlaying)
+    {
+        releaseHeldNotes(0);
+        m_nextBlockStart = -1;
 
-void MidiFilePlayer::process() {}
+        return;
+    }
+
+    auto blockStart = std::llround(static_cast<double>(transport->song_pos_seconds) / CLAP_SECTIME_FACTOR * m_sampleRate);
+
+    // Rounding can put a block a sample off from where the last one ended, anything
+    // more is a seek or a loop and whatever was sounding has to stop
+    if (std::abs(blockStart - m_nextBlockStart) <= 1)
+        blockStart = m_nextBlockStart;
+    else
+        releaseHeldNotes(0);
+
+    const auto blockEnd = blockStart + m_blockSize;
+    const auto& samples = sequence->samples;
+
+    for (auto i = std::ranges::lower_bound(samples, blockStart) - samples.begin();
+         i < std::ssize(samples) && samples[i] < blockEnd; ++i)
+    {
+        playMessage(static_cast<int>(samples[i] - blockStart), sequence->messages[i]);
+    }
+
+    m_nextBlockStart = blockEnd;
+}
 
 float MidiFilePlayer::outputVolume() const
 {
     return m_outputVolume;
 }
 
-void MidiFilePlayer::setOutputVolume(float /*newOutputVolume*/) {}
+void MidiFilePlayer::setOutputVolume(const float newOutputVolume)
+{
+    if (qFuzzyCompare(newOutputVolume, m_outputVolume))
+        return;
+
+    m_outputVolume = newOutputVolume;
+    emit outputVolumeChanged();
+    markDirty();
+}
 
 const QString& MidiFilePlayer::filePath() const
 {
     return m_filePath;
 }
 
-void MidiFilePlayer::setFilePath(const QString& /*newFilePath*/) {}
+void MidiFilePlayer::setFilePath(const QString& newFilePath)
+{
+    const auto path = newFilePath.startsWith("file://")? newFilePath.mid(7) : newFilePath;
+    if (path == m_filePath)
+        return;
+
+    m_filePath = path;
+    emit filePathChanged();
+    markDirty();
+
+    if (m_filePath.isEmpty())
+    {
+        ++m_loadGeneration;
+        setSequence(nullptr, nullptr);
+
+        return;
+    }
+
+    load(true);
+}
+
+int MidiFilePlayer::eventCount() const
+{
+    return m_midiFile? static_cast<int>(m_midiFile->ticks.size()) : 0;
+}
+
+double MidiFilePlayer::lengthInBeats() const
+{
+    return m_midiFile? static_cast<double>(m_midiFile->lengthInTicks) / m_midiFile->ticksPerQuarter : 0.0;
+}
 
 QJsonObject MidiFilePlayer::getState() const
 {
     QJsonObject state;
     state["type"] = "MidiFilePlayer";
     state["name"] = m_name;
+    state["filePath"] = m_filePath;
+    state["outputVolume"] = m_outputVolume.load();
     state["nodes"] = {};
 
     return state;
@@ -56,4 +208,168 @@ QJsonObject MidiFilePlayer::getState() const
 void MidiFilePlayer::loadState(const QJsonObject& stateToLoad)
 {
     m_name = stateToLoad["name"].toString();
+    setOutputVolume(static_cast<float>(stateToLoad["outputVolume"].toDouble(1.0)));
+    setFilePath(stateToLoad["filePath"].toString());
+}
+
+void MidiFilePlayer::load(const bool shouldParse)
+{
+    auto midiFile = shouldParse? nullptr : m_midiFile;
+    if (!shouldParse && !midiFile)
+        return;
+
+    const auto generation = ++m_loadGeneration;
+
+    if (!m_isLoading)
+    {
+        m_isLoading = true;
+        emit isLoadingChanged();
+    }
+
+    // A load still waiting is superseded right here, one already running once it's done
+    {
+        std::lock_guard lock{m_loadMutex};
+        m_pendingLoad = LoadJob{generation, std::move(midiFile), m_filePath, m_sampleRate,
+                                AudioEngine::instance()->transport()->tempoMapSnapshot()};
+    }
+
+    m_loadCondition.notify_one();
+
+    if (!m_loader.joinable())
+        m_loader = std::thread{[this]() { runLoader(); }};
+}
+
+void MidiFilePlayer::runLoader()
+{
+    while (true)
+    {
+        std::optional<LoadJob> job;
+
+        {
+            std::unique_lock lock{m_loadMutex};
+            m_loadCondition.wait(lock, [this]() { return m_shouldStopLoading || m_pendingLoad.has_value(); });
+
+            if (m_shouldStopLoading)
+                return;
+
+            job.swap(m_pendingLoad);
+        }
+
+        auto midiFile = std::move(job->midiFile);
+        if (!midiFile)
+        {
+            if (auto parsed = MidiFile::load(job->path))
+                midiFile = std::make_shared<const MidiFile>(std::move(*parsed));
+        }
+
+        auto sequence = midiFile? buildSequence(*midiFile, std::move(job->tempoMap), job->sampleRate) : nullptr;
+
+        // The destructor joins us, so this is still alive; Qt drops the call if it's gone by then
+        QMetaObject::invokeMethod(this, [this, generation = job->generation, midiFile, sequence]()
+        {
+            if (generation != m_loadGeneration)
+                return;
+
+            m_isLoading = false;
+            emit isLoadingChanged();
+
+            setSequence(midiFile, sequence);
+
+            // The engine started or the tempo changed while this one was being timed
+            if (sequence && (sequence->sampleRate != m_sampleRate
+                             || sequence->tempoMap != AudioEngine::instance()->transport()->tempoMapSnapshot()))
+            {
+                load(false);
+            }
+        }, Qt::QueuedConnection);
+    }
+}
+
+void MidiFilePlayer::setSequence(std::shared_ptr<const MidiFile> midiFile, std::shared_ptr<const Sequence> sequence)
+{
+    m_midiFile = std::move(midiFile);
+    m_audioSequence.store(sequence.get(), std::memory_order_release);
+
+    if (auto oldSequence = std::exchange(m_sequence, std::move(sequence)))
+        EpochReclaimer::instance()->retire([oldSequence]() {});
+
+    emit sequenceChanged();
+}
+
+std::shared_ptr<const MidiFilePlayer::Sequence> MidiFilePlayer::buildSequence(const MidiFile& midiFile,
+    std::shared_ptr<const Transport::TempoMap> tempoMap, const std::int32_t sampleRate)
+{
+    auto sequence = std::make_shared<Sequence>();
+    sequence->sampleRate = sampleRate;
+    sequence->tempoMap = std::move(tempoMap);
+    sequence->samples.resize(midiFile.ticks.size());
+    sequence->messages = midiFile.messages;
+
+    // Ticks are sorted and so are the samples they land on, whatever the tempo does
+    for (std::size_t i = 0; i < midiFile.ticks.size(); ++i)
+    {
+        const auto beat = static_cast<double>(midiFile.ticks[i]) / midiFile.ticksPerQuarter;
+        sequence->samples[i] = std::llround(sequence->tempoMap->secondsAt(beat) * sampleRate);
+    }
+
+    return sequence;
+}
+
+void MidiFilePlayer::playMessage(const int sampleOffset, const std::uint32_t message)
+{
+    std::array<unsigned char, 3> bytes = {
+        static_cast<unsigned char>(message),
+        static_cast<unsigned char>(message >> 8),
+        static_cast<unsigned char>(message >> 16),
+    };
+
+    auto& heldNotes = m_heldNotes[bytes[0] & 0x0F];
+
+    switch (bytes[0] & 0xF0)
+    {
+        case 0x90:
+            if (bytes[2] > 0)
+            {
+                const auto velocity = std::lround(bytes[2] * m_outputVolume.load(std::memory_order_relaxed));
+                bytes[2] = static_cast<unsigned char>(std::clamp<long>(velocity, 1, 127));
+
+                heldNotes.set(bytes[1]);
+                m_hasHeldNotes = true;
+
+                break;
+            }
+
+            // A note on with no velocity is a note off
+            [[fallthrough]];
+        case 0x80:
+            heldNotes.reset(bytes[1]);
+            break;
+
+        default:
+            break;
+    }
+
+    if (!m_strip)
+        return;
+
+    const std::span<const unsigned char> data{bytes.data(), ocp::midiMessageSize(bytes[0])};
+
+    m_strip->processNodesRawMidi(sampleOffset, -1, data);
+}
+
+void MidiFilePlayer::releaseHeldNotes(const int sampleOffset)
+{
+    if (!m_hasHeldNotes)
+        return;
+
+    for (std::uint32_t channel = 0; channel < m_heldNotes.size(); ++channel)
+    {
+        for (std::uint32_t key = 0; key < 128; ++key)
+        {
+            if (m_heldNotes[channel].test(key))
+                playMessage(sampleOffset, 0x80 | channel | key << 8);
+        }
+    }
+
+    m_hasHeldNotes = false;
 }
@@ -1,13 +1,31 @@
 #pragma once
+#include <array>
+#include <bitset>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include "Node.h"
 #include "PluginHost.h"
+#include "Transport.h"
+#include "Utils/MidiFile.h"
 
 
+class ChannelStrip;
+
+
+// Plays a Standard MIDI File into the plugins of the strip it's in, following the
+// engine's transport. The file is parsed on a background thread and laid out on the
+// tempo map's sample timeline; the audio thread binary searches each block's start
+// and hands every event in it to the plugins at its exact offset.
 class MidiFilePlayer : public Node
 {
     Q_OBJECT
     Q_PROPERTY(float outputVolume READ outputVolume WRITE setOutputVolume NOTIFY outputVolumeChanged)
     Q_PROPERTY(QString filePath READ filePath WRITE setFilePath NOTIFY filePathChanged)
+    Q_PROPERTY(bool isLoading READ isLoading NOTIFY isLoadingChanged)
+    Q_PROPERTY(int eventCount READ eventCount NOTIFY sequenceChanged)
+    Q_PROPERTY(double lengthInBeats READ lengthInBeats NOTIFY sequenceChanged)
 
   public:
     explicit MidiFilePlayer(Node* parent);
@@ -20,15 +38,20 @@ class MidiFilePlayer : public Node
     void startProcessing() override;
     void stopProcessing() override;
 
-    void processNoteRawMidi(int sampleOffset, const std::vector<unsigned char>& data) override;
+    void processNoteRawMidi(int sampleOffset, int port, std::span<const unsigned char> data) override;
     void process() override;
 
+    // Scales the velocity of the notes played
     [[nodiscard]] float outputVolume() const;
     void setOutputVolume(float newOutputVolume);
 
     [[nodiscard]] const QString& filePath() const;
     void setFilePath(const QString& newFilePath);
 
+    [[nodiscard]] bool isLoading() const { return m_isLoading; }
+    [[nodiscard]] int eventCount() const;
+    [[nodiscard]] double lengthInBeats() const;
+
     [[nodiscard]] QJsonObject getState() const override;
     void loadState(const QJsonObject& stateToLoad) override;
 
@@ -36,13 +59,69 @@ class MidiFilePlayer : public Node
   signals:
     void outputVolumeChanged();
     void filePathChanged();
+    void isLoadingChanged();
+    void sequenceChanged();
 
 
-  public:
-    std::atomic<Status> m_status;
-    std::atomic<float> m_outputVolume = 0.7f;
+  private:
+    // The file's events on the sample timeline, for one sample rate and tempo map
+    struct Sequence
+    {
+        std::int32_t sampleRate = 0;
+        std::shared_ptr<const Transport::TempoMap> tempoMap;
+        std::vector<std::int64_t> samples;
+        std::vector<std::uint32_t> messages;
+    };
+
+    // The strip whose plugins get the file's events
+    ChannelStrip* m_strip = nullptr;
 
+    std::atomic<float> m_outputVolume = 1.0f;
     QString m_filePath;
+    std::int32_t m_sampleRate = 48000;
+    std::int32_t m_blockSize = 0;
+    float* m_silence[2] = {nullptr, nullptr};
+    // In frames, the largest block it was activated with
+    std::int32_t m_silenceSize = 0;
+
+    // Main thread
+    std::shared_ptr<const MidiFile> m_midiFile;
+    std::shared_ptr<const Sequence> m_sequence;
+    bool m_isLoading = false;
+    // Bumped on every load, so results of loads that got superseded are dropped
+    std::uint32_t m_loadGeneration = 0;
+
+    // What the loader thread is asked to do; only the latest one waiting is done
+    struct LoadJob
+    {
+        std::uint32_t generation = 0;
+        std::shared_ptr<const MidiFile> midiFile;
+        QString path;
+        std::int32_t sampleRate = 0;
+        std::shared_ptr<const Transport::TempoMap> tempoMap;
+    };
+
+    std::mutex m_loadMutex;
+    std::condition_variable m_loadCondition;
+    std::optional<LoadJob> m_pendingLoad;
+    bool m_shouldStopLoading = false;
+    std::thread m_loader;
+
+    std::atomic<const Sequence*> m_audioSequence = nullptr;
+
+    // audio thread only: where the last block ended, and the notes left sounding
+    std::int64_t m_nextBlockStart = -1;
+    std::array<std::bitset<128>, 16> m_heldNotes;
+    bool m_hasHeldNotes = false;
+
+    // Parses the file first if it isn't yet; then times it against the transport's tempo map
+    void load(bool shouldParse);
+    void runLoader();
+    void setSequence(std::shared_ptr<const MidiFile> midiFile, std::shared_ptr<const Sequence> sequence);
+
+    [[nodiscard]] static std::shared_ptr<const Sequence> buildSequence(const MidiFile& midiFile,
+        std::shared_ptr<const Transport::TempoMap> tempoMap, std::int32_t sampleRate);
 
-    unsigned int m_bufferSize = 4096;
+    void playMessage(int sampleOffset, std::uint32_t message);
+    void releaseHeldNotes(int sampleOffset);
 };
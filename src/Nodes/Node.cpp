@@ -1,8 +1,10 @@
 #include "Node.h"
 #include <QJsonObject>
+#include "AudioEngine.h"
 #include "ChannelStrip.h"
 #include "PluginHost.h"
 #include "MidiFilePlayer.h"
+#include "ChainComparison.h"
 
 
 Node* Node::create(Node* parent, const QJsonObject& stateToLoad)
@@ -29,6 +31,13 @@ Node* Node::create(Node* parent, const QJsonObject& stateToLoad)
         return node;
     }
 
+    if (type == "ChainComparison")
+    {
+        auto* node = new ChainComparison(parent);
+        node->loadState(stateToLoad);
+        return node;
+    }
+
     qDebug() << "type of node not found:" << type;
     return nullptr;
 }
@@ -59,6 +68,7 @@ void Node::setName(const QString& name)
 
     m_name = name;
     emit nameChanged();
+    markDirty();
 }
 
 bool Node::isByPassed() const
@@ -75,6 +85,7 @@ void Node::setIsByPassed(const bool newValue)
     status_.isBypassed = newValue;
     status.store(status_);
     emit isByPassedChanged();
+    markDirty();
 }
 
 QList<Node*> Node::nodes() const
@@ -89,3 +100,33 @@ void Node::clearNodes()
 
     m_nodes.clear();
 }
+
+const clap_event_transport* Node::transportEvent() const
+{
+    for (const auto* node = this; node; node = qobject_cast<const Node*>(node->parent()))
+    {
+        if (node->m_renderTransport)
+            return node->m_renderTransport->event();
+    }
+
+    return AudioEngine::instance()->transport()->event();
+}
+
+void Node::markDirty()
+{
+    // All the way up every time, the node might have moved since it got dirty
+    m_isDirty = true;
+
+    if (auto* parentNode = qobject_cast<Node*>(parent()))
+        parentNode->markDirty();
+    else if (auto* audioEngine = AudioEngine::instance())
+        audioEngine->markSessionDirty();
+}
+
+void Node::markClean()
+{
+    m_isDirty = false;
+
+    for (auto* node : findChildren<Node*>())
+        node->m_isDirty = false;
+}
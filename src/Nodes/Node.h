@@ -1,8 +1,12 @@
 #pragma once
+#include <span>
 #include <vector>
-#include <clap/helpers/event-list.hh>
 #include <clap/process.h>
 #include <QObject>
+#include "Utils/EventArena.h"
+
+
+class Transport;
 
 
 enum class S : std::uint8_t
@@ -42,6 +46,7 @@ class Node : public QObject
         ChannelStrip,
         PluginHost,
         MidiFilePlayer,
+        ChainComparison,
     };
     Q_ENUM(Type)
 
@@ -59,6 +64,13 @@ class Node : public QObject
     [[nodiscard]] QList<Node*> nodes() const;
     void clearNodes();
 
+    // Whether anything that gets saved with the node changed since it was last written
+    [[nodiscard]] bool isDirty() const { return m_isDirty; }
+    // Main thread; the nodes it's in, and the session, are dirty too from then on
+    void markDirty();
+    // Main thread, once the node and everything in it got written
+    void markClean();
+
     virtual void setPorts(int numInputs, float** inputs, int numOutputs, float** outputs) = 0;
     virtual void activate(std::int32_t sampleRate, std::int32_t blockSize) = 0;
     virtual void deactivate() = 0;
@@ -66,7 +78,12 @@ class Node : public QObject
     virtual void startProcessing() = 0;
     virtual void stopProcessing() = 0;
 
-    virtual void processNoteRawMidi(int sampleOffset, const std::vector<unsigned char>& data) = 0;
+    // What the node plays along to this block: the engine's transport, unless a node
+    // it's in is being rendered offline against one of its own
+    [[nodiscard]] const clap_event_transport* transportEvent() const;
+
+    // A message from a MIDI input port, already timed within the current block
+    virtual void processNoteRawMidi(int sampleOffset, int port, std::span<const unsigned char> data) = 0;
     virtual void process() = 0;
 
     virtual QJsonObject getState() const = 0;
@@ -76,9 +93,16 @@ class Node : public QObject
     std::atomic<int> pendingTopologyChanges = 0;
     std::atomic<Status> status;
     clap_process m_process{};
-    clap::helpers::EventList m_evIn;
-    clap::helpers::EventList m_evOut;
+    // What the node gets this block from the host, and what it produced; sized on activate
+    EventArena m_evIn;
+    EventArena m_evOut;
+    // Set by the parent right before process(): what the previous node in a chain put
+    // out this block, and whether m_evOut holds anything from this one
+    const EventArena* m_upstreamEvents = nullptr;
+    bool m_hasOutputEvents = false;
     float* buffer[2] = {nullptr, nullptr};
+    // Set only while nothing but the render's thread processes the node
+    const Transport* m_renderTransport = nullptr;
 
 
   public slots:
@@ -98,5 +122,6 @@ class Node : public QObject
 
     const Type m_type;
     QString m_name;
+    bool m_isDirty = false;
 
 };
@@ -1,16 +1,20 @@
 #include "PluginHost.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <exception>
 #include <thread>
+#include <utility>
 #include <clap/helpers/host.hxx>
 #include <clap/helpers/plugin-proxy.hxx>
-#include <clap/helpers/reducing-param-queue.hxx>
-#include <QBuffer>
-#include <QFile>
+#include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include "App.h"
+#include "ChannelStrip.h"
 #include "Components/PluginQuickView.h"
 #include "Utils.h"
+#include "Utils/EpochReclaimer.h"
 
 
 enum class ThreadType
@@ -53,22 +57,27 @@ PluginHost::PluginHost(Node* parent)
 
     connect(this, &PluginHost::parameterGestureBegan, this, &PluginHost::beginParameterGesture);
     connect(this, &PluginHost::parameterGestureEnded, this, &PluginHost::endParameterGesture);
+
+    connect(this, &Node::isByPassedChanged, this, [this]()
+    {
+        if (isPlaceholder() && !isByPassed())
+            instantiate();
+    });
 }
 
 PluginHost::~PluginHost()
 {
     qDebug() << "PluginHost::~PluginHost()" << m_name;
     setIsFloatingWindowOpen(false);
-    PluginHost::deactivate();
-    destroyGuiWindow();
-
-    if (m_plugin)
-    {
-        m_plugin->destroy();
-        m_plugin.reset();
-    }
 
     PluginManager::instance()->unload(*this);
+
+    if (auto* engine = AudioEngine::instance())
+        engine->midiMapping()->removeBindings(*this);
+
+    // The plugin instance keeps a reference to us as its clap_host, so it has to
+    // be gone before we are; a stalled audio thread is waited out, however long
+    while (m_retiredInstanceCount > 0 && !EpochReclaimer::instance()->synchronize()) {}
 }
 
 uint32_t PluginHost::parameterCount() const
@@ -113,6 +122,15 @@ bool PluginHost::isFloatingWindowOpen() const
 
 void PluginHost::setIsFloatingWindowOpen(const bool value)
 {
+    if (value && isPlaceholder())
+    {
+        if (auto* plugin = instantiate(); plugin != this)
+        {
+            plugin->setIsFloatingWindowOpen(true);
+            return;
+        }
+    }
+
     if (value)
     {
         if (isFloatingWindowOpen())
@@ -177,6 +195,8 @@ void PluginHost::activate(const int32_t sample_rate, const int32_t blockSize)
     if (!m_plugin || curStatus.status >= S::Stopped)
         return;
 
+    const auto residentMemoryBefore = ocp::residentMemoryBytes();
+
     if (!m_plugin->activate(sample_rate, blockSize, blockSize))
     {
         qWarning() << "Could not activate plugin:" << m_name;
@@ -186,6 +206,22 @@ void PluginHost::activate(const int32_t sample_rate, const int32_t blockSize)
         return;
     }
 
+    if (const auto residentMemoryAfter = ocp::residentMemoryBytes(); residentMemoryAfter > residentMemoryBefore)
+        m_activationFootprint = std::max(m_activationFootprint, residentMemoryAfter - residentMemoryBefore);
+
+    // Nothing is processing yet, so this is the time to size what the audio thread uses
+    const auto hostEventCapacity = std::max<uint32_t>(1024, blockSize);
+    // A block's worth of SysEx, several patch dumps at once; only for a side that can
+    // carry any, most plugins have no MIDI note port and never see a byte of it
+    constexpr uint32_t sysexPayloadCapacity = 256 * 1024;
+    const auto paramEventCapacity = m_paramQueue? m_paramQueue->slotCount() : 0;
+
+    m_evIn.reserve(hostEventCapacity, hasMidiNotePort(true)? sysexPayloadCapacity : 0);
+    m_evOut.reserve(hostEventCapacity, hasMidiNotePort(false)? sysexPayloadCapacity : 0);
+    m_paramEvents.reserve(paramEventCapacity, 0);
+    m_forwardedEvents.reserve(hostEventCapacity);
+    m_inputEvents.reserve(2 * hostEventCapacity + paramEventCapacity);
+
     m_sampleRate = sample_rate;
     m_sampleStep = 1.0 / m_sampleRate;
     m_blockSize = blockSize;
@@ -204,17 +240,20 @@ void PluginHost::deactivate()
 
     m_blockSize = 0;
     m_plugin->deactivate();
+
+    reportDroppedEvents();
 }
 
 void PluginHost::startProcessing()
 {
-    if (!m_plugin)
+    auto* plugin = m_audioPlugin.load(std::memory_order_acquire);
+    if (!plugin)
         return;
 
     m_evOut.clear();
     m_evIn.clear();
 
-    m_plugin->startProcessing();
+    plugin->startProcessing();
 
     auto curStatus = status.load();
     curStatus.status = S::Running;
@@ -223,37 +262,143 @@ void PluginHost::startProcessing()
 
 void PluginHost::stopProcessing()
 {
-    if (!m_plugin)
+    auto* plugin = m_audioPlugin.load(std::memory_order_acquire);
+    if (!plugin)
         return;
 
     auto curStatus = status.load();
     curStatus.status = S::Stopped;
     status.store(curStatus);
 
-    m_plugin->stopProcessing();
+    plugin->stopProcessing();
     m_isProcessing = false;
 
     m_evOut.clear();
     m_evIn.clear();
 }
 
-void PluginHost::setParamValue(const clap_id id, const double newValue)
+void PluginHost::setParamValue(const uint32_t row, const clap_id id, const double newValue)
 {
-    clap_event_param_value event{};
-    event.header.time = 0;
-    event.header.type = CLAP_EVENT_PARAM_VALUE;
-    event.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
-    event.header.flags = 0;
-    event.header.size = sizeof(event);
-    event.param_id = id;
-    event.cookie = nullptr;
-    event.port_index = 0;
-    event.key = -1;
-    event.channel = -1;
-    event.note_id = -1;
-    event.value = newValue;
+    if (!m_paramQueue)
+        return;
 
-    m_evIn.push(&event.header);
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    m_paramQueue->push(row, id, newValue, std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+
+    // Nobody drains the queue while the plugin is inactive, and that's also the only
+    // time params.flush() may be called from here, once per event loop iteration
+    if (m_isParamFlushPending || status.load().status >= S::Stopped)
+        return;
+
+    m_isParamFlushPending = true;
+    QMetaObject::invokeMethod(this, &PluginHost::flushParamsIfIdle, Qt::QueuedConnection);
+}
+
+bool PluginHost::hasQueuedParamValues() const
+{
+    return m_paramQueue && !m_paramQueue->isEmpty();
+}
+
+bool PluginHost::hasMidiNotePort(const bool isInput) const
+{
+    if (!m_plugin->canUseNotePorts())
+        return false;
+
+    for (uint32_t i = 0; i < m_plugin->notePortsCount(isInput); ++i)
+    {
+        clap_note_port_info info{};
+        if (m_plugin->notePortsGet(i, isInput, &info) && (info.supported_dialects & CLAP_NOTE_DIALECT_MIDI))
+            return true;
+    }
+
+    return false;
+}
+
+std::uint32_t PluginHost::latency() const
+{
+    if (!m_plugin || !m_plugin->canUseLatency() || status.load().status < S::Stopped)
+        return 0;
+
+    return m_plugin->latencyGet();
+}
+
+void PluginHost::pushQueuedParamValues(ParamValueQueue& queue, EventArena& events,
+    const std::int64_t blockStartTime) const
+{
+    // Values that came in during the previous block are placed at the same relative
+    // position in this one: a fixed block of latency instead of jitter
+    const auto blockDuration = blockStartTime > 0 && m_blockSize > 0
+        ? static_cast<std::int64_t>(1'000'000'000.0 * m_blockSize / m_sampleRate)
+        : 0;
+    const auto windowStart = blockStartTime - blockDuration;
+    uint32_t previousTime = 0;
+
+    queue.drain([&](const clap_id id, const double value, const std::int64_t timeNs)
+    {
+        auto event = buildParameterValueChangeEvent(id, value);
+
+        if (blockDuration > 0)
+        {
+            const auto position = std::clamp<std::int64_t>(
+                (timeNs - windowStart) * m_blockSize / blockDuration, 0, m_blockSize - 1);
+
+            // Coalesced values keep their first place in the queue, the plugin wants them sorted
+            event.header.time = std::max(previousTime, static_cast<uint32_t>(position));
+            previousTime = event.header.time;
+        }
+
+        events.push(&event.header);
+    });
+}
+
+void PluginHost::flushParamsIfIdle()
+{
+    m_isParamFlushPending = false;
+
+    if (!m_plugin || !m_paramQueue || !m_plugin->canUseParams() || status.load().status >= S::Stopped)
+        return;
+
+    EventArena in;
+    EventArena out;
+    in.reserve(m_paramQueue->slotCount(), 0);
+    out.reserve(m_paramQueue->slotCount(), 0);
+
+    pushQueuedParamValues(*m_paramQueue, in, 0);
+    if (in.size() == 0)
+        return;
+
+    m_plugin->paramsFlush(in.clapInputEvents(), out.clapOutputEvents());
+}
+
+void PluginHost::rebuildParamBuffers()
+{
+    const auto& ids = m_parameterModel->ids();
+
+    auto paramQueue = std::make_unique<ParamValueQueue>(static_cast<uint32_t>(ids.size()));
+    auto paramFeedback = std::make_unique<ParamValueFeedback>(ids);
+
+    m_audioParamQueue.store(paramQueue.get(), std::memory_order_release);
+    m_audioParamFeedback.store(paramFeedback.get(), std::memory_order_release);
+
+    std::shared_ptr<ParamValueQueue> oldParamQueue = std::exchange(m_paramQueue, std::move(paramQueue));
+    std::shared_ptr<ParamValueFeedback> oldParamFeedback = std::exchange(m_paramFeedback, std::move(paramFeedback));
+
+    if (oldParamQueue || oldParamFeedback)
+        EpochReclaimer::instance()->retire([oldParamQueue, oldParamFeedback]() {});
+}
+
+void PluginHost::paramsRescan(const clap_param_rescan_flags flags) noexcept
+{
+    if (!m_parameterModel)
+        return;
+
+    m_parameterModel->rescan(flags);
+
+    if (flags & CLAP_PARAM_RESCAN_ALL)
+    {
+        rebuildParamBuffers();
+        AudioEngine::instance()->midiMapping()->refresh(*this);
+    }
 }
 
 void PluginHost::processNoteOn(const int sampleOffset, const int channel, const int key, const int velocity)
@@ -290,42 +435,68 @@ void PluginHost::processNoteOff(const int sampleOffset, const int channel, const
     m_evIn.push(&ev.header);
 }
 
-void PluginHost::processNoteRawMidi(const int sampleOffset, const std::vector<unsigned char>& data)
+void PluginHost::processParamValue(const int sampleOffset, const clap_id id, const double value)
 {
-    clap_event_midi ev{};
-    ev.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
-    ev.header.type = CLAP_EVENT_MIDI;
-    ev.header.time = sampleOffset;
-    ev.header.flags = 0;
-    ev.header.size = sizeof(ev);
-    ev.port_index = 0;
-    ev.data[0] = data[0];
-    ev.data[1] = data[1];
-    ev.data[2] = data[2];
+    auto event = buildParameterValueChangeEvent(id, value);
+    event.header.time = sampleOffset;
+    m_evIn.push(&event.header);
+
+    // Plugins don't echo back the values they're given, the GUI learns about it from here
+    if (auto* feedback = m_audioParamFeedback.load(std::memory_order_acquire))
+        feedback->publish(id, value);
+}
 
-    m_evOut.push(&ev.header);
+void PluginHost::processNoteRawMidi(const int sampleOffset, int, const std::span<const unsigned char> data)
+{
+    if (const auto* event = buildMidiEvent(sampleOffset, data); event)
+        m_evIn.push(event);
 }
 
-void PluginHost::outputRawMidi(const int sampleOffset, const std::vector<unsigned char>& data)
+const clap_event_header* PluginHost::buildMidiEvent(const int sampleOffset, const std::span<const unsigned char> data)
 {
-    clap_event_midi ev{};
+    if (data.empty())
+        return nullptr;
+
+    // SysEx only points at its bytes, the arena it's pushed to copies them
+    if (data[0] == 0xF0)
+    {
+        auto& ev = m_midiSysexEvent;
+        ev.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+        ev.header.type = CLAP_EVENT_MIDI_SYSEX;
+        ev.header.time = sampleOffset;
+        ev.header.flags = 0;
+        ev.header.size = sizeof(ev);
+        ev.port_index = 0;
+        ev.buffer = data.data();
+        ev.size = static_cast<uint32_t>(data.size());
+
+        return &ev.header;
+    }
+
+    if (data.size() > 3)
+        return nullptr;
+
+    auto& ev = m_midiEvent;
+    ev = {};
     ev.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
     ev.header.type = CLAP_EVENT_MIDI;
     ev.header.time = sampleOffset;
     ev.header.flags = 0;
     ev.header.size = sizeof(ev);
     ev.port_index = 0;
-    ev.data[0] = data[0];
-    ev.data[1] = data[1];
-    ev.data[2] = data[2];
+    std::ranges::copy(data, ev.data);
 
-    m_evIn.push(&ev.header);
+    return &ev.header;
 }
 
 void PluginHost::process()
 {
     threadType = ThreadType::AudioThread;
-    if (!m_plugin || m_blockSize == 0)
+
+    m_hasOutputEvents = false;
+
+    auto* plugin = m_audioPlugin.load(std::memory_order_acquire);
+    if (!plugin || m_blockSize == 0)
         return;
 
     const auto curStatus = status.load();
@@ -339,31 +510,22 @@ void PluginHost::process()
         return;
     }
 
-    clap_event_transport transport_event = {};
-    transport_event.header.size = sizeof(clap_event_transport);
-    transport_event.header.time = 0;
-    transport_event.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
-    transport_event.header.type = CLAP_EVENT_TRANSPORT;
-    transport_event.header.flags = 0;
+    m_paramEvents.clear();
+    if (auto* paramQueue = m_audioParamQueue.load(std::memory_order_acquire))
+        pushQueuedParamValues(*paramQueue, m_paramEvents, AudioEngine::instance()->blockStartTime());
 
-    transport_event.flags = CLAP_TRANSPORT_HAS_TEMPO |
-                            CLAP_TRANSPORT_HAS_BEATS_TIMELINE |
-                            CLAP_TRANSPORT_IS_PLAYING;
+    m_forwardedEvents.reset(m_upstreamEvents);
 
-    samplesPerBeat = m_sampleRate * (60.0 / AudioEngine::instance()->bpm());
+    m_inputEvents.clear();
+    m_inputEvents.addSource(m_evIn.clapInputEvents());
+    m_inputEvents.addSource(m_paramEvents.clapInputEvents());
+    m_inputEvents.addSource(m_forwardedEvents.clapInputEvents());
+    m_inputEvents.merge();
 
-    const double somethingElse = m_blockSize / samplesPerBeat;
     m_process.frames_count = m_blockSize;
+    m_process.transport = transportEvent();
 
-    transport_event.song_pos_beats = static_cast<clap_beattime>(std::round(CLAP_BEATTIME_FACTOR * song_pos_beats));
-    transport_event.song_pos_seconds = current_sample / m_sampleRate;
-
-    transport_event.tempo = AudioEngine::instance()->bpm();
-    transport_event.tempo_inc = 0.0;
-
-    m_process.transport = &transport_event;
-
-    m_process.in_events = m_evIn.clapInputEvents();
+    m_process.in_events = m_inputEvents.clapInputEvents();
     m_process.out_events = m_evOut.clapOutputEvents();
 
     m_process.audio_inputs = &m_audioIn;
@@ -373,13 +535,11 @@ void PluginHost::process()
 
     m_evOut.clear();
 
-    const auto clapStatus = m_plugin->process(&m_process);
+    const auto clapStatus = plugin->process(&m_process);
     (void)clapStatus;
+    m_hasOutputEvents = true;
 
-    song_pos_beats += somethingElse;
-    current_sample += m_blockSize;
-
-    for (size_t i = 0; i < m_evOut.size(); ++i)
+    for (uint32_t i = 0; i < m_evOut.size(); ++i)
     {
         switch (const auto event = m_evOut.get(i); event->type)
         {
@@ -398,25 +558,10 @@ void PluginHost::process()
             case CLAP_EVENT_PARAM_VALUE:
             {
                 const auto ev = reinterpret_cast<const clap_event_param_value*>(event);
-                m_parameterModel->setValueFromEngine(ev->param_id, ev->value);
-                break;
-            }
-            case CLAP_EVENT_NOTE_ON:
-            {
-                const auto ev = reinterpret_cast<const clap_event_note_t*>(event);
-                qDebug() << "NoteOn" << ev->key << " " << ev->velocity << " " << ev->channel << " " << ev->port_index << " ";
-
-                std::vector<unsigned char> midiMessage;
-
-                unsigned char _status = 0x90;    // Note On, channel 1
-                unsigned char note = 60;         // Middle C (MIDI note number)
-                unsigned char velocity = 100;    // Velocity (0-127)
-
-                midiMessage.push_back(_status);
-                midiMessage.push_back(note);
-                midiMessage.push_back(velocity);
+                if (auto* feedback = m_audioParamFeedback.load(std::memory_order_acquire))
+                    feedback->publish(ev->param_id, ev->value);
 
-                outputRawMidi(0, midiMessage);
+                break;
             }
             default:
                 break;
@@ -437,6 +582,11 @@ bool PluginHost::threadCheckIsAudioThread() const noexcept
     return threadType != ThreadType::MainThread;
 }
 
+void PluginHost::markAudioThread()
+{
+    threadType = ThreadType::AudioThread;
+}
+
 bool PluginHost::hasWindow(const QQuickWindow* window) const
 {
     return m_parentWindow == window;
@@ -444,6 +594,12 @@ bool PluginHost::hasWindow(const QQuickWindow* window) const
 
 void PluginHost::createGuiWindow(QQuickWindow* parentWindow)
 {
+    if (auto* plugin = instantiate(); plugin != this)
+    {
+        plugin->createGuiWindow(parentWindow);
+        return;
+    }
+
     m_parentWindow = parentWindow;
 
     if (!m_plugin || !m_plugin->canUseGui())
@@ -511,14 +667,34 @@ void PluginHost::destroyGuiWindow()
 
 void PluginHost::loadPluginState(const QString& stateAsBase64)
 {
-    const QByteArray stateData = QByteArray::fromBase64(stateAsBase64.toUtf8());
+    loadStateBlob(QByteArray::fromBase64(stateAsBase64.toUtf8()));
+}
+
+void PluginHost::loadStateBlob(const QByteArrayView stateData)
+{
+    // A placeholder just holds on to it, for when it's loaded
+    if (!m_plugin && isPlaceholder())
+    {
+        m_pendingState.remove("stateBlob");
+        m_pendingBlob = stateData.toByteArray();
+        m_stateVersion = newStateVersion();
+        m_baseStateVersion = m_stateVersion;
+
+        return;
+    }
+
+    if (!m_plugin)
+        return;
+
+    m_stateVersion = newStateVersion();
+    m_baseStateVersion = m_stateVersion;
 
     if (!m_plugin->canUseState())
     {
         if (!m_plugin->canUseParams())
             return;
 
-        const QJsonDocument pluginStateJson = QJsonDocument::fromJson(stateData);
+        const QJsonDocument pluginStateJson = QJsonDocument::fromJson(QByteArray::fromRawData(stateData.data(), stateData.size()));
         QJsonObject jsonObject = pluginStateJson.object();
 
         clap::helpers::EventList in;
@@ -526,7 +702,11 @@ void PluginHost::loadPluginState(const QString& stateAsBase64)
 
         for (auto it = jsonObject.begin(); it != jsonObject.end(); ++it)
         {
-            const auto key = it.key().toUInt();
+            bool isId = false;
+            const auto key = it.key().toUInt(&isId);
+            if (!isId)
+                continue;
+
             const auto value = it.value().toDouble();
 
             auto event = buildParameterValueChangeEvent(key, value);
@@ -548,58 +728,122 @@ void PluginHost::loadPluginState(const QString& stateAsBase64)
         return;
     }
 
-    QFile tempFile;
-    QBuffer stateBuffer(&tempFile);
-    stateBuffer.setData(stateData);
-    stateBuffer.open(QIODevice::ReadOnly);
+    // Read straight from wherever the state is, a session file's mapping included
+    struct Reader
+    {
+        QByteArrayView data;
+        qsizetype position = 0;
+    } reader{stateData};
 
-    const clap_istream pluginStateStream{ &stateBuffer, [](const clap_istream* stream, void* buffer, const uint64_t size) -> int64_t
+    const clap_istream pluginStateStream{ &reader, [](const clap_istream* stream, void* buffer, const uint64_t size) -> int64_t
     {
-        return static_cast<QBuffer*>(stream->ctx)->read(static_cast<char*>(buffer), static_cast<long long>(size));
+        auto& stateReader = *static_cast<Reader*>(stream->ctx);
+        const auto remaining = static_cast<uint64_t>(stateReader.data.size() - stateReader.position);
+        const auto count = static_cast<qsizetype>(std::min(size, remaining));
+
+        std::memcpy(buffer, stateReader.data.data() + stateReader.position, static_cast<std::size_t>(count));
+        stateReader.position += count;
+
+        return count;
     }};
 
     if (!m_plugin->stateLoad(&pluginStateStream))
+    {
         qWarning() << "Failed to load plugin state for:" << m_name;
+        return;
+    }
+
+    m_parameterModel->rescan(CLAP_PARAM_RESCAN_VALUES);
 }
 
-QJsonObject PluginHost::getState() const
+QByteArray PluginHost::saveStateBlob() const
 {
-    QJsonObject pluginStateJson;
-    pluginStateJson["type"] = "PluginHost";
-    pluginStateJson["name"] = name();
-    pluginStateJson["isBypassed"] = status.load().isBypassed;
-    pluginStateJson["path"] = path();
-    pluginStateJson["index"] = static_cast<int>(index());
+    if (!m_plugin)
+        return isPlaceholder()? pendingBlob().toByteArray() : QByteArray{};
+
+    // What the audio thread reported since the timer last ran, from mapped controllers say,
+    // changes the version before it's compared
+    m_parameterModel->collectEngineValues();
+
+    // Some plugins don't tell about changes made in their own window
+    if (m_stateBlobCacheVersion == m_stateVersion && !m_isNativeGuiOpen)
+        return m_stateBlobCache;
 
     if (!m_plugin->canUseState())
     {
-        for (const auto&[id, value] : m_parameterModel->getValues())
-            pluginStateJson[QString::number(id)] = value;
+        // Plugins that can't save themselves get their parameter values saved instead
+        QJsonObject parameterValuesJson;
 
-        const QJsonDocument jsonDoc(pluginStateJson);
+        const auto& ids = m_parameterModel->ids();
+        const auto& values = m_parameterModel->values();
 
-        const auto ret = jsonDoc.toJson(QJsonDocument::Compact);
-        pluginStateJson["stateData"]= QString(ret.toBase64());
+        for (std::size_t row = 0; row < ids.size(); ++row)
+            parameterValuesJson[QString::number(ids[row])] = values[row];
 
-        return pluginStateJson;
-    }
+        m_stateBlobCache = QJsonDocument(parameterValuesJson).toJson(QJsonDocument::Compact);
+        m_stateBlobCacheVersion = m_stateVersion;
 
-    QFile file;
-    QBuffer fileBuffer(&file);
-    fileBuffer.open(QIODevice::WriteOnly);
+        return m_stateBlobCache;
+    }
 
-    const clap_ostream pluginStateStream{ &fileBuffer, [](const clap_ostream* stream, const void* buffer, const uint64_t size) -> int64_t
+    QByteArray stateData;
+    const clap_ostream pluginStateStream{ &stateData, [](const clap_ostream* stream, const void* buffer, const uint64_t size) -> int64_t
     {
-        auto& stateBuffer = *static_cast<QBuffer*>(stream->ctx);
-        auto* stateData = static_cast<const char*>(buffer);
+        auto& stateBuffer = *static_cast<QByteArray*>(stream->ctx);
+        stateBuffer.append(static_cast<const char*>(buffer), static_cast<qsizetype>(size));
 
-        return stateBuffer.write(stateData, static_cast<long long>(size));
+        return static_cast<int64_t>(size);
     }};
 
     if (!m_plugin->stateSave(&pluginStateStream))
+    {
         qWarning() << "Failed to copy plugin state to buffer!";
+        return stateData;
+    }
+
+    // Values still on their way to the plugin aren't in what it saved; the model has them
+    // already, so nothing would change the version once they're in
+    if (!hasQueuedParamValues())
+    {
+        m_stateBlobCache = stateData;
+        m_stateBlobCacheVersion = m_stateVersion;
+    }
+
+    return stateData;
+}
+
+QJsonObject PluginHost::getState() const
+{
+    // Saved the way it was restored, byte for byte, without ever loading it
+    if (isPlaceholder())
+    {
+        auto placeholderState = m_pendingState;
+        placeholderState.remove("stateBlob");
+        placeholderState["isBypassed"] = status.load().isBypassed;
+
+        if (auto* sessionWriter = AudioEngine::instance()->sessionWriter())
+            placeholderState["stateBlob"] = sessionWriter->addBlob(pendingBlob().toByteArray());
+        else
+            placeholderState["stateData"] = QString(pendingBlob().toByteArray().toBase64());
+
+        return placeholderState;
+    }
+
+    QJsonObject pluginStateJson;
+    pluginStateJson["type"] = "PluginHost";
+    pluginStateJson["name"] = name();
+    pluginStateJson["isBypassed"] = status.load().isBypassed;
+    pluginStateJson["path"] = path();
+    pluginStateJson["index"] = static_cast<int>(index());
 
-    pluginStateJson["stateData"] = QString(fileBuffer.data().toBase64());
+    // A binary session keeps the state as is, next to the graph; JSON needs it as text
+    if (auto* sessionWriter = AudioEngine::instance()->sessionWriter())
+        pluginStateJson["stateBlob"] = sessionWriter->addBlob(saveStateBlob());
+    else
+        pluginStateJson["stateData"] = QString(saveStateBlob().toBase64());
+
+    if (const auto midiMappings = AudioEngine::instance()->midiMapping()->bindingsToJson(*this); !midiMappings.isEmpty())
+        pluginStateJson["midiMappings"] = midiMappings;
 
     return pluginStateJson;
 }
@@ -609,18 +853,154 @@ void PluginHost::loadState(const QJsonObject& stateToLoad)
     if (stateToLoad.isEmpty())
         return;
 
+    auto* sessionLoader = AudioEngine::instance()->sessionLoader();
+    if (sessionLoader->isBuildingGraph())
+    {
+        // Stays a placeholder until the loader, or whatever needs the plugin, gets to it
+        const auto pluginPath = stateToLoad["path"].toString();
+        m_pluginPath = pluginPath.startsWith("file://")? pluginPath.mid(7) : pluginPath;
+        m_index = static_cast<uint32_t>(stateToLoad["index"].toInt());
+        m_pendingState = stateToLoad;
+        setName(stateToLoad["name"].toString());
+
+        Status placeholderStatus;
+        placeholderStatus.isBypassed = stateToLoad["isBypassed"].toBool();
+        status.store(placeholderStatus);
+
+        sessionLoader->defer(*this);
+        return;
+    }
+
+    if (stateToLoad.contains("stateBlob"))
+        load(stateToLoad, sessionLoader->blob(stateToLoad["stateBlob"].toInt(-1)));
+    else
+        load(stateToLoad, QByteArray::fromBase64(stateToLoad["stateData"].toString().toUtf8()));
+}
+
+void PluginHost::loadState(const QJsonObject& stateToLoad, const QByteArrayView stateBlob)
+{
+    if (!stateToLoad.isEmpty())
+        load(stateToLoad, stateBlob);
+}
+
+void PluginHost::reportDroppedEvents()
+{
+    const auto droppedEvents = m_evIn.droppedEventCount() + m_evOut.droppedEventCount()
+        + m_paramEvents.droppedEventCount() + m_inputEvents.droppedEventCount();
+    const auto droppedPayloadBytes = m_evIn.droppedPayloadBytes() + m_evOut.droppedPayloadBytes()
+        + m_paramEvents.droppedPayloadBytes();
+
+    if (droppedEvents == m_reportedDroppedEvents && droppedPayloadBytes == m_reportedDroppedPayloadBytes)
+        return;
+
+    // Logged here rather than from the audio thread, once per activation it happened in
+    qWarning() << "PluginHost:" << m_name << "dropped" << droppedEvents - m_reportedDroppedEvents
+        << "events and" << droppedPayloadBytes - m_reportedDroppedPayloadBytes
+        << "bytes of SysEx that didn't fit in its event buffers";
+
+    m_reportedDroppedEvents = droppedEvents;
+    m_reportedDroppedPayloadBytes = droppedPayloadBytes;
+}
+
+quint64 PluginHost::newStateVersion()
+{
+    // Main thread only, like everything that changes a state
+    static quint64 lastStateVersion = 0;
+    return ++lastStateVersion;
+}
+
+void PluginHost::load(const QJsonObject& stateToLoad, const QByteArrayView stateBlob)
+{
     const auto pluginPath = stateToLoad["path"].toString();
     const auto pluginIndex = stateToLoad["index"].toInt();
-    const auto pluginStateData = stateToLoad["stateData"].toString();
 
     PluginManager::instance()->load(*this, pluginPath, pluginIndex);
-    loadPluginState(pluginStateData);
+    loadStateBlob(stateBlob);
+    AudioEngine::instance()->midiMapping()->bindingsFromJson(*this, stateToLoad["midiMappings"].toArray());
 
     Status pluginStatus;
     pluginStatus.isBypassed = stateToLoad["isBypassed"].toBool();
     status.store(pluginStatus);
 }
 
+PluginHost* PluginHost::instantiate()
+{
+    if (!isPlaceholder())
+        return this;
+
+    // Already on its way into the strip
+    if (m_instance)
+        return m_instance;
+
+    auto stateToLoad = m_pendingState;
+    stateToLoad["isBypassed"] = status.load().isBypassed;
+
+    auto* channelStrip = qobject_cast<ChannelStrip*>(parent());
+
+    // Nothing plays it yet, so it can become the plugin itself
+    if (!AudioEngine::instance()->isRunning() || !channelStrip || !channelStrip->m_nodes.contains(this))
+    {
+        const auto pendingBlob_ = std::exchange(m_pendingBlob, {});
+        load(stateToLoad, stateToLoad.contains("stateBlob")? pendingBlob() : QByteArrayView{pendingBlob_});
+
+        m_pendingState = {};
+        emit isPlaceholderChanged();
+
+        return this;
+    }
+
+    // The strip is playing, the plugin is loaded next to the placeholder and swapped in
+    // the way any plugin is replaced; until then the placeholder still saves as before
+    auto* plugin = new PluginHost{channelStrip};
+    plugin->load(stateToLoad, pendingBlob());
+
+    channelStrip->startPlugin(plugin);
+    channelStrip->replacePlugin(this, plugin, [](PluginHost* placeholder) { placeholder->deleteLater(); });
+    m_instance = plugin;
+
+    // Its snapshots were taken of the same state, they're the plugin's now
+    AudioEngine::instance()->snapshots()->transfer(this, plugin);
+
+    emit plugin->nameChanged();
+    emit plugin->hasNativeGUIChanged();
+
+    return plugin;
+}
+
+void PluginHost::detachPendingState()
+{
+    if (const auto blobIndex = m_pendingState.take("stateBlob"); !blobIndex.isUndefined())
+        m_pendingBlob = AudioEngine::instance()->sessionLoader()->blob(blobIndex.toInt(-1)).toByteArray();
+}
+
+PluginHost* PluginHost::placeholder(Node* parent) const
+{
+    auto state = getState();
+    state.remove("stateData");
+    state.remove("stateBlob");
+
+    auto* placeholder = new PluginHost(parent);
+    placeholder->m_pluginPath = m_pluginPath;
+    placeholder->m_index = m_index;
+    placeholder->m_name = m_name;
+    placeholder->m_pendingBlob = saveStateBlob();
+    placeholder->m_pendingState = state;
+
+    Status placeholderStatus;
+    placeholderStatus.isBypassed = status.load().isBypassed;
+    placeholder->status.store(placeholderStatus);
+
+    return placeholder;
+}
+
+QByteArrayView PluginHost::pendingBlob() const
+{
+    if (m_pendingState.contains("stateBlob"))
+        return AudioEngine::instance()->sessionLoader()->blob(m_pendingState["stateBlob"].toInt(-1));
+
+    return m_pendingBlob;
+}
+
 void PluginHost::beginParameterGesture(const clap_id id) const
 {
     m_parameterModel->startGesture(id);
@@ -638,6 +1018,28 @@ bool PluginHost::guiRequestResize(uint32_t, uint32_t) noexcept
     return true;
 }
 
+bool PluginHost::threadPoolRequestExec(const uint32_t numTasks) noexcept
+{
+    auto* plugin = m_audioPlugin.load(std::memory_order_acquire);
+    if (!plugin || !plugin->canUseThreadPool() || threadType != ThreadType::AudioThread)
+        return false;
+
+    AudioEngine::instance()->workerPool().execute(numTasks, [](void* context, const uint32_t taskIndex)
+    {
+        static_cast<PluginProxy*>(context)->threadPoolExec(taskIndex);
+    }, plugin);
+
+    return true;
+}
+
+void PluginHost::stateMarkDirty() noexcept
+{
+    // Saved again on the next save, the session gets autosaved with it
+    m_stateVersion = newStateVersion();
+    m_baseStateVersion = m_stateVersion;
+    markDirty();
+}
+
 // void PluginHost::guiResizeHintsChanged() noexcept {}
 // bool PluginHost::guiRequestResize(uint32_t width, uint32_t height) noexcept {}
 // bool PluginHost::guiRequestShow() noexcept {}
@@ -649,7 +1051,5 @@ bool PluginHost::guiRequestResize(uint32_t, uint32_t) noexcept
 // bool PluginHost::posixFdSupportUnregisterFd(int fd) noexcept {}
 // void PluginHost::remoteControlsChanged() noexcept {}
 // void PluginHost::remoteControlsSuggestPage(clap_id pageId) noexcept {}
-// void PluginHost::stateMarkDirty() noexcept {}
 // bool PluginHost::timerSupportRegisterTimer(uint32_t periodMs, clap_id* timerId) noexcept {}
 // bool PluginHost::timerSupportUnregisterTimer(clap_id timerId) noexcept {}
-// bool PluginHost::threadPoolRequestExec(uint32_t numTasks) noexcept {}
@@ -3,11 +3,17 @@
 #include <clap/helpers/event-list.hh>
 #include <clap/helpers/host.hh>
 #include <clap/helpers/plugin-proxy.hh>
-#include <clap/helpers/reducing-param-queue.hh>
+#include <QByteArray>
+#include <QByteArrayView>
 #include <QJsonObject>
+#include <QPointer>
 #include <QQuickWindow>
 #include "Node.h"
 #include "ParameterModel.h"
+#include "Utils/EventMerger.h"
+#include "Utils/EventRouting.h"
+#include "Utils/ParamValueFeedback.h"
+#include "Utils/ParamValueQueue.h"
 
 
 class PluginQuickView;
@@ -40,6 +46,7 @@ class PluginHost final : public Node, public BaseHost
     Q_PROPERTY(QSize guiSize READ guiSize NOTIFY guiSizeChanged)
     Q_PROPERTY(bool isFloatingWindowOpen READ isFloatingWindowOpen WRITE setIsFloatingWindowOpen NOTIFY isFloatingWindowOpenChanged)
     Q_PROPERTY(PluginQuickView* floatingWindow READ floatingWindow NOTIFY floatingWindowChanged)
+    Q_PROPERTY(bool isPlaceholder READ isPlaceholder NOTIFY isPlaceholderChanged)
 
 
   public:
@@ -57,11 +64,16 @@ class PluginHost final : public Node, public BaseHost
 
     [[nodiscard]] uint32_t parameterCount() const;
 
+    // Rough resident memory growth measured while creating and activating the plugin
+    [[nodiscard]] std::size_t estimatedFootprint() const noexcept { return m_footprint + m_activationFootprint; }
+
     [[nodiscard]] ParameterModel* parameters() const
     {
         return m_parameterModel.get();
     }
 
+    [[nodiscard]] ParamValueFeedback* paramValueFeedback() const { return m_paramFeedback.get(); }
+
     [[nodiscard]] QSize guiSize() const;
     [[nodiscard]] PluginQuickView* floatingWindow() const { return m_floatingWindow; }
     void setFloatingWindow(PluginQuickView* window);
@@ -81,19 +93,63 @@ class PluginHost final : public Node, public BaseHost
     void stopProcessing() override;
 
 
-    void setParamValue(clap_id id, double newValue);
+    // Main thread; row is the parameter's index in the ParameterModel
+    void setParamValue(uint32_t row, clap_id id, double newValue);
 
     void processNoteOn(int sampleOffset, int channel, int key, int velocity);
     void processNoteOff(int sampleOffset, int channel, int key, int velocity);
-    void processNoteRawMidi(int sampleOffset, const std::vector<unsigned char>& data) override;
-    void outputRawMidi(int sampleOffset, const std::vector<unsigned char>& data);
+    // audio thread, a value from a mapped MIDI controller
+    void processParamValue(int sampleOffset, clap_id id, double value);
+    void processNoteRawMidi(int sampleOffset, int port, std::span<const unsigned char> data) override;
     void process() override;
 
+    // A plugin restored from a session but not loaded yet: it only holds its saved
+    // state, until the engine is about to process it, its GUI is opened or it's unbypassed
+    [[nodiscard]] bool isPlaceholder() const { return !m_pendingState.isEmpty(); }
+
+    // Copies the placeholder's state blob out of the session being loaded, for it to
+    // stay a placeholder after the load is done
+    void detachPendingState();
+
+    // A placeholder for the plugin as it is now, to stand in for it while it isn't needed
+    [[nodiscard]] PluginHost* placeholder(Node* parent) const;
+
+    // What the plugin saves of itself, or its parameter values when it can't; saving
+    // hands back what it saved last time until the plugin says its state changed
+    void loadStateBlob(QByteArrayView stateData);
+    [[nodiscard]] QByteArray saveStateBlob() const;
+
+    // Loads a state blob kept outside the node JSON, e.g. from the StateStore
+    void loadState(const QJsonObject& stateToLoad, QByteArrayView stateBlob);
+
+    // Changes whenever the state does, parameter values included; what saveStateBlob()
+    // hands back is good for as long as this stays the same
+    [[nodiscard]] quint64 stateVersion() const { return m_stateVersion; }
+
+    // Changes only when the state changes other than through parameter values: a state
+    // gets loaded or the plugin says it's dirty. Two states of the same base version
+    // differ in parameter values at most
+    [[nodiscard]] quint64 baseStateVersion() const { return m_baseStateVersion; }
+    // For a state known to be one seen before, one loaded back from a snapshot say
+    void setBaseStateVersion(quint64 version) { m_baseStateVersion = version; }
+
+    // Whether parameter values set from the GUI thread still wait for the audio thread
+    [[nodiscard]] bool hasQueuedParamValues() const;
+
+    // In samples, what the plugin reports while activated; 0 for a placeholder
+    [[nodiscard]] std::uint32_t latency() const;
+
     [[nodiscard]] bool threadCheckIsMainThread() const noexcept override;
     [[nodiscard]] bool threadCheckIsAudioThread() const noexcept override;
+    // For the calling thread, one that processes plugins other than the engine's own
+    static void markAudioThread();
 
 
   public slots:
+    // Loads the plugin a placeholder stands for. While the engine runs that's a new
+    // PluginHost swapped in for the placeholder, which is what's returned
+    PluginHost* instantiate();
+
     bool hasWindow(const QQuickWindow* window) const;
     void createGuiWindow(QQuickWindow* parentWindow);
     void setParentWindow(QQuickWindow* parentWindow);
@@ -114,6 +170,7 @@ class PluginHost final : public Node, public BaseHost
     void guiSizeChanged();
     void isFloatingWindowOpenChanged();
     void floatingWindowChanged();
+    void isPlaceholderChanged();
 
 
   private slots:
@@ -124,30 +181,69 @@ class PluginHost final : public Node, public BaseHost
   private:
     friend class PluginManager;
 
+    void load(const QJsonObject& stateToLoad, QByteArrayView stateBlob);
+    [[nodiscard]] QByteArrayView pendingBlob() const;
+    [[nodiscard]] static quint64 newStateVersion();
+    // Main thread, what didn't fit in the event buffers since it was last reported
+    void reportDroppedEvents();
+
     int32_t m_sampleRate = 48000;
     double m_sampleStep = 0.0;
     uint32_t m_index = 0;
     QString m_pluginPath;
+    // What a placeholder is to be loaded with; the blob is in the session loader's
+    // while the state still has a "stateBlob" index, in m_pendingBlob after that
+    QJsonObject m_pendingState;
+    QByteArray m_pendingBlob;
+    QPointer<PluginHost> m_instance;
+    // The last saved state and the version it was saved at
+    mutable QByteArray m_stateBlobCache;
+    mutable quint64 m_stateBlobCacheVersion = 0;
+    quint64 m_stateVersion = newStateVersion();
+    quint64 m_baseStateVersion = m_stateVersion;
     std::filesystem::path m_pluginPathAsPath;
+    std::filesystem::file_time_type m_binaryLastWrite;
+    std::size_t m_footprint = 0;
+    std::size_t m_activationFootprint = 0;
+    // Instances unloaded but not torn down yet; they still call us as their clap_host
+    int m_retiredInstanceCount = 0;
+    // Totals over the event buffers, as far as reportDroppedEvents() got
+    std::uint64_t m_reportedDroppedEvents = 0;
+    std::uint64_t m_reportedDroppedPayloadBytes = 0;
 
     bool m_isProcessing = false;
     bool m_isNativeGuiOpen = false;
     PluginQuickView* m_floatingWindow = nullptr;
 
     std::unique_ptr<PluginProxy> m_plugin;
+    // What the audio thread processes; cleared before m_plugin is handed to the reclaimer
+    std::atomic<PluginProxy*> m_audioPlugin = nullptr;
 
     QQuickWindow* m_parentWindow = nullptr;
     std::unique_ptr<ParameterModel> m_parameterModel;
 
+    // Parameter changes from the GUI, handed to the plugin at the start of the next block
+    std::unique_ptr<ParamValueQueue> m_paramQueue;
+    std::atomic<ParamValueQueue*> m_audioParamQueue = nullptr;
+    bool m_isParamFlushPending = false;
+
+    // And the values the plugin reports back, collected by the ParameterModel
+    std::unique_ptr<ParamValueFeedback> m_paramFeedback;
+    std::atomic<ParamValueFeedback*> m_audioParamFeedback = nullptr;
+
+    // m_evIn, the drained parameter queue and what comes from upstream, merged in time order
+    EventArena m_paramEvents;
+    ForwardedEventView m_forwardedEvents;
+    EventMerger m_inputEvents;
+
+    // Scratch for buildMidiEvent(), audio thread only
+    clap_event_midi m_midiEvent = {};
+    clap_event_midi_sysex m_midiSysexEvent = {};
+
     clap_audio_buffer m_audioIn = {};
     clap_audio_buffer m_audioOut = {};
     int32_t m_blockSize = 0;
 
-    double samplesPerBeat = 60.0 / 120.0;
-
-    uint64_t current_sample = 0;
-    double song_pos_beats = 0.0;
-
 
     void requestRestart() noexcept override {};
     void requestProcess() noexcept override {};
@@ -159,10 +255,24 @@ class PluginHost final : public Node, public BaseHost
 
 
     bool implementsParams() const noexcept override { return true; }
-    void paramsRescan(clap_param_rescan_flags /*flags*/) noexcept override {};
+    void paramsRescan(clap_param_rescan_flags flags) noexcept override;
     void paramsClear(clap_id /*paramId*/, clap_param_clear_flags /*flags*/) noexcept override {};
     void paramsRequestFlush() noexcept override {};
 
+    // A blockStartTime of 0 puts every value at the start of the block
+    void pushQueuedParamValues(ParamValueQueue& queue, EventArena& events,
+        std::int64_t blockStartTime) const;
+    void flushParamsIfIdle();
+
+    // Short messages as CLAP_EVENT_MIDI, SysEx as CLAP_EVENT_MIDI_SYSEX; nullptr if it's neither
+    const clap_event_header* buildMidiEvent(int sampleOffset, std::span<const unsigned char> data);
+
+    // Sizes the queue and feedback buffers to the ParameterModel's rows
+    void rebuildParamBuffers();
+
+    // Whether any of its input or output note ports speaks MIDI, the only way SysEx gets in or out
+    [[nodiscard]] bool hasMidiNotePort(bool isInput) const;
+
     // clap_host
     // void requestRestart() noexcept override;
     // void requestProcess() noexcept override;
@@ -199,7 +309,7 @@ class PluginHost final : public Node, public BaseHost
 
     // // clap_host_state
     bool implementsState() const noexcept override { return true; }
-    // void stateMarkDirty() noexcept override;
+    void stateMarkDirty() noexcept override;
 
     // // clap_host_timer_support
     // bool implementsTimerSupport() const noexcept override { return true; }
@@ -211,6 +321,6 @@ class PluginHost final : public Node, public BaseHost
     // // bool threadCheckIsAudioThread() const noexcept override;
 
     // // clap_host_thread_pool
-    // bool implementsThreadPool() const noexcept override { return true; }
-    // bool threadPoolRequestExec(uint32_t numTasks) noexcept override;
+    bool implementsThreadPool() const noexcept override { return true; }
+    bool threadPoolRequestExec(uint32_t numTasks) noexcept override;
 };
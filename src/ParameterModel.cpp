@@ -9,17 +9,15 @@ ParameterModel::ParameterModel(PluginHost& plugin, PluginProxy& pluginProxy, QOb
     , m_plugin{plugin}
     , m_pluginProxy{pluginProxy}
 {
-    if (!m_pluginProxy.canUseParams())
-        return;
-
-    for (auto i = 0u; i < m_pluginProxy.paramsCount(); ++i)
-    {
-        clap_param_info info{};
-        m_pluginProxy.paramsGetInfo(i, &info);
-
-        m_values.push_back({info.id, info.default_value});
-        m_plugin.setParamValue(info.id, info.default_value);
-    }
+    readInfo();
+    readValues();
+
+    // About once per frame, however often the plugin reports, and only while the engine
+    // runs; nothing reports from the audio thread otherwise
+    m_engineValuesTimer.setInterval(16);
+    connect(&m_engineValuesTimer, &QTimer::timeout, this, &ParameterModel::collectEngineValues);
+    connect(AudioEngine::instance(), &AudioEngine::isRunningChanged, this, &ParameterModel::updateEngineValuesTimer);
+    updateEngineValuesTimer();
 }
 
 QHash<int, QByteArray> ParameterModel::roleNames() const
@@ -49,10 +47,7 @@ int ParameterModel::rowCount(const QModelIndex&) const
     if (m_plugin.status.load().status == S::OnError)
         return 0;
 
-    if (!m_pluginProxy.canUseParams())
-        return 0;
-
-    return static_cast<int>(m_pluginProxy.paramsCount());
+    return static_cast<int>(m_ids.size());
 }
 
 int ParameterModel::columnCount(const QModelIndex&) const
@@ -62,123 +57,240 @@ int ParameterModel::columnCount(const QModelIndex&) const
 
 QVariant ParameterModel::data(const QModelIndex& index, int role) const
 {
-    switch (role)
-    {
-        case IdRole:    return m_values[index.row()].id;
-        case ValueRole: return m_values[index.row()].value;
-        default: break;
-    }
-
-    clap_param_info info{};
-    m_pluginProxy.paramsGetInfo(index.row(), &info);
+    const auto row = static_cast<std::size_t>(index.row());
+    if (!index.isValid() || row >= m_ids.size())
+        return {};
 
     switch (role)
     {
-        case NameRole:      return QString{info.name};
-        case MinRole:       return info.min_value;
-        case MaxRole:       return info.max_value;
-        case ReadOnlyRole:  return (info.flags & CLAP_PARAM_IS_READONLY) != 0;
-        case SteppedRole:   return (info.flags & CLAP_PARAM_IS_STEPPED) != 0;
+        case IdRole:        return m_ids[row];
+        case NameRole:      return m_names[row];
+        case MinRole:       return m_minValues[row];
+        case MaxRole:       return m_maxValues[row];
+        case ReadOnlyRole:  return (m_flags[row] & CLAP_PARAM_IS_READONLY) != 0;
+        case SteppedRole:   return (m_flags[row] & CLAP_PARAM_IS_STEPPED) != 0;
+        case ValueRole:     return m_values[row];
         default: return {};
     }
 }
 
 bool ParameterModel::setData(const QModelIndex& index, const QVariant& value, int role)
 {
-    if (!index.isValid() || role != ValueRole)
+    if (!index.isValid() || role != ValueRole || static_cast<std::size_t>(index.row()) >= m_ids.size())
         return false;
 
-    auto& parameter = m_values[index.row()];
+    auto& parameterValue = m_values[index.row()];
 
     const auto newValue = value.toDouble();
 
-    if (qFuzzyCompare(parameter.value, newValue))
+    if (qFuzzyCompare(parameterValue, newValue))
         return false;
 
-    m_plugin.setParamValue(parameter.id, newValue);
-    parameter.value = newValue;
+    m_plugin.setParamValue(index.row(), m_ids[index.row()], newValue);
+    parameterValue = newValue;
 
     emit dataChanged(index, index, {ValueRole});
+    m_plugin.markDirty();
 
     return true;
 }
 
+int ParameterModel::rowOf(const clap_id id) const
+{
+    const auto it = m_rows.find(id);
+    return it != m_rows.end()? it->second : -1;
+}
+
+void ParameterModel::rescan(const clap_param_rescan_flags flags)
+{
+    if (flags & CLAP_PARAM_RESCAN_ALL)
+    {
+        beginResetModel();
+        readInfo();
+        readValues();
+        endResetModel();
+
+        return;
+    }
+
+    if (flags & CLAP_PARAM_RESCAN_INFO)
+        readInfo();
+
+    if (flags & CLAP_PARAM_RESCAN_VALUES)
+        readValues();
+
+    if (m_ids.empty())
+        return;
+
+    // Text changes too, it's not a role but whoever shows it asks again on dataChanged
+    emit dataChanged(createIndex(0, 0), createIndex(static_cast<int>(m_ids.size()) - 1, 0));
+}
+
 void ParameterModel::startGesture(const clap_id id)
 {
-    m_gestureInitialValue = getFromId(id).value;
+    if (const auto row = rowOf(id); row >= 0)
+        m_gestureInitialValue = m_values[row];
 }
 
 void ParameterModel::stopGesture(const clap_id id)
 {
-    const auto&[_, value] = getFromId(id);
+    // The final value may have been published after the timer last fired
+    collectEngineValues();
+
+    const auto row = rowOf(id);
+    if (row < 0)
+        return;
+
+    const auto value = m_values[row];
     if (qFuzzyCompare(m_gestureInitialValue, value))
         return;
 
+    // The user moved it in the plugin's own window; values the plugin changes on its own
+    // (automation, meters) don't make the session unsaved
+    m_plugin.markDirty();
     AudioEngine::instance()->undoStack().push(
         new ChangeParameterValueCommand(*this, id, m_gestureInitialValue, value));
 }
 
 void ParameterModel::setValue(const clap_id id, const double newValue)
 {
-    for (size_t i = 0; i < m_values.size(); ++i)
-    {
-        auto& parameter = m_values[i];
-        if (parameter.id != id)
-            continue;
-
-        if (qFuzzyCompare(parameter.value, newValue))
-            return;
-
-        m_plugin.setParamValue(parameter.id, newValue);
-        parameter.value = newValue;
-
-        auto index = createIndex(static_cast<int>(i), 0);
-        emit dataChanged(index, index, {ValueRole});
-    }
+    if (const auto row = rowOf(id); row >= 0)
+        setValue(row, id, newValue);
 }
 
 void ParameterModel::setValue(const int row, clap_id, const double newValue)
 {
-    auto&[id, value] = m_values[row];
+    if (row < 0 || static_cast<std::size_t>(row) >= m_ids.size())
+        return;
+
+    auto& value = m_values[row];
 
     if (qFuzzyCompare(value, newValue))
         return;
 
-    m_plugin.setParamValue(id, newValue);
+    m_plugin.setParamValue(row, m_ids[row], newValue);
     value = newValue;
 
     const auto index = createIndex(row, 0);
     emit dataChanged(index, index, {ValueRole});
+    m_plugin.markDirty();
 }
 
 void ParameterModel::setValueFromEngine(const clap_id id, const double newValue)
 {
-    for (size_t i = 0; i < m_values.size(); ++i)
+    const auto row = rowOf(id);
+    if (row < 0 || qFuzzyCompare(m_values[row], newValue))
+        return;
+
+    m_values[row] = newValue;
+
+    const auto index = createIndex(row, 0);
+    emit dataChanged(index, index, {ValueRole});
+}
+
+void ParameterModel::updateEngineValuesTimer()
+{
+    if (AudioEngine::instance()->isRunning())
     {
-        auto&[parameterId, parameterValue] = m_values[i];
-        if (parameterId != id)
-            continue;
+        m_engineValuesTimer.start();
+        return;
+    }
 
-        if (qFuzzyCompare(parameterValue, newValue))
+    m_engineValuesTimer.stop();
+    // What the last blocks reported
+    collectEngineValues();
+}
+
+void ParameterModel::collectEngineValues()
+{
+    auto* feedback = m_plugin.paramValueFeedback();
+    if (!feedback)
+        return;
+
+    int firstChangedRow = -1;
+    int lastChangedRow = -1;
+
+    const auto emitChangedRange = [this, &firstChangedRow, &lastChangedRow]()
+    {
+        if (firstChangedRow < 0)
             return;
 
-        parameterValue = newValue;
+        emit dataChanged(createIndex(firstChangedRow, 0), createIndex(lastChangedRow, 0), {ValueRole});
+        firstChangedRow = -1;
+    };
 
-        auto index = createIndex(static_cast<int>(i), 0);
-        emit dataChanged(index, index, {ValueRole});
-    }
+    feedback->collect([this, &firstChangedRow, &lastChangedRow, &emitChangedRange](const uint32_t row, const double value)
+    {
+        if (row >= m_values.size() || qFuzzyCompare(m_values[row], value))
+            return;
+
+        m_values[row] = value;
+
+        const auto changedRow = static_cast<int>(row);
+        if (firstChangedRow >= 0 && changedRow != lastChangedRow + 1)
+            emitChangedRange();
+
+        if (firstChangedRow < 0)
+            firstChangedRow = changedRow;
+
+        lastChangedRow = changedRow;
+    });
+
+    emitChangedRange();
 }
 
-// REMOVE ME???
-Parameter& ParameterModel::getFromId(const clap_id id)
+void ParameterModel::readInfo()
 {
-    for (auto& parameter : m_values)
+    m_ids.clear();
+    m_names.clear();
+    m_minValues.clear();
+    m_maxValues.clear();
+    m_defaultValues.clear();
+    m_flags.clear();
+    m_rows.clear();
+
+    if (!m_pluginProxy.canUseParams())
     {
-        if (parameter.id == id)
-            return parameter;
+        m_values.clear();
+        return;
     }
 
-    return m_values.front();
+    const auto count = m_pluginProxy.paramsCount();
+
+    m_ids.reserve(count);
+    m_names.reserve(count);
+    m_minValues.reserve(count);
+    m_maxValues.reserve(count);
+    m_defaultValues.reserve(count);
+    m_flags.reserve(count);
+    m_rows.reserve(count);
+
+    for (auto i = 0u; i < count; ++i)
+    {
+        clap_param_info info{};
+        if (!m_pluginProxy.paramsGetInfo(i, &info))
+            info.id = CLAP_INVALID_ID;
+
+        m_rows.emplace(info.id, static_cast<int>(i));
+        m_ids.push_back(info.id);
+        m_names.push_back(QString{info.name});
+        m_minValues.push_back(info.min_value);
+        m_maxValues.push_back(info.max_value);
+        m_defaultValues.push_back(info.default_value);
+        m_flags.push_back(info.flags);
+    }
+
+    m_values.resize(count);
+}
+
+void ParameterModel::readValues()
+{
+    // What the plugin has right now, which after loading a state isn't the default
+    for (std::size_t row = 0; row < m_ids.size(); ++row)
+    {
+        if (!m_pluginProxy.paramsGetValue(m_ids[row], &m_values[row]))
+            m_values[row] = m_defaultValues[row];
+    }
 }
 
 QString ParameterModel::getTextValue(const clap_id id, const double value) const
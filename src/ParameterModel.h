@@ -1,7 +1,9 @@
 #pragma once
+#include <unordered_map>
 #include <clap/id.h>
 #include <clap/helpers/plugin-proxy.hh>
 #include <QAbstractItemModel>
+#include <QTimer>
 
 
 class PluginHost;
@@ -13,12 +15,6 @@ using PluginProxy = clap::helpers::PluginProxy<PluginHost_MH, PluginHost_CL>;
 extern template class clap::helpers::PluginProxy<PluginHost_MH, PluginHost_CL>;
 
 
-struct Parameter
-{
-    clap_id id;
-    double value;
-};
-
 class ParameterModel final : public QAbstractListModel
 {
     Q_OBJECT
@@ -40,7 +36,17 @@ class ParameterModel final : public QAbstractListModel
 
     [[nodiscard]] QHash<int, QByteArray> roleNames() const override;
 
-    [[nodiscard]] const std::vector<Parameter>& getValues() const { return m_values; };
+    [[nodiscard]] const std::vector<clap_id>& ids() const { return m_ids; }
+    [[nodiscard]] const std::vector<double>& values() const { return m_values; }
+    [[nodiscard]] const std::vector<double>& minValues() const { return m_minValues; }
+    [[nodiscard]] const std::vector<double>& maxValues() const { return m_maxValues; }
+    [[nodiscard]] const std::vector<clap_param_info_flags>& infoFlags() const { return m_flags; }
+
+    // -1 if there's no parameter with that id
+    [[nodiscard]] int rowOf(clap_id id) const;
+
+    // clap_host_params::rescan(), main thread
+    void rescan(clap_param_rescan_flags flags);
 
 
   public slots:
@@ -59,14 +65,29 @@ class ParameterModel final : public QAbstractListModel
     void setValue(int row, clap_id id, double newValue);
     void setValueFromEngine(clap_id id, double newValue);
 
+    // Picks up what the plugin reported from the audio thread since the last call
+    void collectEngineValues();
+
 
   private:
     friend class ChangeParameterValueCommand;
     PluginHost& m_plugin;
     PluginProxy& m_pluginProxy;
 
-    std::vector<Parameter> m_values;
+    // What the plugin tells us about its parameters, one entry per row in each
+    std::vector<clap_id> m_ids;
+    std::vector<QString> m_names;
+    std::vector<double> m_minValues;
+    std::vector<double> m_maxValues;
+    std::vector<double> m_defaultValues;
+    std::vector<clap_param_info_flags> m_flags;
+    std::vector<double> m_values;
+    std::unordered_map<clap_id, int> m_rows;
+
     double m_gestureInitialValue = 0.0;
+    QTimer m_engineValuesTimer;
 
-    Parameter& getFromId(clap_id id);
+    void readInfo();
+    void readValues();
+    void updateEngineValuesTimer();
 };
@@ -0,0 +1,132 @@
+#include "PluginHostPool.h"
+#include <algorithm>
+#include "AudioEngine.h"
+#include "PluginManager.h"
+#include "Nodes/PluginHost.h"
+#include "Utils/EpochReclaimer.h"
+
+
+namespace
+{
+
+// Plugins that allocate lazily can show almost no growth at load time
+constexpr std::size_t minimumFootprint = 1024 * 1024;
+
+// Without waiting on the audio thread for each one: the instance is torn down with the
+// reclaimer's next collect, and the host right after it, with nothing left to wait for
+void release(PluginHost* plugin)
+{
+    PluginManager::instance()->unload(*plugin);
+    EpochReclaimer::instance()->retire([plugin]() { delete plugin; });
+}
+
+}
+
+
+PluginHostPool::PluginHostPool() = default;
+
+PluginHostPool::~PluginHostPool()
+{
+    clear();
+}
+
+quint64 PluginHostPool::park(PluginHost* plugin)
+{
+    if (!plugin)
+        return 0;
+
+    plugin->setIsFloatingWindowOpen(false);
+    plugin->destroyGuiWindow();
+    plugin->deactivate();
+    plugin->setParent(nullptr);
+    AudioEngine::instance()->midiMapping()->suspendBindings(*plugin);
+
+    const Entry entry{m_nextTicket++, plugin, std::max(plugin->estimatedFootprint(), minimumFootprint)};
+    m_entries.push_front(entry);
+    m_memoryUsed += entry.footprint;
+
+    evict();
+
+    return entry.ticket;
+}
+
+PluginHost* PluginHostPool::take(const quint64 ticket)
+{
+    const auto entry = std::ranges::find(m_entries, ticket, &Entry::ticket);
+    if (entry == m_entries.end())
+        return nullptr;
+
+    return take(entry);
+}
+
+PluginHost* PluginHostPool::take(const QString& path, const uint32_t index)
+{
+    const auto entry = std::ranges::find_if(m_entries, [&path, index](const Entry& e)
+    {
+        return e.plugin->path() == path && e.plugin->index() == index;
+    });
+
+    if (entry == m_entries.end())
+        return nullptr;
+
+    return take(entry);
+}
+
+PluginHost* PluginHostPool::take(const std::list<Entry>::iterator entry)
+{
+    auto* plugin = entry->plugin;
+    m_memoryUsed -= entry->footprint;
+    m_entries.erase(entry);
+
+    AudioEngine::instance()->midiMapping()->resumeBindings(*plugin);
+
+    return plugin;
+}
+
+void PluginHostPool::discard(const QString& path)
+{
+    for (auto it = m_entries.begin(); it != m_entries.end();)
+    {
+        if (it->plugin->path() != path)
+        {
+            ++it;
+            continue;
+        }
+
+        m_memoryUsed -= it->footprint;
+        release(it->plugin);
+        it = m_entries.erase(it);
+    }
+}
+
+void PluginHostPool::clear()
+{
+    for (const auto& entry : m_entries)
+        release(entry.plugin);
+
+    m_entries.clear();
+    m_memoryUsed = 0;
+}
+
+void PluginHostPool::setMaxCount(const std::size_t newMaxCount)
+{
+    m_maxCount = newMaxCount;
+    evict();
+}
+
+void PluginHostPool::setMemoryBudget(const std::size_t newMemoryBudget)
+{
+    m_memoryBudget = newMemoryBudget;
+    evict();
+}
+
+void PluginHostPool::evict()
+{
+    while (!m_entries.empty() && (m_entries.size() > m_maxCount || m_memoryUsed > m_memoryBudget))
+    {
+        const auto& lru = m_entries.back();
+        m_memoryUsed -= lru.footprint;
+        release(lru.plugin);
+        m_entries.pop_back();
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <list>
+#include <QString>
+
+
+class PluginHost;
+
+
+// Keeps recently removed plugins initialised (but deactivated) so that undoing a
+// removal, or going back to a plugin just swapped out in the browser, doesn't pay
+// for create_plugin + init + state load again.
+class PluginHostPool
+{
+  public:
+    PluginHostPool();
+    ~PluginHostPool();
+    PluginHostPool(PluginHostPool&) = delete;
+    PluginHostPool(PluginHostPool&&) = delete;
+    PluginHostPool(const PluginHostPool&) = delete;
+    PluginHostPool(const PluginHostPool&&) = delete;
+
+    // Takes ownership, returns a ticket that can be used to get this exact instance back
+    quint64 park(PluginHost* plugin);
+
+    [[nodiscard]] PluginHost* take(quint64 ticket);
+    [[nodiscard]] PluginHost* take(const QString& path, uint32_t index);
+
+    void discard(const QString& path);
+    void clear();
+
+    [[nodiscard]] std::size_t maxCount() const { return m_maxCount; }
+    void setMaxCount(std::size_t newMaxCount);
+
+    [[nodiscard]] std::size_t memoryBudget() const { return m_memoryBudget; }
+    void setMemoryBudget(std::size_t newMemoryBudget);
+
+    [[nodiscard]] std::size_t memoryUsed() const { return m_memoryUsed; }
+
+
+  private:
+    struct Entry
+    {
+        quint64 ticket = 0;
+        PluginHost* plugin = nullptr;
+        std::size_t footprint = 0;
+    };
+
+    // Most recently parked first
+    std::list<Entry> m_entries;
+
+    quint64 m_nextTicket = 1;
+    std::size_t m_maxCount = 8;
+    std::size_t m_memoryBudget = 512ull * 1024 * 1024;
+    std::size_t m_memoryUsed = 0;
+
+    PluginHost* take(std::list<Entry>::iterator entry);
+    void evict();
+};
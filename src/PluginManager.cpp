@@ -1,13 +1,31 @@
 #include "PluginManager.h"
+#include <cmath>
 #include "Nodes/PluginHost.h"
 #include "PluginLibrary.h"
+#include "Utils.h"
+#include <QDateTime>
+#include <QDir>
+#include <QPointer>
 #include <QSettings>
-#include <QTimer>
+#include "Utils/EpochReclaimer.h"
 
 
 namespace
 {
 constexpr auto* pathsToScanKey = "PluginBrowser/pathsToScan";
+constexpr auto* hostPoolMaxCountKey = "PluginPool/maxCount";
+constexpr auto* hostPoolMemoryBudgetKey = "PluginPool/memoryBudgetMB";
+constexpr auto* preloadBudgetKey = "PluginPreloader/budget";
+constexpr auto* libraryUsageKey = "PluginPreloader/usage";
+
+// Frequency counts, but a plugin used a lot a month ago matters less than one used today
+double usageScore(const int count, const qint64 lastUsed, const qint64 now)
+{
+    constexpr double halfLifeInSeconds = 7.0 * 24.0 * 60.0 * 60.0;
+    const auto age = static_cast<double>(now - lastUsed);
+
+    return count * std::exp2(-age / halfLifeInSeconds);
+}
 
 void addClapsFromDirectory(std::filesystem::path& path, std::vector<std::filesystem::path>& claps)
 {
@@ -78,6 +96,18 @@ QString validatePathsToScan(const QString& paths)
     return pathsList.join(';');
 }
 
+std::filesystem::file_time_type binaryLastWriteTime(const std::filesystem::path& path)
+{
+    auto binaryPath = ocp::findBinaryInAppBundle(path);
+    if (binaryPath.empty())
+        binaryPath = path;
+
+    std::error_code error;
+    const auto lastWriteTime = std::filesystem::last_write_time(binaryPath, error);
+
+    return error ? std::filesystem::file_time_type{} : lastWriteTime;
+}
+
 PluginInfo pluginInfoFromDescriptor(const std::filesystem::path& path, int index,
                                     const clap_plugin_descriptor& descriptor)
 {
@@ -126,15 +156,42 @@ PluginManager::PluginManager()
     : QObject{nullptr}
     , m_settings{std::make_unique<QSettings>("witte", "ClapWorkbench")}
     , m_pathsToScan{m_settings->value(pathsToScanKey, QString{}).toString()}
-{}
+{
+    m_hostPool.setMaxCount(m_settings->value(hostPoolMaxCountKey, 8).toUInt());
+    m_hostPool.setMemoryBudget(m_settings->value(hostPoolMemoryBudgetKey, 512).toULongLong() * 1024 * 1024);
+    m_preloader.setBudget(m_settings->value(preloadBudgetKey, 4).toUInt());
+
+    // Leftovers from a previous run are never in use
+    m_shadowCopiesPath = std::filesystem::path{QDir::tempPath().toStdString()} / "ClapWorkbench" / "shadow-copies";
+    std::error_code error;
+    std::filesystem::remove_all(m_shadowCopiesPath, error);
+
+    const auto usage = m_settings->value(libraryUsageKey).toMap();
+    for (auto it = usage.cbegin(); it != usage.cend(); ++it)
+    {
+        const auto countAndLastUsed = it.value().toList();
+        if (countAndLastUsed.size() != 2)
+            continue;
+
+        m_libraryUsage[it.key()] = {countAndLastUsed[0].toInt(), countAndLastUsed[1].toLongLong()};
+    }
+}
 
 PluginManager::~PluginManager()
 {
     m_settings->setValue(pathsToScanKey, m_pathsToScan);
+    m_settings->setValue(preloadBudgetKey, static_cast<int>(m_preloader.budget()));
+
+    QVariantMap usage;
+    for (auto it = m_libraryUsage.cbegin(); it != m_libraryUsage.cend(); ++it)
+        usage[it.key()] = QVariantList{it->count, it->lastUsed};
+
+    m_settings->setValue(libraryUsageKey, usage);
 }
 
 
-bool PluginManager::load(PluginHost& caller, const QString& path, const uint32_t pluginIndex)
+bool PluginManager::load(PluginHost& caller, const QString& path, const uint32_t pluginIndex,
+    const std::filesystem::path& libraryPath)
 {
     qDebug() << "PluginManager::load:" << path;
 
@@ -145,31 +202,39 @@ bool PluginManager::load(PluginHost& caller, const QString& path, const uint32_t
 
     caller.m_pluginPath = path.startsWith("file://")? path.mid(7) : path;
 
-    const std::filesystem::path pluginPath = caller.m_pluginPath.toStdString();
+    const std::filesystem::path pluginPath = libraryPath.empty()? caller.m_pluginPath.toStdString() : libraryPath;
 
     caller.m_pluginPathAsPath = pluginPath;
+    caller.m_binaryLastWrite = binaryLastWriteTime(caller.m_pluginPath.toStdString());
 
+    recordUsage(caller.m_pluginPath);
 
-    auto pluginIterator = m_handles.find(pluginPath);
-    if (pluginIterator == m_handles.end())
+    auto onError = [&caller, &s]()
     {
-        PluginLibrary library;
-        library.loadFromPath(caller.m_pluginPathAsPath);
-        pluginIterator = m_handles.emplace(pluginPath, std::move(library)).first;
+        s.status = S::OnError;
+        caller.status.store(s);
+        --caller.pendingTopologyChanges;
+
+        return false;
+    };
+
+    PluginLibrary* library = acquireLibrary(pluginPath);
+    if (!library)
+    {
+        qWarning() << "could not load plugin library: " << caller.m_pluginPath;
+        return onError();
     }
 
-    PluginLibrary& library = pluginIterator->second;
+    const auto residentMemoryBefore = ocp::residentMemoryBytes();
 
-    const auto descriptor = library.getPluginDescriptor(static_cast<int>(pluginIndex));
-    const auto plugin = library.createPluginInstance(caller.clapHost(), &descriptor);
+    const auto descriptor = library->getPluginDescriptor(static_cast<int>(pluginIndex));
+    const auto plugin = library->createPluginInstance(caller.clapHost(), &descriptor);
     if (!plugin)
     {
         qWarning() << "could not create plugin with id: " << descriptor.id;
-        s.status = S::OnError;
-        caller.status.store(s);
-        --caller.pendingTopologyChanges;
+        releaseLibraryIfUnused(pluginPath);
 
-        return false;
+        return onError();
     }
 
     auto pluginProxy = std::make_unique<PluginProxy>(*plugin, caller);
@@ -177,26 +242,72 @@ bool PluginManager::load(PluginHost& caller, const QString& path, const uint32_t
     if (!pluginProxy->init())
     {
         qWarning() << "could not initialize plugin with id: " << descriptor.id;
-        s.status = S::OnError;
-        caller.status.store(s);
-        caller.m_plugin.reset();
-        --caller.pendingTopologyChanges;
+        pluginProxy->destroy();
+        releaseLibrary(pluginPath);
 
-        return false;
+        return onError();
     }
 
+    if (const auto residentMemoryAfter = ocp::residentMemoryBytes(); residentMemoryAfter > residentMemoryBefore)
+        caller.m_footprint = residentMemoryAfter - residentMemoryBefore;
+
     caller.m_name = descriptor.name;
     caller.m_plugin = std::move(pluginProxy);
     caller.m_parameterModel = std::make_unique<ParameterModel>(caller, *caller.m_plugin);
+    // A parameter change is a state change, whether the plugin says so or not, from the
+    // GUI or reported back by the engine. Only the ones the user makes mark it dirty,
+    // ParameterModel does that
+    connect(caller.m_parameterModel.get(), &QAbstractItemModel::dataChanged, &caller, [&caller]()
+    {
+        caller.m_stateVersion = PluginHost::newStateVersion();
+    });
+    caller.rebuildParamBuffers();
     caller.m_index = pluginIndex;
+    caller.m_audioPlugin.store(caller.m_plugin.get(), std::memory_order_release);
 
     emit caller.hostedPluginChanged();
+    emit libraryLoaded(caller.m_pluginPath);
     --caller.pendingTopologyChanges;
 
     return true;
 }
 
-void PluginManager::unload(PluginHost& pluginHost, [[maybe_unused]] const bool forceLibraryUnload)
+void PluginManager::prepareLibrary(const std::filesystem::path& path, QObject* context,
+    std::function<void()> onReady)
+{
+    if (m_handles.contains(path))
+    {
+        onReady();
+        return;
+    }
+
+    m_preloader.preload(path, [context = QPointer{context}, onReady = std::move(onReady)]()
+    {
+        if (context)
+            QMetaObject::invokeMethod(context, onReady, Qt::QueuedConnection);
+    });
+}
+
+std::filesystem::path PluginManager::makeShadowCopy(const QString& path)
+{
+    const std::filesystem::path source = path.toStdString();
+    auto destination = m_shadowCopiesPath / std::to_string(++m_shadowCopiesCount);
+
+    std::error_code error;
+    std::filesystem::create_directories(destination, error);
+    destination /= source.filename();
+
+    std::filesystem::copy(source, destination, std::filesystem::copy_options::recursive, error);
+    if (error)
+    {
+        qWarning() << "Could not make a shadow copy of" << path << ":" << error.message().c_str();
+        return {};
+    }
+
+    return destination;
+}
+
+void PluginManager::unload(PluginHost& pluginHost)
 {
     if (!pluginHost.m_plugin)
         return;
@@ -204,45 +315,180 @@ void PluginManager::unload(PluginHost& pluginHost, [[maybe_unused]] const bool f
     if (!pluginHost.name().isEmpty())
         qDebug() << "PluginManager::unload:" << pluginHost.name();
 
-    if (pluginHost.status.load().status >= S::Stopped)
-        pluginHost.deactivate();
+    // From here on the audio thread can't reach the instance anymore, but a callback
+    // that's already running might, so the actual teardown waits for the next epoch
+    pluginHost.m_audioPlugin.store(nullptr, std::memory_order_release);
+    pluginHost.m_audioParamQueue.store(nullptr, std::memory_order_release);
+    pluginHost.m_audioParamFeedback.store(nullptr, std::memory_order_release);
+
+    auto curStatus = pluginHost.status.load();
+    const bool wasActive = curStatus.status >= S::Stopped;
+    curStatus.status = S::Inactive;
+    pluginHost.status.store(curStatus);
+    pluginHost.m_blockSize = 0;
+
+    if (pluginHost.m_plugin->canUseGui())
+        pluginHost.destroyGuiWindow();
 
     pluginHost.m_parameterModel.reset();
 
-    if (pluginHost.m_plugin)
+    std::shared_ptr<PluginProxy> plugin = std::move(pluginHost.m_plugin);
+    std::shared_ptr<ParamValueQueue> paramQueue = std::move(pluginHost.m_paramQueue);
+    std::shared_ptr<ParamValueFeedback> paramFeedback = std::move(pluginHost.m_paramFeedback);
+
+    // The host outlives this, its destructor waits for it
+    ++pluginHost.m_retiredInstanceCount;
+    EpochReclaimer::instance()->retire([this, host = &pluginHost, plugin, paramQueue, paramFeedback, wasActive,
+        pluginPath = pluginHost.m_pluginPathAsPath]()
+    {
+        if (wasActive)
+            plugin->deactivate();
+
+        plugin->destroy();
+        releaseLibrary(pluginPath);
+        --host->m_retiredInstanceCount;
+    });
+}
+
+PluginLibrary* PluginManager::acquireLibrary(const std::filesystem::path& path)
+{
+    auto pluginIterator = m_handles.find(path);
+    if (pluginIterator == m_handles.end())
     {
-        if (pluginHost.m_plugin->canUseGui())
-            pluginHost.destroyGuiWindow();
+        PluginLibrary library;
+        library.loadFromPath(path);
+
+        // Only after our own dlopen, otherwise dropping the preloaded handle could unload it
+        if (m_preloader.consume(path))
+            ++m_preloadHits;
+        else
+            ++m_preloadMisses;
+
+        emit preloadHitRateChanged();
+
+        if (!library.isLoaded())
+            return nullptr;
 
-        pluginHost.m_plugin->destroy();
-        pluginHost.m_plugin.reset();
+        pluginIterator = m_handles.emplace(path, std::move(library)).first;
     }
 
-    const auto& pluginPath = pluginHost.m_pluginPathAsPath;
+    return &pluginIterator->second;
+}
 
-    auto pluginIterator = m_handles.find(pluginPath);
+void PluginManager::releaseLibrary(const std::filesystem::path& path)
+{
+    const auto pluginIterator = m_handles.find(path);
     if (pluginIterator == m_handles.end())
     {
-        qInfo() << "Plugin not found in PluginManager:" << pluginHost.name() << pluginHost.m_pluginPathAsPath.c_str();
+        qInfo() << "Plugin library not found in PluginManager:" << path.c_str();
         return;
     }
 
-    if (forceLibraryUnload)
-    {
-        PluginLibrary& library = pluginIterator->second;
-        library.decreasePluginCount();
+    PluginLibrary& library = pluginIterator->second;
+    library.decreasePluginCount();
 
-        if (library.count() == 0)
-            m_handles.erase(pluginIterator);
+    if (library.count() > 0)
+        return;
+
+    m_handles.erase(pluginIterator);
+
+    if (isShadowCopy(path))
+    {
+        std::error_code error;
+        std::filesystem::remove_all(path.parent_path(), error);
     }
-    else
+}
+
+bool PluginManager::isBinaryOutdated(const PluginHost& pluginHost) const
+{
+    if (!pluginHost.m_plugin)
+        return false;
+
+    const auto lastWriteTime = binaryLastWriteTime(pluginHost.m_pluginPath.toStdString());
+
+    return lastWriteTime != std::filesystem::file_time_type{} && lastWriteTime != pluginHost.m_binaryLastWrite;
+}
+
+bool PluginManager::isShadowCopy(const std::filesystem::path& path) const
+{
+    const auto relativePath = path.lexically_relative(m_shadowCopiesPath);
+    return !relativePath.empty() && *relativePath.begin() != "..";
+}
+
+void PluginManager::releaseLibraryIfUnused(const std::filesystem::path& path)
+{
+    const auto pluginIterator = m_handles.find(path);
+    if (pluginIterator == m_handles.end() || pluginIterator->second.count() > 0)
+        return;
+
+    pluginIterator->second.unload();
+    m_handles.erase(pluginIterator);
+}
+
+int PluginManager::preloadBudget() const
+{
+    return static_cast<int>(m_preloader.budget());
+}
+
+void PluginManager::setPreloadBudget(const int newPreloadBudget)
+{
+    if (newPreloadBudget < 0 || newPreloadBudget == preloadBudget())
+        return;
+
+    m_preloader.setBudget(newPreloadBudget);
+    emit preloadBudgetChanged();
+}
+
+double PluginManager::preloadHitRate() const
+{
+    const auto total = m_preloadHits + m_preloadMisses;
+    if (total == 0)
+        return 0.0;
+
+    return static_cast<double>(m_preloadHits) / total;
+}
+
+void PluginManager::prefetchLikelyPicks()
+{
+    const auto now = QDateTime::currentSecsSinceEpoch();
+
+    std::vector<std::pair<double, QString>> candidates;
+    for (auto it = m_libraryUsage.cbegin(); it != m_libraryUsage.cend(); ++it)
     {
-        QTimer::singleShot(2000, this, [pluginIterator]()
+        if (const std::filesystem::path libraryPath = it.key().toStdString();
+            m_handles.contains(libraryPath) || !std::filesystem::exists(libraryPath))
         {
-            PluginLibrary& library = pluginIterator->second;
-            library.decreasePluginCount();
-        });
+            continue;
+        }
+
+        candidates.emplace_back(usageScore(it->count, it->lastUsed, now), it.key());
     }
+
+    std::ranges::sort(candidates, std::greater{});
+
+    const auto count = std::min(candidates.size(), m_preloader.budget());
+
+    // Queued from least to most likely, each preload() jumps to the front
+    for (auto i = count; i > 0; --i)
+        m_preloader.preload(candidates[i - 1].second.toStdString());
+}
+
+void PluginManager::warm(const QString& path)
+{
+    const auto pluginPath = path.startsWith("file://")? path.mid(7) : path;
+    const std::filesystem::path libraryPath = pluginPath.toStdString();
+
+    if (m_handles.contains(libraryPath))
+        return;
+
+    m_preloader.preload(libraryPath);
+}
+
+void PluginManager::recordUsage(const QString& path)
+{
+    auto& usage = m_libraryUsage[path];
+    ++usage.count;
+    usage.lastUsed = QDateTime::currentSecsSinceEpoch();
 }
 
 QString PluginManager::pathsToScan() const
@@ -1,7 +1,9 @@
 #pragma once
 #include <filesystem>
 #include <QObject>
+#include "PluginHostPool.h"
 #include "PluginInfo.h"
+#include "PluginPreloader.h"
 
 
 class QSettings;
@@ -16,6 +18,8 @@ class PluginManager final : public QObject
     Q_PROPERTY(QString pathsToScan READ pathsToScan WRITE setPathsToScan NOTIFY pathsToScanChanged)
     Q_PROPERTY(bool hasFoundPlugins READ hasFoundPlugins NOTIFY hasFoundPluginsChanged)
     Q_PROPERTY(QList<PluginInfo> availablePlugins READ availablePlugins NOTIFY availablePluginsChanged)
+    Q_PROPERTY(int preloadBudget READ preloadBudget WRITE setPreloadBudget NOTIFY preloadBudgetChanged)
+    Q_PROPERTY(double preloadHitRate READ preloadHitRate NOTIFY preloadHitRateChanged)
 
 
   public:
@@ -26,8 +30,20 @@ class PluginManager final : public QObject
     PluginManager(const PluginManager&) = delete;
     PluginManager(const PluginManager&&) = delete;
 
-    bool load(PluginHost& caller, const QString& path, uint32_t pluginIndex);
-    void unload(PluginHost& pluginHost, bool forceLibraryUnload = false);
+    // libraryPath, when set, is the binary actually opened (e.g. a shadow copy), while
+    // path stays what the plugin is known by
+    bool load(PluginHost& caller, const QString& path, uint32_t pluginIndex,
+        const std::filesystem::path& libraryPath = {});
+    void unload(PluginHost& pluginHost);
+
+    // Gets the library into memory off the main thread, then calls onReady on context's thread
+    void prepareLibrary(const std::filesystem::path& path, QObject* context, std::function<void()> onReady);
+
+    // Copies a plugin so that its current binary can be loaded next to an older one
+    [[nodiscard]] std::filesystem::path makeShadowCopy(const QString& path);
+    [[nodiscard]] bool isBinaryOutdated(const PluginHost& pluginHost) const;
+
+    [[nodiscard]] PluginHostPool& hostPool() { return m_hostPool; }
 
     [[nodiscard]] QString pathsToScan() const;
     void setPathsToScan(const QString& newPathsToScan);
@@ -36,15 +52,28 @@ class PluginManager final : public QObject
 
     [[nodiscard]] QList<PluginInfo> availablePlugins();
 
+    [[nodiscard]] int preloadBudget() const;
+    void setPreloadBudget(int newPreloadBudget);
+
+    [[nodiscard]] double preloadHitRate() const;
+
 
   public slots:
     void rescanPluginPaths();
 
+    // Speculatively opens the libraries the user is most likely to pick next
+    void prefetchLikelyPicks();
+    void warm(const QString& path);
+
 
   signals:
     void pathsToScanChanged() const;
     void hasFoundPluginsChanged() const;
     void availablePluginsChanged() const;
+    void preloadBudgetChanged() const;
+    void preloadHitRateChanged() const;
+
+    void libraryLoaded(const QString& path) const;
 
 
   private:
@@ -53,7 +82,32 @@ class PluginManager final : public QObject
     QString m_pathsToScan;
     QList<PluginInfo> m_availablePluginsList;
 
+    // Every loaded library, refcounted by its live instances; an entry is only
+    // erased (and dlclose'd) once its last instance has been reclaimed
     std::unordered_map<std::filesystem::path, PluginLibrary> m_handles;
 
+    PluginHostPool m_hostPool;
+
+    struct LibraryUsage
+    {
+        int count = 0;
+        qint64 lastUsed = 0;
+    };
+
+    PluginPreloader m_preloader;
+    QHash<QString, LibraryUsage> m_libraryUsage;
+    int m_preloadHits = 0;
+    int m_preloadMisses = 0;
+
+    std::filesystem::path m_shadowCopiesPath;
+    int m_shadowCopiesCount = 0;
+
+    void recordUsage(const QString& path);
+
+    PluginLibrary* acquireLibrary(const std::filesystem::path& path);
+    void releaseLibrary(const std::filesystem::path& path);
+    void releaseLibraryIfUnused(const std::filesystem::path& path);
+    [[nodiscard]] bool isShadowCopy(const std::filesystem::path& path) const;
+
     void scanPluginPaths();
 };
@@ -0,0 +1,210 @@
+#include "PluginPreloader.h"
+#include <vector>
+#include "Utils.h"
+
+
+PluginPreloader::PluginPreloader() : m_thread{&PluginPreloader::run, this} {}
+
+PluginPreloader::~PluginPreloader()
+{
+    {
+        std::lock_guard lock{m_mutex};
+        m_shouldStop = true;
+        m_queue.clear();
+    }
+
+    m_condition.notify_one();
+    m_thread.join();
+
+    for (const auto& preloaded : m_preloaded)
+    {
+        if (preloaded.handle)
+            ocp::releaseHandle(preloaded.handle);
+    }
+}
+
+void PluginPreloader::preload(const std::filesystem::path& path, std::function<void()> onReady)
+{
+    std::vector<std::function<void()>> waitersToNotify;
+
+    {
+        std::lock_guard lock{m_mutex};
+
+        if (const auto it = std::ranges::find(m_preloaded, path, &Preloaded::path); it != m_preloaded.end())
+        {
+            m_preloaded.splice(m_preloaded.begin(), m_preloaded, it);
+
+            if (it->handle)
+                waitersToNotify.push_back(std::move(onReady));
+            else if (onReady)
+                m_waiters[path.string()].push_back(std::move(onReady));
+        }
+        else
+        {
+            if (const auto queued = std::ranges::find(m_queue, path); queued != m_queue.end())
+                m_queue.erase(queued);
+
+            m_queue.push_front(path);
+
+            if (onReady)
+                m_waiters[path.string()].push_back(std::move(onReady));
+
+            dropQueuedOverBudget(waitersToNotify);
+        }
+    }
+
+    m_condition.notify_one();
+
+    for (const auto& waiter : waitersToNotify)
+    {
+        if (waiter)
+            waiter();
+    }
+}
+
+bool PluginPreloader::consume(const std::filesystem::path& path)
+{
+    void* handle = nullptr;
+
+    {
+        std::lock_guard lock{m_mutex};
+
+        if (const auto it = std::ranges::find(m_queue, path); it != m_queue.end())
+            m_queue.erase(it);
+
+        const auto it = std::ranges::find(m_preloaded, path, &Preloaded::path);
+        if (it == m_preloaded.end())
+            return false;
+
+        // Still being opened: the main thread got there first
+        if (!it->handle)
+            return false;
+
+        handle = it->handle;
+        m_preloaded.erase(it);
+    }
+
+    ocp::releaseHandle(handle);
+
+    return true;
+}
+
+std::size_t PluginPreloader::budget() const
+{
+    std::lock_guard lock{m_mutex};
+    return m_budget;
+}
+
+void PluginPreloader::setBudget(const std::size_t newBudget)
+{
+    std::vector<std::function<void()>> waitersToNotify;
+
+    {
+        std::unique_lock lock{m_mutex};
+        m_budget = newBudget;
+
+        dropQueuedOverBudget(waitersToNotify);
+        evictOverBudget(lock);
+    }
+
+    for (const auto& waiter : waitersToNotify)
+        waiter();
+}
+
+void PluginPreloader::run()
+{
+    std::unique_lock lock{m_mutex};
+
+    while (true)
+    {
+        m_condition.wait(lock, [this]() { return m_shouldStop || !m_queue.empty(); });
+        if (m_shouldStop)
+            return;
+
+        const auto path = m_queue.front();
+        m_queue.pop_front();
+
+        m_preloaded.push_front({path, nullptr});
+        evictOverBudget(lock);
+
+        lock.unlock();
+
+        ocp::readAhead(path);
+        void* handle = ocp::clapHandleFromPath(path);
+
+        lock.lock();
+
+        const auto it = std::ranges::find(m_preloaded, path, &Preloaded::path);
+        if (it != m_preloaded.end() && !it->handle)
+        {
+            if (handle)
+                it->handle = handle;
+            else
+                m_preloaded.erase(it);
+
+            handle = nullptr;
+        }
+
+        std::vector<std::function<void()>> waitersToNotify;
+        takeWaiters(path, waitersToNotify);
+
+        lock.unlock();
+
+        // Consumed or evicted while we were busy
+        if (handle)
+            ocp::releaseHandle(handle);
+
+        for (const auto& waiter : waitersToNotify)
+            waiter();
+
+        lock.lock();
+    }
+}
+
+void PluginPreloader::dropQueuedOverBudget(std::vector<std::function<void()>>& waitersToNotify)
+{
+    while (m_queue.size() > m_budget)
+    {
+        takeWaiters(m_queue.back(), waitersToNotify);
+        m_queue.pop_back();
+    }
+}
+
+void PluginPreloader::takeWaiters(const std::filesystem::path& path,
+    std::vector<std::function<void()>>& waitersToNotify)
+{
+    const auto it = m_waiters.find(path.string());
+    if (it == m_waiters.end())
+        return;
+
+    for (auto& waiter : it->second)
+        waitersToNotify.push_back(std::move(waiter));
+
+    m_waiters.erase(it);
+}
+
+void PluginPreloader::evictOverBudget(std::unique_lock<std::mutex>& lock)
+{
+    std::vector<void*> handlesToRelease;
+
+    // Entries still being opened are left alone, run() owns them until then
+    for (auto it = m_preloaded.end(); m_preloaded.size() > m_budget && it != m_preloaded.begin();)
+    {
+        --it;
+        if (!it->handle)
+            continue;
+
+        handlesToRelease.push_back(it->handle);
+        it = m_preloaded.erase(it);
+    }
+
+    if (handlesToRelease.empty())
+        return;
+
+    lock.unlock();
+
+    for (auto* handle : handlesToRelease)
+        ocp::releaseHandle(handle);
+
+    lock.lock();
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+// Pulls plugin binaries into the page cache and dlopen's them on a background thread,
+// so that when the user picks one the main thread only pays for the CLAP entry init
+// (which the spec requires to happen there) and factory creation.
+class PluginPreloader
+{
+  public:
+    PluginPreloader();
+    ~PluginPreloader();
+    PluginPreloader(PluginPreloader&) = delete;
+    PluginPreloader(PluginPreloader&&) = delete;
+    PluginPreloader(const PluginPreloader&) = delete;
+    PluginPreloader(const PluginPreloader&&) = delete;
+
+    // Most important first; anything over budget is dropped. onReady is called from
+    // the preloader's thread (or right away) once opening the library was attempted,
+    // whether it worked or the request got dropped
+    void preload(const std::filesystem::path& path, std::function<void()> onReady = {});
+
+    // To be called once the library has been opened for real: tells whether the
+    // preload got there in time and drops the preloader's own handle to it
+    bool consume(const std::filesystem::path& path);
+
+    [[nodiscard]] std::size_t budget() const;
+    void setBudget(std::size_t newBudget);
+
+
+  private:
+    struct Preloaded
+    {
+        std::filesystem::path path;
+        void* handle = nullptr;
+    };
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<std::filesystem::path> m_queue;
+    // Most recently requested first
+    std::list<Preloaded> m_preloaded;
+    std::unordered_map<std::string, std::vector<std::function<void()>>> m_waiters;
+    std::size_t m_budget = 4;
+    bool m_shouldStop = false;
+
+    std::thread m_thread;
+
+    void run();
+    void evictOverBudget(std::unique_lock<std::mutex>& lock);
+    void dropQueuedOverBudget(std::vector<std::function<void()>>& waitersToNotify);
+    void takeWaiters(const std::filesystem::path& path, std::vector<std::function<void()>>& waitersToNotify);
+};
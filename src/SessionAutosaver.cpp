@@ -0,0 +1,95 @@
+#include "SessionAutosaver.h"
+#include <algorithm>
+#include <QtDebug>
+#include "AudioEngine.h"
+
+
+SessionAutosaver::SessionAutosaver(AudioEngine& audioEngine, QObject* parent)
+    : QObject{parent}, m_audioEngine{audioEngine}
+{
+    connect(&m_timer, &QTimer::timeout, this, &SessionAutosaver::autosave);
+
+    m_writer = std::thread{[this]() { write(); }};
+}
+
+SessionAutosaver::~SessionAutosaver()
+{
+    {
+        std::lock_guard lock{m_mutex};
+        m_shouldStop = true;
+    }
+
+    m_condition.notify_one();
+    m_writer.join();
+}
+
+void SessionAutosaver::setInterval(const int seconds)
+{
+    if (seconds == m_interval)
+        return;
+
+    m_interval = std::max(0, seconds);
+
+    if (m_interval > 0)
+        m_timer.start(m_interval * 1000);
+    else
+        m_timer.stop();
+
+    emit intervalChanged();
+}
+
+void SessionAutosaver::setPath(const QString& path)
+{
+    m_path = path.startsWith("file://")? path.mid(7) : path;
+}
+
+void SessionAutosaver::autosave()
+{
+    // Half a session isn't worth keeping
+    if (m_path.isEmpty() || m_audioEngine.sessionLoader()->isLoading())
+        return;
+
+    if (!m_audioEngine.isSessionDirty() && !m_hasFailed)
+        return;
+
+    m_hasFailed = false;
+
+    Job job{m_path, {}, {}};
+    job.graph = m_audioEngine.sessionState(&job.writer);
+
+    {
+        std::lock_guard lock{m_mutex};
+        m_pendingJob = std::move(job);
+    }
+
+    m_condition.notify_one();
+}
+
+void SessionAutosaver::write()
+{
+    while (true)
+    {
+        std::optional<Job> job;
+
+        {
+            std::unique_lock lock{m_mutex};
+            m_condition.wait(lock, [this]() { return m_shouldStop || m_pendingJob.has_value(); });
+
+            // What's left is written before quitting, it's the newest there is
+            if (!m_pendingJob && m_shouldStop)
+                return;
+
+            job.swap(m_pendingJob);
+        }
+
+        if (!job->writer.write(job->path, job->graph))
+        {
+            // Nothing got written, so it's all still to be
+            qWarning() << "SessionAutosaver: could not write" << job->path;
+            QMetaObject::invokeMethod(this, [this]() { m_hasFailed = true; }, Qt::QueuedConnection);
+            continue;
+        }
+
+        QMetaObject::invokeMethod(this, [this, path = job->path]() { emit saved(path); }, Qt::QueuedConnection);
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <QJsonObject>
+#include <QObject>
+#include <QTimer>
+#include "Utils/SessionFile.h"
+
+
+class AudioEngine;
+
+
+// Every so often, writes the session to a file of its own when it changed since it
+// was last written. The graph is put together on the main thread, where plugins that
+// didn't change hand over the state they saved last time instead of saving it again;
+// encoding the graph and writing the file (to a temporary one first, renamed over the
+// old one) happen on a thread of its own, so the window never waits on the disk.
+class SessionAutosaver final : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(int interval READ interval WRITE setInterval NOTIFY intervalChanged)
+
+
+  public:
+    explicit SessionAutosaver(AudioEngine& audioEngine, QObject* parent = nullptr);
+    ~SessionAutosaver() override;
+    SessionAutosaver(SessionAutosaver&) = delete;
+    SessionAutosaver(SessionAutosaver&&) = delete;
+    SessionAutosaver(const SessionAutosaver&) = delete;
+    SessionAutosaver(const SessionAutosaver&&) = delete;
+
+    // In seconds, 0 turns autosaving off
+    [[nodiscard]] int interval() const { return m_interval; }
+    void setInterval(int seconds);
+
+    [[nodiscard]] const QString& path() const { return m_path; }
+    void setPath(const QString& path);
+
+    // Right away, if there's anything to save
+    void autosave();
+
+
+  signals:
+    void intervalChanged();
+    void saved(const QString& path);
+
+
+  private:
+    struct Job
+    {
+        QString path;
+        QJsonObject graph;
+        SessionFile::Writer writer;
+    };
+
+    AudioEngine& m_audioEngine;
+    int m_interval = 0;
+    QString m_path;
+    QTimer m_timer;
+    // The last write didn't make it; kept apart from the session's own unsaved changes
+    bool m_hasFailed = false;
+
+    // Only the latest session waiting is written, an older one still waiting is dropped
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::optional<Job> m_pendingJob;
+    bool m_shouldStop = false;
+    std::thread m_writer;
+
+    void write();
+};
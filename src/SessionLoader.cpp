@@ -0,0 +1,406 @@
+#include "SessionLoader.h"
+#include <algorithm>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QTimer>
+#include <QtDebug>
+#include "AudioEngine.h"
+#include "Nodes/ChannelStrip.h"
+#include "Nodes/PluginHost.h"
+#include "Utils.h"
+
+
+namespace
+{
+
+std::filesystem::path libraryOf(const QJsonObject& pluginState)
+{
+    const auto path = pluginState["path"].toString();
+    return (path.startsWith("file://")? path.mid(7) : path).toStdString();
+}
+
+// Decodes the base64 states of a JSON session into blobs, the way a binary session
+// has them, and notes down every library the session's plugins come from
+QJsonValue prepareNodes(const QJsonValue& value, std::vector<QByteArray>& blobs,
+    std::set<std::filesystem::path>& libraries)
+{
+    if (value.isArray())
+    {
+        QJsonArray nodes;
+        for (const auto& node : value.toArray())
+            nodes.append(prepareNodes(node, blobs, libraries));
+
+        return nodes;
+    }
+
+    if (!value.isObject())
+        return value;
+
+    auto node = value.toObject();
+    for (auto it = node.begin(); it != node.end(); ++it)
+    {
+        if (it->isArray())
+            *it = prepareNodes(*it, blobs, libraries);
+    }
+
+    if (node["type"].toString() != "PluginHost")
+        return node;
+
+    if (auto library = libraryOf(node); !library.empty())
+        libraries.insert(std::move(library));
+
+    if (node.contains("stateData"))
+    {
+        blobs.push_back(QByteArray::fromBase64(node.take("stateData").toString().toUtf8()));
+        node["stateBlob"] = static_cast<int>(blobs.size()) - 1;
+    }
+
+    return node;
+}
+
+}
+
+
+SessionLoader::SessionLoader(QObject* parent) : QObject{parent}
+{
+}
+
+SessionLoader::~SessionLoader()
+{
+    cancel();
+
+    // Quitting, the workers are only waited for here
+    for (auto& job : m_stoppingJobs)
+    {
+        job->thread.join();
+        release(*job);
+    }
+}
+
+void SessionLoader::load(const QString& path)
+{
+    cancel();
+
+    m_isLoading = true;
+    emit isLoadingChanged();
+
+    m_job = std::make_unique<Job>();
+    m_job->thread = std::thread{[this, &job = *m_job, path, generation = m_generation]()
+    {
+        read(job, path, generation);
+
+        job.isDone.store(true, std::memory_order_release);
+        QMetaObject::invokeMethod(this, &SessionLoader::reapStoppedJobs, Qt::QueuedConnection);
+    }};
+}
+
+void SessionLoader::cancel()
+{
+    ++m_generation;
+
+    if (m_job)
+    {
+        m_job->shouldStop.store(true);
+        m_stoppingJobs.push_back(std::move(m_job));
+    }
+
+    reapStoppedJobs();
+
+    m_pendingPlugins.clear();
+    m_readyLibraries.clear();
+    m_session.reset();
+
+    m_pluginCount = 0;
+    m_loadedPluginCount = 0;
+    m_currentPluginName.clear();
+    emit progressChanged();
+
+    if (m_isLoading)
+    {
+        m_isLoading = false;
+        emit isLoadingChanged();
+    }
+}
+
+void SessionLoader::setIsLazy(const bool value)
+{
+    if (m_isLazy == value)
+        return;
+
+    m_isLazy = value;
+    emit isLazyChanged();
+}
+
+void SessionLoader::defer(PluginHost& placeholder)
+{
+    m_pendingPlugins.push_back({&placeholder, placeholder.path().toStdString()});
+}
+
+void SessionLoader::instantiateLater(PluginHost& placeholder)
+{
+    const auto isQueued = std::ranges::any_of(m_pendingPlugins, [&placeholder](const PendingPlugin& plugin)
+    {
+        return plugin.placeholder == &placeholder;
+    });
+
+    // Without a library to wait for, PluginManager opens it when it gets to it
+    if (!isQueued)
+        m_pendingPlugins.push_back({&placeholder, {}});
+
+    scheduleNextPlugin();
+}
+
+QByteArrayView SessionLoader::blob(const int index) const
+{
+    if (!m_session)
+        return {};
+
+    if (m_session->sessionFile)
+        return m_session->sessionFile->blob(index);
+
+    if (index < 0 || index >= static_cast<int>(m_session->blobs.size()))
+        return {};
+
+    return m_session->blobs[static_cast<std::size_t>(index)];
+}
+
+void SessionLoader::read(Job& job, const QString& path, const std::uint32_t generation)
+{
+    auto session = std::make_shared<Session>();
+
+    session->sessionFile = SessionFile::open(path);
+    if (session->sessionFile)
+    {
+        session->graph = QJsonDocument(session->sessionFile->graph());
+    }
+    else
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            qWarning() << "Failed to open file for reading:" << path;
+            QMetaObject::invokeMethod(this, [this, generation]()
+            {
+                if (generation == m_generation)
+                    finish();
+            }, Qt::QueuedConnection);
+
+            return;
+        }
+
+        session->graph = QJsonDocument::fromJson(file.readAll());
+    }
+
+    std::set<std::filesystem::path> libraries;
+
+    // Older sessions are just the array of channel strips
+    if (session->graph.isArray())
+    {
+        session->graph.setArray(prepareNodes(session->graph.array(), session->blobs, libraries).toArray());
+    }
+    else
+    {
+        auto sessionJson = session->graph.object();
+        sessionJson["channelStrips"] = prepareNodes(sessionJson["channelStrips"], session->blobs, libraries);
+        session->graph.setObject(sessionJson);
+    }
+
+    session->libraries.assign(libraries.begin(), libraries.end());
+
+    QMetaObject::invokeMethod(this, [this, generation, session]()
+    {
+        if (generation == m_generation)
+            buildGraph(session);
+    }, Qt::QueuedConnection);
+
+    prefetchLibraries(job, session->libraries, generation);
+}
+
+void SessionLoader::prefetchLibraries(Job& job, const std::vector<std::filesystem::path>& libraries,
+    const std::uint32_t generation)
+{
+    job.prefetchedHandles.assign(libraries.size(), nullptr);
+
+    // Mostly waiting on the disk, so a few at once pays off even on few cores
+    std::atomic<std::size_t> next = 0;
+    const auto prefetch = [this, &job, &libraries, &next, generation]()
+    {
+        for (auto i = next++; i < libraries.size() && !job.shouldStop.load(); i = next++)
+        {
+            ocp::readAhead(libraries[i]);
+            job.prefetchedHandles[i] = ocp::clapHandleFromPath(libraries[i]);
+
+            QMetaObject::invokeMethod(this, [this, generation, library = libraries[i]]()
+            {
+                if (generation != m_generation)
+                    return;
+
+                m_readyLibraries.insert(library);
+                scheduleNextPlugin();
+            }, Qt::QueuedConnection);
+        }
+    };
+
+    const auto threadCount = std::min<std::size_t>(libraries.size(), std::clamp(std::thread::hardware_concurrency(), 2u, 8u));
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < threadCount; ++i)
+        threads.emplace_back(prefetch);
+
+    prefetch();
+
+    for (auto& thread : threads)
+        thread.join();
+}
+
+void SessionLoader::buildGraph(std::shared_ptr<const Session> session)
+{
+    m_session = std::move(session);
+
+    const auto& graph = m_session->graph;
+    const auto sessionJson = graph.object();
+
+    QList<Node*> channelStrips;
+
+    m_isBuildingGraph = true;
+
+    for (const auto channels = graph.isArray()? graph.array() : sessionJson["channelStrips"].toArray();
+         const auto& jsChannelRef : channels)
+    {
+        if (auto* channelStrip = Node::create(nullptr, jsChannelRef.toObject()))
+            channelStrips.append(channelStrip);
+    }
+
+    m_isBuildingGraph = false;
+
+    // The rest keep a copy of their state and wait for something to need them
+    if (m_isLazy)
+    {
+        const bool isEngineRunning = AudioEngine::instance()->isRunning();
+
+        std::erase_if(m_pendingPlugins, [isEngineRunning](const PendingPlugin& plugin)
+        {
+            if (isEngineRunning && !plugin.placeholder->isByPassed())
+                return false;
+
+            plugin.placeholder->detachPendingState();
+            return true;
+        });
+    }
+
+    // What's folded away in collapsed strips is out of sight, so it's loaded last
+    std::ranges::stable_partition(m_pendingPlugins, [](const PendingPlugin& plugin)
+    {
+        return !ChannelStrip::isInCollapsedStrip(plugin.placeholder);
+    });
+
+    m_pluginCount = static_cast<int>(m_pendingPlugins.size());
+    m_loadedPluginCount = 0;
+    emit progressChanged();
+
+    emit graphReady(sessionJson["transport"].toObject(), channelStrips);
+
+    scheduleNextPlugin();
+}
+
+void SessionLoader::scheduleNextPlugin()
+{
+    if (m_isLoadScheduled)
+        return;
+
+    // One plugin per turn, whatever else is waiting in the event loop goes in between
+    m_isLoadScheduled = true;
+    QTimer::singleShot(0, this, [this]()
+    {
+        m_isLoadScheduled = false;
+        loadNextPlugin();
+    });
+}
+
+void SessionLoader::loadNextPlugin()
+{
+    std::erase_if(m_pendingPlugins, [](const PendingPlugin& plugin) { return plugin.placeholder.isNull(); });
+
+    // A session still being read has nothing in the queue yet but what's asked for meanwhile
+    const bool isLoadingSession = m_isLoading && m_session;
+
+    if (m_pendingPlugins.empty())
+    {
+        if (isLoadingSession)
+            finish();
+
+        return;
+    }
+
+    // In session order, as far as the libraries come in
+    const auto next = std::ranges::find_if(m_pendingPlugins, [this](const PendingPlugin& plugin)
+    {
+        return plugin.library.empty() || m_readyLibraries.contains(plugin.library);
+    });
+
+    if (next == m_pendingPlugins.end())
+        return;
+
+    auto* placeholder = next->placeholder.data();
+    m_pendingPlugins.erase(next);
+
+    // Might have been needed, and loaded, already
+    placeholder->instantiate();
+
+    if (isLoadingSession)
+    {
+        m_currentPluginName = placeholder->name();
+        m_loadedPluginCount = std::max(0, m_pluginCount - static_cast<int>(m_pendingPlugins.size()));
+        emit progressChanged();
+    }
+
+    scheduleNextPlugin();
+}
+
+void SessionLoader::finish()
+{
+    // Every library is in by now, the worker is done or just about to be; it's released
+    // like a cancelled one once it is
+    if (m_job)
+        m_stoppingJobs.push_back(std::move(m_job));
+
+    reapStoppedJobs();
+
+    m_readyLibraries.clear();
+    m_session.reset();
+
+    m_loadedPluginCount = m_pluginCount;
+    m_currentPluginName.clear();
+    emit progressChanged();
+
+    m_isLoading = false;
+    emit isLoadingChanged();
+    emit finished();
+}
+
+void SessionLoader::reapStoppedJobs()
+{
+    std::erase_if(m_stoppingJobs, [](const std::unique_ptr<Job>& job)
+    {
+        if (!job->isDone.load(std::memory_order_acquire))
+            return false;
+
+        // Returned from read() already, this doesn't wait for anything
+        job->thread.join();
+        release(*job);
+
+        return true;
+    });
+}
+
+void SessionLoader::release(Job& job)
+{
+    for (auto* handle : job.prefetchedHandles)
+    {
+        if (handle)
+            ocp::releaseHandle(handle);
+    }
+
+    job.prefetchedHandles.clear();
+}
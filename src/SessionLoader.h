@@ -0,0 +1,137 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+#include <QByteArrayView>
+#include <QJsonDocument>
+#include <QObject>
+#include <QPointer>
+#include "Nodes/Node.h"
+#include "Utils/SessionFile.h"
+
+
+class PluginHost;
+
+
+// Loads a session in stages, so the window stays responsive and shows the session
+// as it comes in. A background thread reads and parses the file (base64 decoding
+// the states of JSON sessions), then opens every distinct plugin library in
+// parallel. The main thread builds the whole graph right away, with every plugin an
+// empty placeholder, and then swaps the real plugins in one per event loop turn, as
+// soon as each one's library is in memory: what's left for it are the CLAP calls
+// the spec wants there (entry init, create, init, state load and activate).
+//
+// With isLazy, only the plugins the engine is going to process get loaded; bypassed
+// ones, and all of them while the engine is off, stay placeholders until needed.
+class SessionLoader final : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool isLazy READ isLazy WRITE setIsLazy NOTIFY isLazyChanged)
+    Q_PROPERTY(bool isLoading READ isLoading NOTIFY isLoadingChanged)
+    Q_PROPERTY(int pluginCount READ pluginCount NOTIFY progressChanged)
+    Q_PROPERTY(int loadedPluginCount READ loadedPluginCount NOTIFY progressChanged)
+    Q_PROPERTY(QString currentPluginName READ currentPluginName NOTIFY progressChanged)
+
+
+  public:
+    explicit SessionLoader(QObject* parent = nullptr);
+    ~SessionLoader() override;
+    SessionLoader(SessionLoader&) = delete;
+    SessionLoader(SessionLoader&&) = delete;
+    SessionLoader(const SessionLoader&) = delete;
+    SessionLoader(const SessionLoader&&) = delete;
+
+    // Drops whatever load is still going on before starting this one
+    void load(const QString& path);
+    // Doesn't wait for the background thread, it stops on its own once it notices
+    void cancel();
+
+    [[nodiscard]] bool isLazy() const { return m_isLazy; }
+    void setIsLazy(bool value);
+
+    [[nodiscard]] bool isLoading() const { return m_isLoading; }
+    [[nodiscard]] int pluginCount() const { return m_pluginCount; }
+    [[nodiscard]] int loadedPluginCount() const { return m_loadedPluginCount; }
+    [[nodiscard]] const QString& currentPluginName() const { return m_currentPluginName; }
+
+    // While the graph is being built, plugins are only queued here instead of loaded
+    [[nodiscard]] bool isBuildingGraph() const { return m_isBuildingGraph; }
+    void defer(PluginHost& placeholder);
+    // Loaded the way a session's plugins are, one per event loop turn, instead of all
+    // at once right now; for placeholders the engine is about to process
+    void instantiateLater(PluginHost& placeholder);
+
+    // The state blobs of the session being loaded, valid until it's done loading
+    [[nodiscard]] QByteArrayView blob(int index) const;
+
+
+  signals:
+    void isLazyChanged();
+    void isLoadingChanged();
+    void progressChanged();
+
+    // On the main thread, with the channel strips of the session, before any plugin is in
+    void graphReady(const QJsonObject& transportState, const QList<Node*>& channelStrips);
+    void finished();
+
+
+  private:
+    // What the background thread hands over, read only from then on
+    struct Session
+    {
+        QJsonDocument graph;
+        std::unique_ptr<SessionFile> sessionFile;
+        // The states of a JSON session, decoded
+        std::vector<QByteArray> blobs;
+        std::vector<std::filesystem::path> libraries;
+    };
+
+    struct PendingPlugin
+    {
+        QPointer<PluginHost> placeholder;
+        std::filesystem::path library;
+    };
+
+    std::shared_ptr<const Session> m_session;
+    std::deque<PendingPlugin> m_pendingPlugins;
+    std::set<std::filesystem::path> m_readyLibraries;
+
+    bool m_isLazy = false;
+    bool m_isLoading = false;
+    bool m_isBuildingGraph = false;
+    bool m_isLoadScheduled = false;
+    int m_pluginCount = 0;
+    int m_loadedPluginCount = 0;
+    QString m_currentPluginName;
+
+    // The background thread of one load, and what it opened
+    struct Job
+    {
+        std::thread thread;
+        std::atomic<bool> shouldStop = false;
+        std::atomic<bool> isDone = false;
+        // Opened by the worker so they're resident, released once the plugins hold their own
+        std::vector<void*> prefetchedHandles;
+    };
+
+    // Bumped on every load and cancel, so what arrives from a load that's gone is dropped
+    std::uint32_t m_generation = 0;
+    std::unique_ptr<Job> m_job;
+    // Cancelled, joined and released once they're done
+    std::vector<std::unique_ptr<Job>> m_stoppingJobs;
+
+    void read(Job& job, const QString& path, std::uint32_t generation);
+    void prefetchLibraries(Job& job, const std::vector<std::filesystem::path>& libraries, std::uint32_t generation);
+
+    void buildGraph(std::shared_ptr<const Session> session);
+    void scheduleNextPlugin();
+    void loadNextPlugin();
+    void finish();
+    void reapStoppedJobs();
+    static void release(Job& job);
+};
@@ -0,0 +1,248 @@
+#include "Snapshots.h"
+#include <QtDebug>
+#include "AudioEngine.h"
+#include "ParameterModel.h"
+#include "Nodes/ChannelStrip.h"
+#include "Nodes/PluginHost.h"
+
+
+Snapshots::Snapshots(QObject* parent) : QObject{parent}
+{
+    m_latencyTimer.setInterval(1);
+    m_latencyTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_latencyTimer, &QTimer::timeout, this, &Snapshots::measureLatency);
+}
+
+bool Snapshots::hasSnapshot(Node* node, const int slot) const
+{
+    const auto it = m_nodes.find(node);
+    return it != m_nodes.end() && slot >= 0 && slot < slotCount && it->second.slots[slot].isFilled;
+}
+
+int Snapshots::currentSlot(Node* node) const
+{
+    const auto it = m_nodes.find(node);
+    return it != m_nodes.end()? it->second.currentSlot : -1;
+}
+
+void Snapshots::transfer(const Node* from, Node* to)
+{
+    const auto it = m_nodes.find(from);
+    if (it == m_nodes.end() || !to)
+        return;
+
+    auto nodeSlots = std::move(it->second);
+    m_nodes.erase(it);
+
+    const bool isNew = m_nodes.insert_or_assign(to, std::move(nodeSlots)).second;
+
+    if (isNew)
+        connect(to, &QObject::destroyed, this, [this, to]() { m_nodes.erase(to); });
+
+    if (m_lastNode == from)
+        m_lastNode = to;
+
+    ++m_revision;
+    emit changed();
+}
+
+void Snapshots::capture(Node* node, const int slot)
+{
+    if (!node || slot < 0 || slot >= slotCount)
+        return;
+
+    Slot captured;
+
+    // A placeholder's is taken of the state it's waiting with, without loading it
+    if (auto* plugin = dynamic_cast<PluginHost*>(node))
+    {
+        captured.plugins.push_back(snapshotOf(*plugin));
+    }
+    else if (auto* channelStrip = dynamic_cast<ChannelStrip*>(node))
+    {
+        for (auto* child : channelStrip->m_nodes)
+        {
+            if (auto* plugin = dynamic_cast<PluginHost*>(child))
+                captured.plugins.push_back(snapshotOf(*plugin));
+        }
+
+        captured.outputVolume = channelStrip->outputVolume();
+        captured.isBypassed = channelStrip->isByPassed();
+    }
+    else
+    {
+        return;
+    }
+
+    captured.isFilled = true;
+
+    auto [it, isNew] = m_nodes.try_emplace(node);
+    if (isNew)
+        connect(node, &QObject::destroyed, this, [this, node]() { m_nodes.erase(node); });
+
+    it->second.slots[slot] = std::move(captured);
+    it->second.currentSlot = slot;
+    m_lastNode = node;
+
+    ++m_revision;
+    emit changed();
+}
+
+void Snapshots::recall(Node* node, const int slot)
+{
+    const auto it = m_nodes.find(node);
+    if (it == m_nodes.end() || slot < 0 || slot >= slotCount || !it->second.slots[slot].isFilled)
+        return;
+
+    const auto& recalled = it->second.slots[slot];
+
+    m_recallStart = std::chrono::steady_clock::now();
+    m_loadedStateCount = 0;
+    m_pendingPlugins.clear();
+
+    // A placeholder gets the state to wait with instead, and stays one
+    const auto recallInto = [this](PluginHost& plugin, const PluginSnapshot& snapshot)
+    {
+        if (apply(plugin, snapshot))
+            ++m_loadedStateCount;
+        else if (plugin.hasQueuedParamValues())
+            m_pendingPlugins.append(&plugin);
+    };
+
+    if (auto* plugin = dynamic_cast<PluginHost*>(node))
+    {
+        recallInto(*plugin, recalled.plugins.front());
+    }
+    else if (auto* channelStrip = dynamic_cast<ChannelStrip*>(node))
+    {
+        // By position: what got moved or swapped since is the user's to sort out
+        std::size_t next = 0;
+        for (auto* child : channelStrip->m_nodes)
+        {
+            auto* plugin = dynamic_cast<PluginHost*>(child);
+            if (!plugin)
+                continue;
+
+            if (next == recalled.plugins.size())
+                break;
+
+            recallInto(*plugin, recalled.plugins[next++]);
+        }
+
+        channelStrip->setOutputVolume(recalled.outputVolume);
+        channelStrip->setIsByPassed(recalled.isBypassed);
+    }
+
+    it->second.currentSlot = slot;
+    m_lastNode = node;
+
+    ++m_revision;
+    emit changed();
+
+    measureLatency();
+}
+
+void Snapshots::toggle()
+{
+    if (!m_lastNode)
+        return;
+
+    const auto it = m_nodes.find(m_lastNode.data());
+    if (it == m_nodes.end())
+        return;
+
+    const auto current = it->second.currentSlot;
+    for (int i = 1; i <= slotCount; ++i)
+    {
+        if (const auto slot = (current + i) % slotCount; it->second.slots[slot].isFilled)
+        {
+            recall(m_lastNode.data(), slot);
+            return;
+        }
+    }
+}
+
+void Snapshots::clear()
+{
+    m_nodes.clear();
+    m_lastNode = nullptr;
+
+    m_latencyTimer.stop();
+    m_pendingPlugins.clear();
+
+    ++m_revision;
+    emit changed();
+}
+
+Snapshots::PluginSnapshot Snapshots::snapshotOf(PluginHost& plugin)
+{
+    PluginSnapshot snapshot;
+    snapshot.path = plugin.path();
+    snapshot.index = plugin.index();
+    // Only saved again when the plugin changed since it was saved last
+    snapshot.state = AudioEngine::instance()->stateStore().put(plugin.saveStateBlob());
+    snapshot.baseStateVersion = plugin.baseStateVersion();
+    snapshot.isBypassed = plugin.isByPassed();
+
+    if (const auto* parameters = plugin.parameters())
+    {
+        snapshot.ids = parameters->ids();
+        snapshot.values = parameters->values();
+    }
+
+    return snapshot;
+}
+
+bool Snapshots::apply(PluginHost& plugin, const PluginSnapshot& snapshot)
+{
+    if (plugin.path() != snapshot.path || plugin.index() != snapshot.index)
+    {
+        qWarning() << "Snapshots: not the plugin the snapshot was taken of," << plugin.name();
+        return false;
+    }
+
+    const bool hasLoadedState = plugin.baseStateVersion() != snapshot.baseStateVersion;
+
+    if (hasLoadedState)
+    {
+        plugin.loadStateBlob(snapshot.state? snapshot.state->data() : QByteArray{});
+        plugin.setBaseStateVersion(snapshot.baseStateVersion);
+    }
+    else if (auto* parameters = plugin.parameters())
+    {
+        // The rest of the state is the same, so the values are all there is to set; the
+        // model skips those that didn't change
+        for (std::size_t i = 0; i < snapshot.ids.size(); ++i)
+            parameters->setValue(snapshot.ids[i], snapshot.values[i]);
+    }
+
+    // Last, so a placeholder switched back on loads with the state it was just given
+    plugin.setIsByPassed(snapshot.isBypassed);
+
+    return hasLoadedState;
+}
+
+void Snapshots::measureLatency()
+{
+    m_pendingPlugins.removeIf([](const QPointer<PluginHost>& plugin)
+    {
+        return plugin.isNull() || !plugin->hasQueuedParamValues();
+    });
+
+    const auto elapsed = std::chrono::steady_clock::now() - m_recallStart;
+
+    // Given up on after a second, the engine might have stopped in between
+    if (!m_pendingPlugins.isEmpty() && elapsed < std::chrono::seconds{1})
+    {
+        if (!m_latencyTimer.isActive())
+            m_latencyTimer.start();
+
+        return;
+    }
+
+    m_latencyTimer.stop();
+    m_pendingPlugins.clear();
+
+    m_recallLatency = std::chrono::duration<double, std::milli>(elapsed).count();
+    emit recalled();
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+#include <clap/id.h>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+#include "Utils/StateStore.h"
+
+
+class Node;
+class PluginHost;
+
+
+// A/B/C slots for a plugin, or for a whole strip's plugins, held in memory to compare
+// settings without going through session files. Recalling is cheap when it can be:
+// a plugin whose state only differs from the slot's in parameter values gets just the
+// values that differ, through the same queue the GUI uses (or params.flush while
+// it's not processing); only the rest gets its state loaded back. Bypass is part of
+// a snapshot, the plugins' and a strip's own. The time from a recall until the audio
+// thread picked up every value is recallLatency.
+class Snapshots final : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(int revision READ revision NOTIFY changed)
+    Q_PROPERTY(double recallLatency READ recallLatency NOTIFY recalled)
+    Q_PROPERTY(int loadedStateCount READ loadedStateCount NOTIFY recalled)
+
+
+  public:
+    static constexpr int slotCount = 3;
+
+    explicit Snapshots(QObject* parent = nullptr);
+    Snapshots(Snapshots&) = delete;
+    Snapshots(Snapshots&&) = delete;
+    Snapshots(const Snapshots&) = delete;
+    Snapshots(const Snapshots&&) = delete;
+
+    // Bumped on every capture and recall, for bindings on the invokables below
+    [[nodiscard]] int revision() const { return m_revision; }
+
+    // Of the last recall, in milliseconds
+    [[nodiscard]] double recallLatency() const { return m_recallLatency; }
+    // How many plugins of the last recall needed their state loaded
+    [[nodiscard]] int loadedStateCount() const { return m_loadedStateCount; }
+
+    [[nodiscard]] Q_INVOKABLE bool hasSnapshot(Node* node, int slot) const;
+    // The slot last captured or recalled for the node, -1 for none
+    [[nodiscard]] Q_INVOKABLE int currentSlot(Node* node) const;
+
+    // What was captured of a node goes to the one that takes its place, a placeholder's
+    // to the plugin it's swapped for say
+    void transfer(const Node* from, Node* to);
+
+
+  public slots:
+    void capture(Node* node, int slot);
+    void recall(Node* node, int slot);
+    // The node last captured or recalled goes to its next slot that has a snapshot
+    void toggle();
+
+    void clear();
+
+
+  signals:
+    void changed();
+    void recalled();
+
+
+  private:
+    struct PluginSnapshot
+    {
+        QString path;
+        uint32_t index = 0;
+        StateStore::Ref state;
+        quint64 baseStateVersion = 0;
+        std::vector<clap_id> ids;
+        std::vector<double> values;
+        bool isBypassed = false;
+    };
+
+    // For a plugin one snapshot, for a strip one per plugin in it, in order
+    struct Slot
+    {
+        bool isFilled = false;
+        std::vector<PluginSnapshot> plugins;
+        double outputVolume = 1.0;
+        bool isBypassed = false;
+    };
+
+    struct NodeSlots
+    {
+        std::array<Slot, slotCount> slots;
+        int currentSlot = -1;
+    };
+
+    std::unordered_map<const Node*, NodeSlots> m_nodes;
+    QPointer<Node> m_lastNode;
+    int m_revision = 0;
+
+    double m_recallLatency = 0.0;
+    int m_loadedStateCount = 0;
+    std::chrono::steady_clock::time_point m_recallStart;
+    // Plugins whose recalled values are on their way to the audio thread
+    QList<QPointer<PluginHost>> m_pendingPlugins;
+    QTimer m_latencyTimer;
+
+    [[nodiscard]] static PluginSnapshot snapshotOf(PluginHost& plugin);
+    // Whether it had to load the state, rather than only set parameter values
+    bool apply(PluginHost& plugin, const PluginSnapshot& snapshot);
+    void measureLatency();
+};
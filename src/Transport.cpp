@@ -0,0 +1,356 @@
+#include "Transport.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <QJsonArray>
+#include "Utils/EpochReclaimer.h"
+
+
+namespace
+{
+
+// Seconds it takes to play `beats` from a point at `tempo`, the tempo changing by `slope` per beat
+double segmentSeconds(const double tempo, const double slope, const double beats)
+{
+    if (std::abs(slope) < 1e-12)
+        return 60.0 * beats / tempo;
+
+    return 60.0 / slope * std::log((tempo + slope * beats) / tempo);
+}
+
+clap_beattime toBeatTime(const double beats)
+{
+    return static_cast<clap_beattime>(std::llround(static_cast<double>(CLAP_BEATTIME_FACTOR) * beats));
+}
+
+clap_sectime toSecTime(const double seconds)
+{
+    return static_cast<clap_sectime>(std::llround(static_cast<double>(CLAP_SECTIME_FACTOR) * seconds));
+}
+
+}
+
+
+Transport::Transport(QObject* parent) : QObject{parent}
+{
+    setTempoMap({{0.0, 120.0, false}});
+
+    // Runs while playing, and once more after, for where the last block left it
+    m_positionTimer.setInterval(50);
+    connect(&m_positionTimer, &QTimer::timeout, this, [this]()
+    {
+        if (!m_isPlaying.load())
+            m_positionTimer.stop();
+
+        if (const auto position = songPosition(); position != m_lastNotifiedPosition)
+        {
+            m_lastNotifiedPosition = position;
+            emit songPositionChanged();
+        }
+    });
+}
+
+Transport::~Transport()
+{
+    m_audioTempoMap.store(nullptr);
+}
+
+void Transport::setIsPlaying(const bool value)
+{
+    if (m_isPlaying.exchange(value) == value)
+        return;
+
+    if (value)
+        m_positionTimer.start();
+
+    emit isPlayingChanged();
+}
+
+double Transport::bpm() const
+{
+    return m_tempoMap->points.front().bpm;
+}
+
+void Transport::setBpm(const double newBpm)
+{
+    if (qFuzzyCompare(newBpm, bpm()))
+        return;
+
+    auto points = m_tempoMap->points;
+    points.front().bpm = newBpm;
+    setTempoMap(std::move(points));
+}
+
+const std::vector<Transport::TempoPoint>& Transport::tempoMap() const
+{
+    return m_tempoMap->points;
+}
+
+void Transport::setTempoMap(std::vector<TempoPoint> points)
+{
+    std::ranges::stable_sort(points, {}, &TempoPoint::beat);
+
+    auto tempoMap = std::make_shared<TempoMap>();
+    tempoMap->points.reserve(points.size() + 1);
+
+    for (auto point : points)
+    {
+        point.beat = std::max(point.beat, 0.0);
+        point.bpm = std::clamp(point.bpm, 1.0, 999.0);
+
+        // Of several points on the same beat, the last one wins
+        if (!tempoMap->points.empty() && tempoMap->points.back().beat == point.beat)
+            tempoMap->points.back() = point;
+        else
+            tempoMap->points.push_back(point);
+    }
+
+    if (tempoMap->points.empty())
+        tempoMap->points.push_back({});
+
+    if (tempoMap->points.front().beat > 0.0)
+        tempoMap->points.insert(tempoMap->points.begin(), {0.0, tempoMap->points.front().bpm, false});
+
+    tempoMap->seconds.resize(tempoMap->points.size());
+    for (std::size_t i = 1; i < tempoMap->points.size(); ++i)
+    {
+        const auto& previous = tempoMap->points[i - 1];
+        tempoMap->seconds[i] = tempoMap->seconds[i - 1]
+            + segmentSeconds(previous.bpm, tempoMap->slopeOf(i - 1), tempoMap->points[i].beat - previous.beat);
+    }
+
+    m_audioTempoMap.store(tempoMap.get(), std::memory_order_release);
+
+    // Snapshots handed out keep theirs alive for as long as they need it
+    if (auto oldTempoMap = std::exchange(m_tempoMap, std::move(tempoMap)))
+        EpochReclaimer::instance()->retire([oldTempoMap]() {});
+
+    emit tempoMapChanged();
+}
+
+void Transport::setTimeSignatureNumerator(const int value)
+{
+    if (value < 1 || value > 32 || m_timeSignatureNumerator.exchange(value) == value)
+        return;
+
+    emit timeSignatureChanged();
+}
+
+void Transport::setTimeSignatureDenominator(const int value)
+{
+    // Whole, half, quarter... notes
+    if (value < 1 || value > 32 || (value & (value - 1)) != 0 || m_timeSignatureDenominator.exchange(value) == value)
+        return;
+
+    emit timeSignatureChanged();
+}
+
+void Transport::setIsLooping(const bool value)
+{
+    if (m_isLooping.exchange(value) == value)
+        return;
+
+    emit loopChanged();
+}
+
+void Transport::setLoopStart(const double beat)
+{
+    m_loopStart.store(std::max(beat, 0.0));
+    emit loopChanged();
+}
+
+void Transport::setLoopEnd(const double beat)
+{
+    m_loopEnd.store(std::max(beat, 0.0));
+    emit loopChanged();
+}
+
+void Transport::seek(const double beat)
+{
+    const auto target = std::max(beat, 0.0);
+
+    m_seekTarget.store(target, std::memory_order_relaxed);
+    m_seekCount.fetch_add(1, std::memory_order_release);
+
+    // Shows up right away, whether or not the audio thread is running
+    m_publishedPosition.store(target, std::memory_order_relaxed);
+    m_lastNotifiedPosition = target;
+    emit songPositionChanged();
+}
+
+QJsonObject Transport::getState() const
+{
+    QJsonObject transportJson;
+    transportJson["bpm"] = bpm();
+    transportJson["timeSignatureNumerator"] = timeSignatureNumerator();
+    transportJson["timeSignatureDenominator"] = timeSignatureDenominator();
+    transportJson["isLooping"] = isLooping();
+    transportJson["loopStart"] = loopStart();
+    transportJson["loopEnd"] = loopEnd();
+
+    if (tempoMap().size() > 1)
+    {
+        QJsonArray tempoMapJson;
+        for (const auto& point : tempoMap())
+        {
+            QJsonObject pointJson;
+            pointJson["beat"] = point.beat;
+            pointJson["bpm"] = point.bpm;
+            pointJson["isRamp"] = point.isRamp;
+
+            tempoMapJson.append(pointJson);
+        }
+
+        transportJson["tempoMap"] = tempoMapJson;
+    }
+
+    return transportJson;
+}
+
+void Transport::loadState(const QJsonObject& stateToLoad)
+{
+    std::vector<TempoPoint> points;
+
+    for (const auto tempoMapJson = stateToLoad["tempoMap"].toArray(); const auto& pointRef : tempoMapJson)
+    {
+        const auto pointJson = pointRef.toObject();
+        points.push_back({pointJson["beat"].toDouble(), pointJson["bpm"].toDouble(120.0), pointJson["isRamp"].toBool()});
+    }
+
+    if (points.empty())
+        points.push_back({0.0, stateToLoad["bpm"].toDouble(120.0), false});
+
+    setIsPlaying(false);
+    setTempoMap(std::move(points));
+    setTimeSignatureNumerator(stateToLoad["timeSignatureNumerator"].toInt(4));
+    setTimeSignatureDenominator(stateToLoad["timeSignatureDenominator"].toInt(4));
+    setLoopStart(stateToLoad["loopStart"].toDouble(0.0));
+    setLoopEnd(stateToLoad["loopEnd"].toDouble(16.0));
+    setIsLooping(stateToLoad["isLooping"].toBool());
+    seek(0.0);
+}
+
+void Transport::advance(const std::int32_t sampleRate, const std::uint32_t frameCount) noexcept
+{
+    const auto* tempoMap = m_audioTempoMap.load(std::memory_order_acquire);
+    if (!tempoMap || sampleRate <= 0)
+        return;
+
+    if (const auto seekCount = m_seekCount.load(std::memory_order_acquire); seekCount != m_seenSeekCount)
+    {
+        m_seenSeekCount = seekCount;
+        m_position = m_seekTarget.load(std::memory_order_relaxed);
+    }
+
+    const bool isPlaying = m_isPlaying.load(std::memory_order_relaxed);
+    const auto loopStart = m_loopStart.load(std::memory_order_relaxed);
+    const auto loopEnd = m_loopEnd.load(std::memory_order_relaxed);
+    const bool isLooping = m_isLooping.load(std::memory_order_relaxed) && loopEnd > loopStart;
+    const auto numerator = m_timeSignatureNumerator.load(std::memory_order_relaxed);
+    const auto denominator = m_timeSignatureDenominator.load(std::memory_order_relaxed);
+
+    const auto tempo = tempoMap->tempoAt(m_position);
+    const auto seconds = tempoMap->secondsAt(m_position);
+
+    // Where this block ends, through whatever tempo changes are in it
+    auto nextPosition = m_position;
+    if (isPlaying)
+        nextPosition = tempoMap->beatAt(seconds + static_cast<double>(frameCount) / sampleRate);
+
+    auto& ev = m_event;
+    ev.header.size = sizeof(ev);
+    ev.header.time = 0;
+    ev.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+    ev.header.type = CLAP_EVENT_TRANSPORT;
+    ev.header.flags = 0;
+
+    ev.flags = CLAP_TRANSPORT_HAS_TEMPO
+             | CLAP_TRANSPORT_HAS_BEATS_TIMELINE
+             | CLAP_TRANSPORT_HAS_SECONDS_TIMELINE
+             | CLAP_TRANSPORT_HAS_TIME_SIGNATURE;
+
+    if (isPlaying)
+        ev.flags |= CLAP_TRANSPORT_IS_PLAYING;
+
+    if (isLooping)
+        ev.flags |= CLAP_TRANSPORT_IS_LOOP_ACTIVE;
+
+    ev.song_pos_beats = toBeatTime(m_position);
+    ev.song_pos_seconds = toSecTime(seconds);
+
+    // Per sample, so a plugin can follow a ramp within the block
+    ev.tempo = tempo;
+    ev.tempo_inc = isPlaying && frameCount > 0? (tempoMap->tempoAt(nextPosition) - tempo) / frameCount : 0.0;
+
+    ev.loop_start_beats = toBeatTime(loopStart);
+    ev.loop_end_beats = toBeatTime(loopEnd);
+    ev.loop_start_seconds = toSecTime(tempoMap->secondsAt(loopStart));
+    ev.loop_end_seconds = toSecTime(tempoMap->secondsAt(loopEnd));
+
+    const auto beatsPerBar = numerator * 4.0 / denominator;
+    const auto barNumber = std::floor(m_position / beatsPerBar);
+    ev.bar_start = toBeatTime(barNumber * beatsPerBar);
+    ev.bar_number = static_cast<std::int32_t>(barNumber);
+    ev.tsig_num = static_cast<std::uint16_t>(numerator);
+    ev.tsig_denom = static_cast<std::uint16_t>(denominator);
+
+    // Loops wrap on block boundaries, whatever went past the end carries over
+    if (isLooping && m_position < loopEnd && nextPosition >= loopEnd)
+        nextPosition = loopStart + std::fmod(nextPosition - loopEnd, loopEnd - loopStart);
+
+    m_position = nextPosition;
+    m_publishedPosition.store(m_position, std::memory_order_relaxed);
+}
+
+std::size_t Transport::TempoMap::segmentAt(const double beat) const noexcept
+{
+    const auto next = std::ranges::upper_bound(points, beat, {}, &TempoPoint::beat);
+    return next == points.begin()? 0 : static_cast<std::size_t>(next - points.begin()) - 1;
+}
+
+std::size_t Transport::TempoMap::segmentAtSeconds(const double time) const noexcept
+{
+    const auto next = std::ranges::upper_bound(seconds, time);
+    return next == seconds.begin()? 0 : static_cast<std::size_t>(next - seconds.begin()) - 1;
+}
+
+double Transport::TempoMap::slopeOf(const std::size_t segment) const noexcept
+{
+    if (segment + 1 >= points.size() || !points[segment].isRamp)
+        return 0.0;
+
+    const auto& from = points[segment];
+    const auto& to = points[segment + 1];
+
+    return (to.bpm - from.bpm) / (to.beat - from.beat);
+}
+
+double Transport::TempoMap::tempoAt(const double beat) const noexcept
+{
+    const auto segment = segmentAt(beat);
+    const auto& point = points[segment];
+
+    return point.bpm + slopeOf(segment) * (beat - point.beat);
+}
+
+double Transport::TempoMap::secondsAt(const double beat) const noexcept
+{
+    const auto segment = segmentAt(beat);
+    const auto& point = points[segment];
+
+    return seconds[segment] + segmentSeconds(point.bpm, slopeOf(segment), beat - point.beat);
+}
+
+double Transport::TempoMap::beatAt(const double time) const noexcept
+{
+    const auto segment = segmentAtSeconds(time);
+    const auto& point = points[segment];
+    const auto slope = slopeOf(segment);
+    const auto elapsed = time - seconds[segment];
+
+    if (std::abs(slope) < 1e-12)
+        return point.beat + elapsed * point.bpm / 60.0;
+
+    // The inverse of segmentSeconds()
+    return point.beat + point.bpm * (std::exp(slope * elapsed / 60.0) - 1.0) / slope;
+}
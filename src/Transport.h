@@ -0,0 +1,137 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <clap/events.h>
+#include <QJsonObject>
+#include <QObject>
+#include <QTimer>
+
+
+// The one song position everything plays along to. The audio thread advances it
+// once per block, before any node runs, into a clap_event_transport that every
+// plugin gets a pointer to; the main thread asks for play, stop, seeks and loops
+// through atomics and publishes tempo maps the same way the other audio thread
+// tables are published, by swapping in an immutable copy.
+class Transport final : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool isPlaying READ isPlaying WRITE setIsPlaying NOTIFY isPlayingChanged)
+    Q_PROPERTY(double bpm READ bpm WRITE setBpm NOTIFY tempoMapChanged)
+    Q_PROPERTY(int timeSignatureNumerator READ timeSignatureNumerator WRITE setTimeSignatureNumerator NOTIFY timeSignatureChanged)
+    Q_PROPERTY(int timeSignatureDenominator READ timeSignatureDenominator WRITE setTimeSignatureDenominator NOTIFY timeSignatureChanged)
+    Q_PROPERTY(bool isLooping READ isLooping WRITE setIsLooping NOTIFY loopChanged)
+    Q_PROPERTY(double loopStart READ loopStart WRITE setLoopStart NOTIFY loopChanged)
+    Q_PROPERTY(double loopEnd READ loopEnd WRITE setLoopEnd NOTIFY loopChanged)
+    Q_PROPERTY(double songPosition READ songPosition WRITE seek NOTIFY songPositionChanged)
+
+
+  public:
+    // From its beat on, the tempo stays at bpm, or with isRamp goes in a straight
+    // line (over beats) to the next point's
+    struct TempoPoint
+    {
+        double beat = 0.0;
+        double bpm = 120.0;
+        bool isRamp = false;
+    };
+
+    // Immutable once published, points sorted by beat and the first one at beat 0
+    struct TempoMap
+    {
+        std::vector<TempoPoint> points;
+        // Where each point falls on the seconds timeline
+        std::vector<double> seconds;
+
+        [[nodiscard]] std::size_t segmentAt(double beat) const noexcept;
+        [[nodiscard]] std::size_t segmentAtSeconds(double time) const noexcept;
+        // How much the tempo changes per beat in a segment, 0 when it doesn't ramp
+        [[nodiscard]] double slopeOf(std::size_t segment) const noexcept;
+
+        [[nodiscard]] double tempoAt(double beat) const noexcept;
+        [[nodiscard]] double secondsAt(double beat) const noexcept;
+        [[nodiscard]] double beatAt(double time) const noexcept;
+    };
+
+    explicit Transport(QObject* parent = nullptr);
+    ~Transport() override;
+    Transport(Transport&) = delete;
+    Transport(Transport&&) = delete;
+    Transport(const Transport&) = delete;
+    Transport(const Transport&&) = delete;
+
+    [[nodiscard]] bool isPlaying() const { return m_isPlaying.load(); }
+    void setIsPlaying(bool value);
+
+    // The tempo at the start of the song, what a map with a single point plays at
+    [[nodiscard]] double bpm() const;
+    void setBpm(double newBpm);
+
+    [[nodiscard]] const std::vector<TempoPoint>& tempoMap() const;
+    void setTempoMap(std::vector<TempoPoint> points);
+
+    // For timing things against the tempo map away from the main thread
+    [[nodiscard]] std::shared_ptr<const TempoMap> tempoMapSnapshot() const { return m_tempoMap; }
+
+    [[nodiscard]] int timeSignatureNumerator() const { return m_timeSignatureNumerator.load(); }
+    void setTimeSignatureNumerator(int value);
+    [[nodiscard]] int timeSignatureDenominator() const { return m_timeSignatureDenominator.load(); }
+    void setTimeSignatureDenominator(int value);
+
+    [[nodiscard]] bool isLooping() const { return m_isLooping.load(); }
+    void setIsLooping(bool value);
+    [[nodiscard]] double loopStart() const { return m_loopStart.load(); }
+    void setLoopStart(double beat);
+    [[nodiscard]] double loopEnd() const { return m_loopEnd.load(); }
+    void setLoopEnd(double beat);
+
+    // In beats, as of the last block
+    [[nodiscard]] double songPosition() const { return m_publishedPosition.load(std::memory_order_relaxed); }
+
+    [[nodiscard]] QJsonObject getState() const;
+    void loadState(const QJsonObject& stateToLoad);
+
+    // audio thread, once per block before anything processes
+    void advance(std::int32_t sampleRate, std::uint32_t frameCount) noexcept;
+    [[nodiscard]] const clap_event_transport* event() const noexcept { return &m_event; }
+
+
+  public slots:
+    void play() { setIsPlaying(true); }
+    void stop() { setIsPlaying(false); }
+    void seek(double beat);
+
+
+  signals:
+    void isPlayingChanged();
+    void tempoMapChanged();
+    void timeSignatureChanged();
+    void loopChanged();
+    void songPositionChanged();
+
+
+  private:
+    std::atomic<bool> m_isPlaying = false;
+    std::atomic<int> m_timeSignatureNumerator = 4;
+    std::atomic<int> m_timeSignatureDenominator = 4;
+    std::atomic<bool> m_isLooping = false;
+    std::atomic<double> m_loopStart = 0.0;
+    std::atomic<double> m_loopEnd = 16.0;
+
+    // Seeks are counted, so the audio thread can tell a new one from the last it took
+    std::atomic<double> m_seekTarget = 0.0;
+    std::atomic<std::uint32_t> m_seekCount = 0;
+
+    std::shared_ptr<const TempoMap> m_tempoMap;
+    std::atomic<const TempoMap*> m_audioTempoMap = nullptr;
+
+    std::atomic<double> m_publishedPosition = 0.0;
+    double m_lastNotifiedPosition = 0.0;
+    QTimer m_positionTimer;
+
+    // audio thread only
+    double m_position = 0.0;
+    std::uint32_t m_seenSeekCount = 0;
+    clap_event_transport m_event = {};
+};
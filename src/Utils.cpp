@@ -1,9 +1,13 @@
 #include "Utils.h"
+#include <fstream>
 #include <iostream>
 #include <vector>
 #if __APPLE__
 #include <dlfcn.h>
+#include <mach/mach.h>
 #include <CoreFoundation/CoreFoundation.h>
+#else
+#include <unistd.h>
 #endif
 
 namespace ocp
@@ -65,6 +69,42 @@ void releaseHandle(void* handle)
         std::cerr << "Failed to unload bundle: " << dlerror() << std::endl;
 }
 
+void readAhead(const std::filesystem::path& path)
+{
+    const auto binaryPath = findBinaryInAppBundle(path);
+
+    std::ifstream file{binaryPath.empty()? path : binaryPath, std::ios::binary};
+    if (!file)
+        return;
+
+    std::vector<char> chunk(1024 * 1024);
+    while (file.read(chunk.data(), static_cast<std::streamsize>(chunk.size())))
+    {
+    }
+}
+
+std::size_t residentMemoryBytes()
+{
+#if __APPLE__
+    mach_task_basic_info info{};
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS)
+        return 0;
+
+    return info.resident_size;
+#else
+    std::size_t totalPages = 0;
+    std::size_t residentPages = 0;
+
+    std::ifstream statm{"/proc/self/statm"};
+    if (!(statm >> totalPages >> residentPages))
+        return 0;
+
+    return residentPages * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
 clap_window makeClapWindow(WId window)
 {
     clap_window w{};
@@ -21,6 +21,11 @@ clap_plugin_entry* clapEntryFromHandle(void* handle);
 
 void releaseHandle(void* handle);
 
+// Reads a plugin's binary through once, so that opening it doesn't wait on the disk
+void readAhead(const std::filesystem::path& path);
+
+std::size_t residentMemoryBytes();
+
 clap_window makeClapWindow(WId window);
 
 }
@@ -0,0 +1,97 @@
+#include "EpochReclaimer.h"
+#include <thread>
+#include <QtDebug>
+
+
+EpochReclaimer* EpochReclaimer::instance()
+{
+    static EpochReclaimer inst;
+
+    return &inst;
+}
+
+EpochReclaimer::EpochReclaimer() : QObject{nullptr}
+{
+    m_collectTimer.setInterval(100);
+    connect(&m_collectTimer, &QTimer::timeout, this, &EpochReclaimer::collect);
+}
+
+EpochReclaimer::~EpochReclaimer()
+{
+    m_isAudioThreadActive = false;
+    collect();
+}
+
+void EpochReclaimer::setIsAudioThreadActive(const bool value)
+{
+    m_isAudioThreadActive = value;
+
+    if (!value)
+        collect();
+}
+
+void EpochReclaimer::retire(std::function<void()> reclaim)
+{
+    m_retired.push_back({m_epoch.load(std::memory_order_acquire), std::move(reclaim)});
+
+    if (!m_isAudioThreadActive)
+    {
+        collect();
+        return;
+    }
+
+    if (!m_collectTimer.isActive())
+        m_collectTimer.start();
+}
+
+void EpochReclaimer::collect()
+{
+    const auto currentEpoch = m_epoch.load(std::memory_order_acquire);
+    const bool isAudioThreadActive = m_isAudioThreadActive;
+
+    // Reclaiming may retire more things (an instance releasing its library),
+    // so pop one at a time instead of iterating
+    while (!m_retired.empty())
+    {
+        if (isAudioThreadActive && m_retired.front().epoch >= currentEpoch)
+            break;
+
+        auto reclaim = std::move(m_retired.front().reclaim);
+        m_retired.pop_front();
+
+        if (reclaim)
+            reclaim();
+    }
+
+    if (m_retired.empty())
+        m_collectTimer.stop();
+}
+
+bool EpochReclaimer::synchronize()
+{
+    if (m_isAudioThreadActive)
+    {
+        const auto epochToWaitFor = m_epoch.load(std::memory_order_acquire) + 1;
+
+        // Bounded so a stalled audio device can't hang the GUI forever
+        for (int i = 0; i < 500 && m_isAudioThreadActive; ++i)
+        {
+            if (m_epoch.load(std::memory_order_acquire) >= epochToWaitFor)
+                break;
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        // The audio thread might still be in there; what's retired stays retired and
+        // gets collected once it moves on
+        if (m_isAudioThreadActive && m_epoch.load(std::memory_order_acquire) < epochToWaitFor)
+        {
+            qWarning() << "EpochReclaimer::synchronize: the audio thread didn't advance in time," << m_retired.size()
+                       << "retired objects left for later";
+            return false;
+        }
+    }
+
+    collect();
+    return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <QObject>
+#include <QTimer>
+
+
+// Defers destruction of anything the audio thread might still be touching.
+// The audio thread advances the epoch once per callback; an object retired at
+// epoch N is reclaimed (on the main thread) once the epoch has moved past N,
+// meaning the callback that could have seen it has finished.
+class EpochReclaimer final : public QObject
+{
+    Q_OBJECT
+
+
+  public:
+    static EpochReclaimer* instance();
+    ~EpochReclaimer() override;
+    EpochReclaimer(EpochReclaimer&) = delete;
+    EpochReclaimer(EpochReclaimer&&) = delete;
+    EpochReclaimer(const EpochReclaimer&) = delete;
+    EpochReclaimer(const EpochReclaimer&&) = delete;
+
+    // audio thread
+    void advance() noexcept { m_epoch.fetch_add(1, std::memory_order_acq_rel); }
+
+    // main thread
+    void setIsAudioThreadActive(bool value);
+    void retire(std::function<void()> reclaim);
+    void collect();
+    // Waits for the audio thread to finish its current callback and collects; false
+    // when it didn't in time, with everything still retired
+    bool synchronize();
+
+    [[nodiscard]] std::size_t pendingCount() const { return m_retired.size(); }
+
+
+  private:
+    EpochReclaimer();
+
+    struct Retired
+    {
+        std::uint64_t epoch = 0;
+        std::function<void()> reclaim;
+    };
+
+    std::atomic<std::uint64_t> m_epoch = 0;
+    std::atomic<bool> m_isAudioThreadActive = false;
+    std::deque<Retired> m_retired;
+    QTimer m_collectTimer;
+};
@@ -0,0 +1,142 @@
+#include "EventArena.h"
+#include <algorithm>
+#include <cstring>
+#include "EpochReclaimer.h"
+
+
+namespace
+{
+
+constexpr std::uint32_t eventAlignment = 8;
+
+// Leaves room for the biggest core events (transport, note expression) at an average of a cache line each
+constexpr std::uint32_t bytesPerEvent = 64;
+
+std::uint32_t alignedSize(const std::uint32_t size)
+{
+    return (size + eventAlignment - 1) & ~(eventAlignment - 1);
+}
+
+}
+
+
+EventArena::~EventArena()
+{
+    delete m_storage.exchange(nullptr);
+}
+
+void EventArena::reserve(const std::uint32_t eventCapacity, const std::uint32_t payloadCapacity)
+{
+    if (const auto* storage = m_storage.load();
+        storage && storage->eventCapacity >= eventCapacity && storage->payloadBytes >= payloadCapacity)
+        return;
+
+    auto* storage = new Storage;
+    storage->eventCapacity = eventCapacity;
+    storage->eventBytes = eventCapacity * bytesPerEvent;
+    storage->events = std::make_unique<CacheLine[]>(storage->eventBytes / sizeof(CacheLine));
+    storage->offsets = std::make_unique<std::uint32_t[]>(eventCapacity);
+    storage->payloadBytes = static_cast<std::uint32_t>((payloadCapacity + sizeof(CacheLine) - 1) / sizeof(CacheLine) * sizeof(CacheLine));
+    storage->payload = std::make_unique<CacheLine[]>(storage->payloadBytes / sizeof(CacheLine));
+
+    if (auto* oldStorage = m_storage.exchange(storage))
+        EpochReclaimer::instance()->retire([oldStorage]() { delete oldStorage; });
+}
+
+bool EventArena::push(const clap_event_header* event) noexcept
+{
+    auto* storage = m_storage.load(std::memory_order_acquire);
+    if (!event || !storage)
+    {
+        m_droppedEvents.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    const auto size = alignedSize(event->size);
+    if (storage->count == storage->eventCapacity || storage->usedEventBytes + size > storage->eventBytes)
+    {
+        m_droppedEvents.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    const bool isSysex = event->space_id == CLAP_CORE_EVENT_SPACE_ID && event->type == CLAP_EVENT_MIDI_SYSEX;
+    const auto* sysex = isSysex? reinterpret_cast<const clap_event_midi_sysex*>(event) : nullptr;
+
+    auto* payload = reinterpret_cast<std::byte*>(storage->payload.get()) + storage->usedPayloadBytes;
+    if (sysex)
+    {
+        if (storage->usedPayloadBytes + sysex->size > storage->payloadBytes)
+        {
+            m_droppedEvents.fetch_add(1, std::memory_order_relaxed);
+            m_droppedPayloadBytes.fetch_add(sysex->size, std::memory_order_relaxed);
+            return false;
+        }
+
+        std::memcpy(payload, sysex->buffer, sysex->size);
+        storage->usedPayloadBytes += alignedSize(sysex->size);
+    }
+
+    const auto offset = storage->usedEventBytes;
+    auto* destination = reinterpret_cast<std::byte*>(storage->events.get()) + offset;
+    std::memcpy(destination, event, event->size);
+    storage->usedEventBytes += size;
+
+    if (sysex)
+        reinterpret_cast<clap_event_midi_sysex*>(destination)->buffer = reinterpret_cast<const uint8_t*>(payload);
+
+    // Sources push in (mostly) ascending time, so this is usually just an append
+    auto* offsets = storage->offsets.get();
+    auto position = storage->count;
+    while (position > 0 && get(position - 1)->time > event->time)
+    {
+        offsets[position] = offsets[position - 1];
+        --position;
+    }
+
+    offsets[position] = offset;
+    ++storage->count;
+
+    return true;
+}
+
+void EventArena::clear() noexcept
+{
+    auto* storage = m_storage.load(std::memory_order_acquire);
+    if (!storage)
+        return;
+
+    storage->count = 0;
+    storage->usedEventBytes = 0;
+    storage->usedPayloadBytes = 0;
+}
+
+std::uint32_t EventArena::size() const noexcept
+{
+    const auto* storage = m_storage.load(std::memory_order_acquire);
+    return storage? storage->count : 0;
+}
+
+const clap_event_header* EventArena::get(const std::uint32_t index) const noexcept
+{
+    const auto* storage = m_storage.load(std::memory_order_acquire);
+    if (!storage || index >= storage->count)
+        return nullptr;
+
+    const auto* events = reinterpret_cast<const std::byte*>(storage->events.get());
+    return reinterpret_cast<const clap_event_header*>(events + storage->offsets[index]);
+}
+
+std::uint32_t EventArena::clapSize(const clap_input_events* list)
+{
+    return static_cast<const EventArena*>(list->ctx)->size();
+}
+
+const clap_event_header* EventArena::clapGet(const clap_input_events* list, const std::uint32_t index)
+{
+    return static_cast<const EventArena*>(list->ctx)->get(index);
+}
+
+bool EventArena::clapTryPush(const clap_output_events* list, const clap_event_header* event)
+{
+    return static_cast<EventArena*>(list->ctx)->push(event);
+}
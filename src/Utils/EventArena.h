@@ -0,0 +1,75 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <clap/events.h>
+
+
+// Fixed-capacity storage for the CLAP events of one block. Nothing is allocated on
+// push: events that don't fit are dropped and counted. Events are kept sorted by
+// time (stable for equal times), so an arena can be handed to a plugin as is or be
+// one of the sources of an EventMerger.
+//
+// SysEx bytes are copied into the arena's payload space and live until clear(), so
+// an event can outlive the buffer it was pushed from.
+class EventArena
+{
+  public:
+    EventArena() = default;
+    ~EventArena();
+    EventArena(EventArena&) = delete;
+    EventArena(EventArena&&) = delete;
+    EventArena(const EventArena&) = delete;
+    EventArena(const EventArena&&) = delete;
+
+    // Main thread; the old storage is reclaimed once the audio thread is done with it
+    void reserve(std::uint32_t eventCapacity, std::uint32_t payloadCapacity = 64 * 1024);
+
+    // audio thread
+    bool push(const clap_event_header* event) noexcept;
+    bool tryPush(const clap_event_header* event) noexcept { return push(event); }
+    void clear() noexcept;
+
+    [[nodiscard]] std::uint32_t size() const noexcept;
+    [[nodiscard]] const clap_event_header* get(std::uint32_t index) const noexcept;
+
+    [[nodiscard]] const clap_input_events* clapInputEvents() const noexcept { return &m_inputEvents; }
+    [[nodiscard]] const clap_output_events* clapOutputEvents() const noexcept { return &m_outputEvents; }
+
+    [[nodiscard]] std::uint64_t droppedEventCount() const noexcept { return m_droppedEvents.load(std::memory_order_relaxed); }
+    [[nodiscard]] std::uint64_t droppedPayloadBytes() const noexcept { return m_droppedPayloadBytes.load(std::memory_order_relaxed); }
+
+
+  private:
+    struct alignas(64) CacheLine
+    {
+        std::byte bytes[64];
+    };
+
+    struct Storage
+    {
+        std::unique_ptr<CacheLine[]> events;
+        std::uint32_t eventBytes = 0;
+        std::unique_ptr<std::uint32_t[]> offsets;
+        std::uint32_t eventCapacity = 0;
+        std::unique_ptr<CacheLine[]> payload;
+        std::uint32_t payloadBytes = 0;
+
+        std::uint32_t count = 0;
+        std::uint32_t usedEventBytes = 0;
+        std::uint32_t usedPayloadBytes = 0;
+    };
+
+    std::atomic<Storage*> m_storage = nullptr;
+
+    std::atomic<std::uint64_t> m_droppedEvents = 0;
+    std::atomic<std::uint64_t> m_droppedPayloadBytes = 0;
+
+    const clap_input_events m_inputEvents{this, &EventArena::clapSize, &EventArena::clapGet};
+    const clap_output_events m_outputEvents{this, &EventArena::clapTryPush};
+
+    static std::uint32_t clapSize(const clap_input_events* list);
+    static const clap_event_header* clapGet(const clap_input_events* list, std::uint32_t index);
+    static bool clapTryPush(const clap_output_events* list, const clap_event_header* event);
+};
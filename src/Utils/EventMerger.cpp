@@ -0,0 +1,93 @@
+#include "EventMerger.h"
+
+
+void EventMerger::reserve(const std::uint32_t eventCapacity)
+{
+    if (eventCapacity <= m_capacity)
+        return;
+
+    m_events = std::make_unique<const clap_event_header*[]>(eventCapacity);
+    m_capacity = eventCapacity;
+    clear();
+}
+
+void EventMerger::addSource(const clap_input_events* source) noexcept
+{
+    if (!source || m_sourceCount == maxSources)
+        return;
+
+    const auto size = source->size(source);
+    if (size == 0)
+        return;
+
+    m_sources[m_sourceCount] = source;
+    m_sizes[m_sourceCount] = size;
+    ++m_sourceCount;
+}
+
+void EventMerger::merge() noexcept
+{
+    for (std::size_t i = 0; i < m_sourceCount; ++i)
+        m_positions[i] = 0;
+
+    m_count = 0;
+    while (m_count < m_capacity && mergeNext()) {}
+
+    // The latest events are the ones that don't make it
+    std::uint64_t droppedEvents = 0;
+    for (std::size_t i = 0; i < m_sourceCount; ++i)
+        droppedEvents += m_sizes[i] - m_positions[i];
+
+    if (droppedEvents > 0)
+        m_droppedEvents.fetch_add(droppedEvents, std::memory_order_relaxed);
+}
+
+bool EventMerger::mergeNext() noexcept
+{
+    const clap_event_header* earliest = nullptr;
+    std::size_t earliestSource = 0;
+
+    // With a handful of sources a linear pick of the earliest head beats a heap;
+    // ties go to the earlier source so each source keeps its own order
+    for (std::size_t i = 0; i < m_sourceCount; ++i)
+    {
+        if (m_positions[i] == m_sizes[i])
+            continue;
+
+        const auto* event = m_sources[i]->get(m_sources[i], m_positions[i]);
+        if (!event)
+        {
+            m_positions[i] = m_sizes[i];
+            continue;
+        }
+
+        if (!earliest || event->time < earliest->time)
+        {
+            earliest = event;
+            earliestSource = i;
+        }
+    }
+
+    if (!earliest)
+        return false;
+
+    ++m_positions[earliestSource];
+    m_events[m_count++] = earliest;
+
+    return true;
+}
+
+const clap_event_header* EventMerger::get(const std::uint32_t index) const noexcept
+{
+    return index < m_count? m_events[index] : nullptr;
+}
+
+std::uint32_t EventMerger::clapSize(const clap_input_events* list)
+{
+    return static_cast<const EventMerger*>(list->ctx)->m_count;
+}
+
+const clap_event_header* EventMerger::clapGet(const clap_input_events* list, const std::uint32_t index)
+{
+    return static_cast<const EventMerger*>(list->ctx)->get(index);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <clap/events.h>
+
+
+// Presents several time-sorted event sources to a plugin as one sorted input list.
+// Only pointers to the sources' events are merged, the events themselves stay
+// where they are, so the sources have to outlive the merged list. The merge is done
+// up front, a block's worth of events from a handful of sources costs next to
+// nothing, and size() is then exactly what get() has an event for.
+class EventMerger
+{
+  public:
+    static constexpr std::size_t maxSources = 4;
+
+    // Main thread, while the owner isn't processing
+    void reserve(std::uint32_t eventCapacity);
+
+    // audio thread
+    void clear() noexcept { m_sourceCount = 0; m_count = 0; }
+    void addSource(const clap_input_events* source) noexcept;
+    void merge() noexcept;
+
+    [[nodiscard]] const clap_input_events* clapInputEvents() const noexcept { return &m_inputEvents; }
+
+    // Any thread
+    [[nodiscard]] std::uint64_t droppedEventCount() const noexcept { return m_droppedEvents.load(std::memory_order_relaxed); }
+
+
+  private:
+    std::array<const clap_input_events*, maxSources> m_sources{};
+    std::array<std::uint32_t, maxSources> m_positions{};
+    std::array<std::uint32_t, maxSources> m_sizes{};
+    std::size_t m_sourceCount = 0;
+
+    std::unique_ptr<const clap_event_header*[]> m_events;
+    std::uint32_t m_capacity = 0;
+    std::uint32_t m_count = 0;
+    std::atomic<std::uint64_t> m_droppedEvents = 0;
+
+    const clap_input_events m_inputEvents{this, &EventMerger::clapSize, &EventMerger::clapGet};
+
+    bool mergeNext() noexcept;
+    [[nodiscard]] const clap_event_header* get(std::uint32_t index) const noexcept;
+
+    static std::uint32_t clapSize(const clap_input_events* list);
+    static const clap_event_header* clapGet(const clap_input_events* list, std::uint32_t index);
+};
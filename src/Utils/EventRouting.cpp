@@ -0,0 +1,101 @@
+#include "EventRouting.h"
+#include "EventArena.h"
+
+
+bool ocp::isForwardedDownstream(const clap_event_header& event) noexcept
+{
+    if (event.space_id != CLAP_CORE_EVENT_SPACE_ID)
+        return false;
+
+    switch (event.type)
+    {
+        case CLAP_EVENT_NOTE_ON:
+        case CLAP_EVENT_NOTE_OFF:
+        case CLAP_EVENT_NOTE_CHOKE:
+        case CLAP_EVENT_NOTE_EXPRESSION:
+        case CLAP_EVENT_MIDI:
+        case CLAP_EVENT_MIDI_SYSEX:
+        case CLAP_EVENT_MIDI2:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+std::size_t ocp::midiMessageSize(const unsigned char status) noexcept
+{
+    switch (status & 0xF0)
+    {
+        case 0xC0:
+        case 0xD0:
+            return 2;
+
+        case 0xF0:
+            break;
+
+        default:
+            return 3;
+    }
+
+    switch (status)
+    {
+        case 0xF1:
+        case 0xF3:
+            return 2;
+
+        case 0xF2:
+            return 3;
+
+        default:
+            return 1;
+    }
+}
+
+
+void ForwardedEventView::reserve(const std::uint32_t eventCapacity)
+{
+    if (eventCapacity <= m_capacity)
+        return;
+
+    m_indices = std::make_unique<std::uint32_t[]>(eventCapacity);
+    m_capacity = eventCapacity;
+    reset(nullptr);
+}
+
+void ForwardedEventView::reset(const EventArena* source) noexcept
+{
+    m_source = source;
+    m_isIndexed = source == nullptr;
+    m_count = 0;
+}
+
+void ForwardedEventView::index() noexcept
+{
+    m_isIndexed = true;
+
+    const auto size = m_source->size();
+    for (std::uint32_t i = 0; i < size && m_count < m_capacity; ++i)
+    {
+        if (const auto* event = m_source->get(i); event && ocp::isForwardedDownstream(*event))
+            m_indices[m_count++] = i;
+    }
+}
+
+std::uint32_t ForwardedEventView::clapSize(const clap_input_events* list)
+{
+    auto* view = static_cast<ForwardedEventView*>(list->ctx);
+    if (!view->m_isIndexed)
+        view->index();
+
+    return view->m_count;
+}
+
+const clap_event_header* ForwardedEventView::clapGet(const clap_input_events* list, const std::uint32_t index)
+{
+    auto* view = static_cast<ForwardedEventView*>(list->ctx);
+    if (!view->m_isIndexed)
+        view->index();
+
+    return index < view->m_count? view->m_source->get(view->m_indices[index]) : nullptr;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <clap/events.h>
+
+class EventArena;
+
+
+namespace ocp
+{
+
+// Whether an event a plugin outputs is meant for whatever comes after it in a chain:
+// notes and MIDI are, while parameter values, gestures and anything outside the
+// core event space only make sense for the plugin that produced them
+[[nodiscard]] bool isForwardedDownstream(const clap_event_header& event) noexcept;
+
+// How many bytes a (non SysEx) MIDI 1.0 message with this status byte has
+[[nodiscard]] std::size_t midiMessageSize(unsigned char status) noexcept;
+
+}
+
+
+// The forwarded part of another node's output, read in place: only the indices of
+// the events that pass are kept, never the events
+class ForwardedEventView
+{
+  public:
+    // Main thread, while the owner isn't processing
+    void reserve(std::uint32_t eventCapacity);
+
+    // audio thread; the source has to stay untouched while the view is read
+    void reset(const EventArena* source) noexcept;
+
+    [[nodiscard]] const clap_input_events* clapInputEvents() const noexcept { return &m_inputEvents; }
+
+
+  private:
+    const EventArena* m_source = nullptr;
+    bool m_isIndexed = false;
+
+    std::unique_ptr<std::uint32_t[]> m_indices;
+    std::uint32_t m_capacity = 0;
+    std::uint32_t m_count = 0;
+
+    const clap_input_events m_inputEvents{this, &ForwardedEventView::clapSize, &ForwardedEventView::clapGet};
+
+    void index() noexcept;
+
+    static std::uint32_t clapSize(const clap_input_events* list);
+    static const clap_event_header* clapGet(const clap_input_events* list, std::uint32_t index);
+};
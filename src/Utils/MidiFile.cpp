@@ -0,0 +1,263 @@
+#include "MidiFile.h"
+#include <algorithm>
+#include <QFile>
+#include <QtDebug>
+#include "EventRouting.h"
+
+
+namespace
+{
+
+// Bounds-checked reads over a chunk, anything past its end reads as a failure
+class Reader
+{
+  public:
+    explicit Reader(const std::span<const unsigned char> bytes) : m_bytes{bytes} {}
+
+    [[nodiscard]] bool atEnd() const { return m_position >= m_bytes.size(); }
+    [[nodiscard]] bool hasFailed() const { return m_hasFailed; }
+
+    std::uint32_t readByte()
+    {
+        if (atEnd())
+        {
+            m_hasFailed = true;
+            return 0;
+        }
+
+        return m_bytes[m_position++];
+    }
+
+    std::uint32_t readBigEndian(const int byteCount)
+    {
+        std::uint32_t value = 0;
+        for (int i = 0; i < byteCount; ++i)
+            value = value << 8 | readByte();
+
+        return value;
+    }
+
+    // At most 4 bytes, 7 bits each, the top bit saying there's more
+    std::uint32_t readVariableLength()
+    {
+        std::uint32_t value = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            const auto byte = readByte();
+            value = value << 7 | (byte & 0x7F);
+
+            if (!(byte & 0x80))
+                return value;
+        }
+
+        m_hasFailed = true;
+        return value;
+    }
+
+    std::span<const unsigned char> readBytes(const std::size_t count)
+    {
+        if (count > m_bytes.size() - m_position)
+        {
+            m_hasFailed = true;
+            m_position = m_bytes.size();
+            return {};
+        }
+
+        const auto bytes = m_bytes.subspan(m_position, count);
+        m_position += count;
+
+        return bytes;
+    }
+
+    void skip(const std::size_t count) { (void)readBytes(count); }
+
+
+  private:
+    std::span<const unsigned char> m_bytes;
+    std::size_t m_position = 0;
+    bool m_hasFailed = false;
+};
+
+struct TrackEvent
+{
+    std::uint64_t tick = 0;
+    std::uint32_t message = 0;
+};
+
+bool parseTrack(Reader& track, std::vector<TrackEvent>& events, std::uint64_t& lengthInTicks)
+{
+    std::uint64_t tick = 0;
+    std::uint32_t runningStatus = 0;
+    bool isValid = true;
+
+    while (isValid && !track.atEnd() && !track.hasFailed())
+    {
+        tick += track.readVariableLength();
+
+        auto status = track.readByte();
+
+        // Running status: what was read is already the first data byte
+        std::uint32_t firstDataByte = 0;
+        const bool isRunningStatus = status < 0x80;
+        if (isRunningStatus)
+        {
+            if (runningStatus == 0)
+            {
+                isValid = false;
+                break;
+            }
+
+            firstDataByte = status;
+            status = runningStatus;
+        }
+
+        if (status == 0xFF)
+        {
+            const auto type = track.readByte();
+            track.skip(track.readVariableLength());
+
+            if (type == 0x2F)
+                break;
+
+            continue;
+        }
+
+        if (status == 0xF0 || status == 0xF7)
+        {
+            track.skip(track.readVariableLength());
+            runningStatus = 0;
+            continue;
+        }
+
+        // System common and realtime messages have no business in a file
+        if (status >= 0xF0)
+        {
+            isValid = false;
+            break;
+        }
+
+        runningStatus = status;
+
+        std::uint32_t message = status;
+        for (std::size_t i = 1; i < ocp::midiMessageSize(static_cast<unsigned char>(status)); ++i)
+        {
+            const auto dataByte = i == 1 && isRunningStatus? firstDataByte : track.readByte();
+            message |= (dataByte & 0x7F) << (8 * i);
+        }
+
+        if (track.hasFailed())
+            break;
+
+        events.push_back({tick, message});
+    }
+
+    lengthInTicks = std::max(lengthInTicks, tick);
+
+    return isValid && !track.hasFailed();
+}
+
+}
+
+
+std::optional<MidiFile> MidiFile::parse(const std::span<const unsigned char> bytes)
+{
+    Reader file{bytes};
+
+    if (file.readBigEndian(4) != 0x4D546864)  // MThd
+    {
+        qWarning() << "MidiFile: not a Standard MIDI File";
+        return std::nullopt;
+    }
+
+    const auto headerLength = file.readBigEndian(4);
+    const auto format = file.readBigEndian(2);
+    const auto trackCount = file.readBigEndian(2);
+    const auto division = file.readBigEndian(2);
+    file.skip(headerLength > 6? headerLength - 6 : 0);
+
+    if (file.hasFailed() || format > 1)
+    {
+        qWarning() << "MidiFile: unsupported format" << format;
+        return std::nullopt;
+    }
+
+    if (division & 0x8000 || division == 0)
+    {
+        qWarning() << "MidiFile: SMPTE time division isn't supported";
+        return std::nullopt;
+    }
+
+    MidiFile midiFile;
+    midiFile.ticksPerQuarter = static_cast<std::uint16_t>(division);
+
+    std::vector<TrackEvent> events;
+    // A rough guess, channel messages are mostly 3 or 4 bytes with their delta time
+    events.reserve(bytes.size() / 4);
+
+    // Each track comes out sorted, so they only need merging
+    std::vector<std::size_t> trackEnds;
+    trackEnds.reserve(trackCount);
+
+    for (std::uint32_t i = 0; i < trackCount && !file.atEnd(); ++i)
+    {
+        const auto chunkType = file.readBigEndian(4);
+        const auto chunk = file.readBytes(file.readBigEndian(4));
+
+        if (file.hasFailed())
+        {
+            qWarning() << "MidiFile: truncated at track" << i;
+            break;
+        }
+
+        // Unknown chunks are to be skipped
+        if (chunkType != 0x4D54726B)  // MTrk
+            continue;
+
+        Reader track{chunk};
+        if (!parseTrack(track, events, midiFile.lengthInTicks))
+            qWarning() << "MidiFile: track" << i << "is malformed, keeping what could be read";
+
+        trackEnds.push_back(events.size());
+    }
+
+    for (std::size_t i = 1; i < trackEnds.size(); ++i)
+    {
+        std::inplace_merge(events.begin(), events.begin() + static_cast<std::ptrdiff_t>(trackEnds[i - 1]),
+                           events.begin() + static_cast<std::ptrdiff_t>(trackEnds[i]),
+                           [](const TrackEvent& a, const TrackEvent& b) { return a.tick < b.tick; });
+    }
+
+    midiFile.ticks.resize(events.size());
+    midiFile.messages.resize(events.size());
+
+    for (std::size_t i = 0; i < events.size(); ++i)
+    {
+        midiFile.ticks[i] = events[i].tick;
+        midiFile.messages[i] = events[i].message;
+    }
+
+    return midiFile;
+}
+
+std::optional<MidiFile> MidiFile::load(const QString& path)
+{
+    QFile file{path};
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning() << "MidiFile: could not open" << path;
+        return std::nullopt;
+    }
+
+    // Only the pages we touch get read in, and nothing is copied
+    const auto size = file.size();
+    if (auto* mapped = file.map(0, size))
+    {
+        auto midiFile = parse({mapped, static_cast<std::size_t>(size)});
+        file.unmap(mapped);
+
+        return midiFile;
+    }
+
+    const auto contents = file.readAll();
+    return parse({reinterpret_cast<const unsigned char*>(contents.constData()), static_cast<std::size_t>(contents.size())});
+}
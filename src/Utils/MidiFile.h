@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+#include <QString>
+
+
+// The channel messages of a Standard MIDI File (format 0 or 1), every track merged
+// into one flat array sorted by tick. Meta events and SysEx are skipped, and so are
+// the file's own tempo changes: it's played in beats, against the engine's tempo map.
+struct MidiFile
+{
+    std::uint16_t ticksPerQuarter = 480;
+
+    std::vector<std::uint64_t> ticks;
+    // Status byte, then the data bytes in the next ones; the size follows from the status
+    std::vector<std::uint32_t> messages;
+
+    // Tick of the last event in any track, end of track included
+    std::uint64_t lengthInTicks = 0;
+
+    [[nodiscard]] static std::optional<MidiFile> parse(std::span<const unsigned char> bytes);
+
+    // Maps the file to memory instead of reading it
+    [[nodiscard]] static std::optional<MidiFile> load(const QString& path);
+};
@@ -0,0 +1,67 @@
+#include "MidiMessageRing.h"
+#include <algorithm>
+
+
+MidiMessageRing::MidiMessageRing(const std::uint32_t messageCapacity, const std::uint64_t byteCapacity)
+    : m_messageCapacity{messageCapacity}
+    , m_byteCapacity{byteCapacity}
+    , m_entries{std::make_unique<Entry[]>(messageCapacity)}
+    , m_bytes{std::make_unique<unsigned char[]>(byteCapacity)}
+{}
+
+bool MidiMessageRing::push(const std::int64_t time, const int port, const std::span<const unsigned char> data) noexcept
+{
+    if (data.empty())
+        return false;
+
+    const auto size = static_cast<std::uint32_t>(data.size());
+
+    // A message is never split: if it doesn't fit before the end of the ring, the
+    // rest of the ring is skipped
+    auto byteStart = m_byteTail;
+    if (const auto offset = byteStart % m_byteCapacity; offset + size > m_byteCapacity)
+        byteStart += m_byteCapacity - offset;
+
+    const auto tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == m_messageCapacity
+        || byteStart + size - m_byteHead.load(std::memory_order_acquire) > m_byteCapacity)
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    std::ranges::copy(data, &m_bytes[byteStart % m_byteCapacity]);
+    m_byteTail = byteStart + size;
+
+    auto& entry = m_entries[tail % m_messageCapacity];
+    entry.time = time;
+    entry.port = port;
+    entry.size = size;
+    entry.byteStart = byteStart;
+
+    m_tail.store(tail + 1, std::memory_order_release);
+
+    return true;
+}
+
+std::optional<MidiMessageRing::Message> MidiMessageRing::front() const noexcept
+{
+    const auto head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire))
+        return std::nullopt;
+
+    const auto& entry = m_entries[head % m_messageCapacity];
+
+    return Message{entry.time, entry.port, {&m_bytes[entry.byteStart % m_byteCapacity], entry.size}};
+}
+
+void MidiMessageRing::pop() noexcept
+{
+    const auto head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire))
+        return;
+
+    const auto& entry = m_entries[head % m_messageCapacity];
+    m_byteHead.store(entry.byteStart + entry.size, std::memory_order_release);
+    m_head.store(head + 1, std::memory_order_release);
+}
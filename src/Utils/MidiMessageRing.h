@@ -0,0 +1,57 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+
+
+// Single producer, single consumer queue of timestamped MIDI messages of any length.
+// The bytes go into a ring of their own, each message in one contiguous piece, so
+// a SysEx dump comes out as a single span. Nothing is allocated after construction;
+// what doesn't fit is dropped and counted.
+class MidiMessageRing
+{
+  public:
+    struct Message
+    {
+        std::int64_t time = 0;
+        int port = 0;
+        std::span<const unsigned char> data;
+    };
+
+    // messageCapacity has to be a power of two
+    explicit MidiMessageRing(std::uint32_t messageCapacity = 1024, std::uint64_t byteCapacity = 256 * 1024);
+
+    // producer
+    bool push(std::int64_t time, int port, std::span<const unsigned char> data) noexcept;
+
+    // consumer; the message's bytes stay valid until pop()
+    [[nodiscard]] std::optional<Message> front() const noexcept;
+    void pop() noexcept;
+
+    [[nodiscard]] std::uint64_t droppedCount() const noexcept { return m_dropped.load(std::memory_order_relaxed); }
+
+
+  private:
+    struct Entry
+    {
+        std::int64_t time = 0;
+        int port = 0;
+        std::uint32_t size = 0;
+        std::uint64_t byteStart = 0;
+    };
+
+    const std::uint32_t m_messageCapacity;
+    const std::uint64_t m_byteCapacity;
+
+    std::unique_ptr<Entry[]> m_entries;
+    std::atomic<std::uint32_t> m_head = 0;
+    std::atomic<std::uint32_t> m_tail = 0;
+
+    std::unique_ptr<unsigned char[]> m_bytes;
+    std::atomic<std::uint64_t> m_byteHead = 0;
+    std::uint64_t m_byteTail = 0;
+
+    std::atomic<std::uint64_t> m_dropped = 0;
+};
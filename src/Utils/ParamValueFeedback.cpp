@@ -0,0 +1,24 @@
+#include "ParamValueFeedback.h"
+
+
+ParamValueFeedback::ParamValueFeedback(const std::vector<clap_id>& ids)
+    : m_values{std::make_unique<std::atomic<double>[]>(ids.size())}
+    , m_dirtyWordCount{(ids.size() + 63) / 64}
+{
+    m_dirty = std::make_unique<std::atomic<std::uint64_t>[]>(m_dirtyWordCount);
+
+    m_rows.reserve(ids.size());
+    for (std::uint32_t row = 0; row < ids.size(); ++row)
+        m_rows.emplace(ids[row], row);
+}
+
+void ParamValueFeedback::publish(const clap_id id, const double value) noexcept
+{
+    const auto it = m_rows.find(id);
+    if (it == m_rows.end())
+        return;
+
+    const auto row = it->second;
+    m_values[row].store(value, std::memory_order_relaxed);
+    m_dirty[row / 64].fetch_or(std::uint64_t{1} << (row % 64), std::memory_order_release);
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <clap/id.h>
+
+
+// Parameter values reported by the plugin on the audio thread, picked up by the GUI
+// at its own pace. The audio thread only stores the value and sets the row's bit in
+// a dirty bitmap; the GUI takes whatever bits are set, so a parameter that changed a
+// hundred times since the last look is reported once, with its latest value.
+class ParamValueFeedback
+{
+  public:
+    explicit ParamValueFeedback(const std::vector<clap_id>& ids);
+
+    // audio thread
+    void publish(clap_id id, double value) noexcept;
+
+    // GUI thread: onValue(uint32_t row, double value), in ascending row order
+    template <typename Callback>
+    void collect(Callback&& onValue)
+    {
+        for (std::size_t word = 0; word < m_dirtyWordCount; ++word)
+        {
+            auto bits = m_dirty[word].exchange(0, std::memory_order_acquire);
+
+            while (bits != 0)
+            {
+                const auto row = static_cast<std::uint32_t>(word * 64 + std::countr_zero(bits));
+                bits &= bits - 1;
+
+                onValue(row, m_values[row].load(std::memory_order_relaxed));
+            }
+        }
+    }
+
+
+  private:
+    std::unordered_map<clap_id, std::uint32_t> m_rows;
+    std::unique_ptr<std::atomic<double>[]> m_values;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> m_dirty;
+    std::size_t m_dirtyWordCount = 0;
+};
@@ -0,0 +1,28 @@
+#include "ParamValueQueue.h"
+
+
+ParamValueQueue::ParamValueQueue(const std::uint32_t slotCount)
+    // One spare entry in the ring so that full and empty can be told apart
+    : m_capacity{slotCount + 1}
+    , m_slots{std::make_unique<Slot[]>(slotCount)}
+    , m_ring{std::make_unique<std::uint32_t[]>(slotCount + 1)}
+{}
+
+void ParamValueQueue::push(const std::uint32_t slot, const clap_id id, const double value,
+    const std::int64_t timeNs) noexcept
+{
+    if (slot >= slotCount())
+        return;
+
+    auto& paramSlot = m_slots[slot];
+    paramSlot.id.store(id, std::memory_order_relaxed);
+    paramSlot.timeNs.store(timeNs, std::memory_order_relaxed);
+    paramSlot.value.store(value);
+
+    if (paramSlot.isQueued.exchange(true))
+        return;
+
+    const auto tail = m_tail.load(std::memory_order_relaxed);
+    m_ring[tail] = slot;
+    m_tail.store((tail + 1) % m_capacity, std::memory_order_release);
+}
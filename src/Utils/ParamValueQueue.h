@@ -0,0 +1,63 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <clap/id.h>
+
+
+// Single producer (GUI thread), single consumer (audio thread) queue of parameter
+// values that only ever holds the latest value per parameter. Each parameter gets a
+// slot, and a slot is queued at most once until the consumer picks it up, so the
+// queue can't overflow and never allocates after construction.
+class ParamValueQueue
+{
+  public:
+    explicit ParamValueQueue(std::uint32_t slotCount);
+
+    // producer
+    void push(std::uint32_t slot, clap_id id, double value, std::int64_t timeNs) noexcept;
+
+    // consumer: onValue(clap_id id, double value, std::int64_t timeNs)
+    template <typename Callback>
+    void drain(Callback&& onValue) noexcept
+    {
+        auto head = m_head.load(std::memory_order_relaxed);
+        const auto tail = m_tail.load(std::memory_order_acquire);
+
+        while (head != tail)
+        {
+            auto& slot = m_slots[m_ring[head]];
+            head = (head + 1) % m_capacity;
+
+            // Cleared before reading, so a value pushed after the read queues the slot again
+            slot.isQueued.store(false);
+            onValue(slot.id.load(std::memory_order_relaxed), slot.value.load(), slot.timeNs.load(std::memory_order_relaxed));
+        }
+
+        m_head.store(head, std::memory_order_release);
+    }
+
+    [[nodiscard]] std::uint32_t slotCount() const noexcept { return m_capacity - 1; }
+
+    // Either side; from the producer, whether the consumer picked up everything pushed so far
+    [[nodiscard]] bool isEmpty() const noexcept
+    {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+
+  private:
+    struct Slot
+    {
+        std::atomic<clap_id> id = CLAP_INVALID_ID;
+        std::atomic<double> value = 0.0;
+        std::atomic<std::int64_t> timeNs = 0;
+        std::atomic<bool> isQueued = false;
+    };
+
+    std::uint32_t m_capacity;
+    std::unique_ptr<Slot[]> m_slots;
+    std::unique_ptr<std::uint32_t[]> m_ring;
+    std::atomic<std::uint32_t> m_head = 0;
+    std::atomic<std::uint32_t> m_tail = 0;
+};
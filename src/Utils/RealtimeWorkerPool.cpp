@@ -0,0 +1,170 @@
+#include "RealtimeWorkerPool.h"
+#include <QtDebug>
+#include <pthread.h>
+#if __APPLE__
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <mach/thread_policy.h>
+#endif
+
+
+namespace
+{
+
+thread_local bool isPoolWorker = false;
+
+// Until the engine tells the block size it runs at, 256 frames at 48 kHz
+constexpr std::int64_t defaultPeriodNanoseconds = 5'333'333;
+
+#if __APPLE__
+// What Core Audio's own IO thread runs with: the scheduler is told how much of every
+// period the thread needs, instead of it getting a priority that can still be demoted
+void setRealtimePriority(const pthread_t thread, const std::int64_t periodNanoseconds)
+{
+    mach_timebase_info_data_t timebase{};
+    mach_timebase_info(&timebase);
+
+    const auto toAbsoluteTime = [&timebase](const std::int64_t nanoseconds)
+    {
+        return static_cast<std::uint32_t>(nanoseconds * timebase.denom / timebase.numer);
+    };
+
+    thread_time_constraint_policy_data_t policy{};
+    policy.period = toAbsoluteTime(periodNanoseconds);
+    policy.computation = toAbsoluteTime(periodNanoseconds / 2);
+    policy.constraint = toAbsoluteTime(periodNanoseconds);
+    policy.preemptible = true;
+
+    if (const auto error = thread_policy_set(pthread_mach_thread_np(thread), THREAD_TIME_CONSTRAINT_POLICY,
+            reinterpret_cast<thread_policy_t>(&policy), THREAD_TIME_CONSTRAINT_POLICY_COUNT); error != KERN_SUCCESS)
+        qDebug() << "RealtimeWorkerPool: could not set the time constraint policy, error" << error;
+}
+#else
+void setRealtimePriority(const pthread_t thread, std::int64_t)
+{
+    sched_param param{};
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+
+    if (const auto error = pthread_setschedparam(thread, SCHED_FIFO, &param); error != 0)
+        qDebug() << "RealtimeWorkerPool: could not raise worker priority, error" << error;
+}
+#endif
+
+}
+
+
+RealtimeWorkerPool::RealtimeWorkerPool(const unsigned int workerCount)
+{
+    m_workers.reserve(workerCount);
+
+    for (unsigned int i = 0; i < workerCount; ++i)
+        m_workers.emplace_back(&RealtimeWorkerPool::run, this);
+}
+
+RealtimeWorkerPool::~RealtimeWorkerPool()
+{
+    m_shouldStop = true;
+    m_generation.fetch_add(1);
+    m_generation.notify_all();
+
+    for (auto& worker : m_workers)
+        worker.join();
+}
+
+void RealtimeWorkerPool::setPeriod(const std::uint32_t frameCount, const std::int32_t sampleRate)
+{
+#if __APPLE__
+    if (sampleRate <= 0)
+        return;
+
+    const auto periodNanoseconds = static_cast<std::int64_t>(frameCount) * 1'000'000'000 / sampleRate;
+    for (auto& worker : m_workers)
+        setRealtimePriority(worker.native_handle(), periodNanoseconds);
+#else
+    // SCHED_FIFO has no notion of a period
+    static_cast<void>(frameCount);
+    static_cast<void>(sampleRate);
+#endif
+}
+
+unsigned int RealtimeWorkerPool::defaultWorkerCount()
+{
+    // The audio thread itself always takes part, so it's one less than the cores we have
+    const auto cores = std::thread::hardware_concurrency();
+    return cores > 1 ? cores - 1 : 0;
+}
+
+void RealtimeWorkerPool::execute(const std::uint32_t taskCount, const Task task, void* context) noexcept
+{
+    if (taskCount == 0)
+        return;
+
+    const bool canFanOut = taskCount > 1 && !m_workers.empty() && !isPoolWorker && !m_isBusy.exchange(true);
+    if (!canFanOut)
+    {
+        for (std::uint32_t i = 0; i < taskCount; ++i)
+            task(context, i);
+
+        return;
+    }
+
+    Job job;
+    job.task = task;
+    job.context = context;
+    job.taskCount = taskCount;
+    job.pendingTasks = taskCount;
+
+    m_job.store(&job);
+    m_generation.fetch_add(1);
+    m_generation.notify_all();
+
+    runTasks(job);
+
+    while (job.pendingTasks.load(std::memory_order_acquire) > 0)
+        std::this_thread::yield();
+
+    // Workers register as active before looking at m_job, so once it's cleared and
+    // nobody is active, nobody can still be holding on to our stack-allocated job
+    m_job.store(nullptr);
+    while (m_activeWorkers.load() > 0)
+        std::this_thread::yield();
+
+    m_isBusy.store(false, std::memory_order_release);
+}
+
+void RealtimeWorkerPool::run()
+{
+    isPoolWorker = true;
+    setRealtimePriority(pthread_self(), defaultPeriodNanoseconds);
+
+    std::uint32_t seenGeneration = 0;
+
+    while (true)
+    {
+        m_generation.wait(seenGeneration);
+        seenGeneration = m_generation.load();
+
+        if (m_shouldStop)
+            return;
+
+        m_activeWorkers.fetch_add(1);
+
+        if (auto* job = m_job.load())
+            runTasks(*job);
+
+        m_activeWorkers.fetch_sub(1);
+    }
+}
+
+void RealtimeWorkerPool::runTasks(Job& job) noexcept
+{
+    while (true)
+    {
+        const auto taskIndex = job.nextTask.fetch_add(1, std::memory_order_relaxed);
+        if (taskIndex >= job.taskCount)
+            return;
+
+        job.task(job.context, taskIndex);
+        job.pendingTasks.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+
+// A fixed set of threads the audio thread can fan work out to and block-join on.
+// Only one job runs at a time: a request made while the pool is busy (or from one
+// of its own workers) runs inline on the calling thread instead of queueing, so
+// nested users like a plugin's thread pool inside a strip rendered in parallel
+// never end up with more runnable threads than cores.
+class RealtimeWorkerPool
+{
+  public:
+    using Task = void (*)(void* context, std::uint32_t taskIndex);
+
+    explicit RealtimeWorkerPool(unsigned int workerCount = defaultWorkerCount());
+    ~RealtimeWorkerPool();
+    RealtimeWorkerPool(RealtimeWorkerPool&) = delete;
+    RealtimeWorkerPool(RealtimeWorkerPool&&) = delete;
+    RealtimeWorkerPool(const RealtimeWorkerPool&) = delete;
+    RealtimeWorkerPool(const RealtimeWorkerPool&&) = delete;
+
+    // Runs task(context, 0..taskCount-1), the calling thread takes part; returns when all are done
+    void execute(std::uint32_t taskCount, Task task, void* context) noexcept;
+
+    [[nodiscard]] unsigned int workerCount() const noexcept { return static_cast<unsigned int>(m_workers.size()); }
+
+    // Main thread, once the stream is open: on macOS the workers are scheduled for a
+    // share of every block of this length
+    void setPeriod(std::uint32_t frameCount, std::int32_t sampleRate);
+
+    [[nodiscard]] static unsigned int defaultWorkerCount();
+
+
+  private:
+    struct Job
+    {
+        Task task = nullptr;
+        void* context = nullptr;
+        std::uint32_t taskCount = 0;
+        std::atomic<std::uint32_t> nextTask = 0;
+        std::atomic<std::uint32_t> pendingTasks = 0;
+    };
+
+    std::vector<std::thread> m_workers;
+
+    std::atomic<Job*> m_job = nullptr;
+    std::atomic<std::uint32_t> m_generation = 0;
+    std::atomic<std::uint32_t> m_activeWorkers = 0;
+    std::atomic<bool> m_isBusy = false;
+    std::atomic<bool> m_shouldStop = false;
+
+    void run();
+    static void runTasks(Job& job) noexcept;
+};
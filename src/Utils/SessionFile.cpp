@@ -0,0 +1,217 @@
+#include "SessionFile.h"
+#include <QCborMap>
+#include <QCborValue>
+#include <QSaveFile>
+#include <QtDebug>
+#include <QtEndian>
+
+
+namespace
+{
+
+constexpr std::uint32_t fourCC(const char (&code)[5])
+{
+    return static_cast<std::uint32_t>(static_cast<unsigned char>(code[0]))
+         | static_cast<std::uint32_t>(static_cast<unsigned char>(code[1])) << 8
+         | static_cast<std::uint32_t>(static_cast<unsigned char>(code[2])) << 16
+         | static_cast<std::uint32_t>(static_cast<unsigned char>(code[3])) << 24;
+}
+
+constexpr std::uint32_t magic = fourCC("CWBS");
+constexpr std::uint32_t graphChunk = fourCC("GRPH");
+constexpr std::uint32_t blobChunk = fourCC("BLOB");
+constexpr std::uint32_t version = 1;
+
+constexpr std::size_t headerSize = 16;
+constexpr std::size_t tableEntrySize = 24;
+
+constexpr std::uint64_t alignedTo8(const std::uint64_t size)
+{
+    return (size + 7) & ~std::uint64_t{7};
+}
+
+template <typename T>
+void append(QByteArray& bytes, const T value)
+{
+    T littleEndian = qToLittleEndian(value);
+    bytes.append(reinterpret_cast<const char*>(&littleEndian), sizeof(T));
+}
+
+template <typename T>
+T read(const uchar* bytes)
+{
+    return qFromLittleEndian<T>(bytes);
+}
+
+}
+
+
+int SessionFile::Writer::addBlob(QByteArray blob)
+{
+    if (const auto it = m_blobIndices.constFind(blob); it != m_blobIndices.cend())
+        return it.value();
+
+    const auto index = static_cast<int>(m_blobs.size());
+    m_blobIndices.insert(blob, index);
+    m_blobs.push_back(std::move(blob));
+
+    return index;
+}
+
+bool SessionFile::Writer::write(const QString& path, const QJsonObject& graph) const
+{
+    const auto graphData = QCborValue::fromJsonValue(graph).toCbor();
+
+    const auto chunkCount = static_cast<std::uint32_t>(m_blobs.size() + 1);
+    auto offset = alignedTo8(headerSize + tableEntrySize * chunkCount);
+
+    QByteArray header;
+    header.reserve(static_cast<qsizetype>(offset));
+    append(header, magic);
+    append(header, version);
+    append(header, chunkCount);
+    append(header, std::uint32_t{0});
+
+    const auto addChunk = [&header, &offset](const std::uint32_t type, const qsizetype size)
+    {
+        append(header, type);
+        append(header, std::uint32_t{0});
+        append(header, offset);
+        append(header, static_cast<std::uint64_t>(size));
+
+        offset = alignedTo8(offset + static_cast<std::uint64_t>(size));
+    };
+
+    addChunk(graphChunk, graphData.size());
+    for (const auto& blob : m_blobs)
+        addChunk(blobChunk, blob.size());
+
+    QSaveFile file{path};
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "SessionFile: could not open" << path << "for writing";
+        return false;
+    }
+
+    constexpr char padding[8] = {};
+    const auto writeChunk = [&file, &padding](const QByteArray& data)
+    {
+        file.write(data);
+        file.write(padding, static_cast<qint64>(alignedTo8(static_cast<std::uint64_t>(data.size())) - static_cast<std::uint64_t>(data.size())));
+    };
+
+    writeChunk(header);
+    writeChunk(graphData);
+    for (const auto& blob : m_blobs)
+        writeChunk(blob);
+
+    if (!file.commit())
+    {
+        qWarning() << "SessionFile: could not write" << path << file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+SessionFile::SessionFile(const QString& path) : m_file{path}
+{
+}
+
+SessionFile::~SessionFile()
+{
+    if (m_mapped)
+        m_file.unmap(m_mapped);
+}
+
+std::unique_ptr<SessionFile> SessionFile::open(const QString& path)
+{
+    std::unique_ptr<SessionFile> sessionFile{new SessionFile{path}};
+    auto& file = sessionFile->m_file;
+
+    if (!file.open(QIODevice::ReadOnly))
+        return nullptr;
+
+    const auto size = static_cast<std::uint64_t>(file.size());
+    if (size < headerSize)
+        return nullptr;
+
+    // Cheap to tell a container from a JSON session before mapping anything
+    uchar magicBytes[4] = {};
+    if (file.read(reinterpret_cast<char*>(magicBytes), 4) != 4 || read<std::uint32_t>(magicBytes) != magic)
+        return nullptr;
+
+    const uchar* bytes = sessionFile->m_mapped = file.map(0, static_cast<qint64>(size));
+    if (!bytes)
+    {
+        file.seek(0);
+        sessionFile->m_contents = file.readAll();
+        bytes = reinterpret_cast<const uchar*>(sessionFile->m_contents.constData());
+    }
+
+    if (const auto fileVersion = read<std::uint32_t>(bytes + 4); fileVersion > version)
+    {
+        qWarning() << "SessionFile:" << path << "is of a newer version," << fileVersion;
+        return nullptr;
+    }
+
+    const auto chunkCount = read<std::uint32_t>(bytes + 8);
+    if (chunkCount == 0 || headerSize + tableEntrySize * std::uint64_t{chunkCount} > size)
+    {
+        qWarning() << "SessionFile:" << path << "has a broken chunk table";
+        return nullptr;
+    }
+
+    bool hasGraph = false;
+    for (std::uint32_t i = 0; i < chunkCount; ++i)
+    {
+        const auto* entry = bytes + headerSize + tableEntrySize * i;
+        const auto type = read<std::uint32_t>(entry);
+        const auto offset = read<std::uint64_t>(entry + 8);
+        const auto chunkSize = read<std::uint64_t>(entry + 16);
+
+        if (offset > size || chunkSize > size - offset)
+        {
+            qWarning() << "SessionFile:" << path << "is truncated at chunk" << i;
+            return nullptr;
+        }
+
+        const QByteArrayView chunk{bytes + offset, static_cast<qsizetype>(chunkSize)};
+
+        if (type == graphChunk)
+        {
+            QCborParserError error;
+            const auto graph = QCborValue::fromCbor(QByteArray::fromRawData(chunk.data(), chunk.size()), &error);
+            if (error.error != QCborError::NoError || !graph.isMap())
+            {
+                qWarning() << "SessionFile:" << path << "has a broken graph," << error.errorString();
+                return nullptr;
+            }
+
+            sessionFile->m_graph = graph.toMap().toJsonObject();
+            hasGraph = true;
+        }
+        else if (type == blobChunk)
+        {
+            sessionFile->m_blobs.push_back(chunk);
+        }
+
+        // Chunks of types this version doesn't know about are skipped
+    }
+
+    if (!hasGraph)
+    {
+        qWarning() << "SessionFile:" << path << "has no graph";
+        return nullptr;
+    }
+
+    return sessionFile;
+}
+
+QByteArrayView SessionFile::blob(const int index) const
+{
+    if (index < 0 || index >= blobCount())
+        return {};
+
+    return m_blobs[static_cast<std::size_t>(index)];
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QFile>
+#include <QHash>
+#include <QJsonObject>
+#include <QString>
+
+
+// A session on disk as chunks: a header with the chunk table, the session graph as
+// CBOR, then every plugin's state as a raw blob that the graph refers to by index.
+// Opening one maps the file and parses only the graph; blobs are handed out as views
+// into the mapping, so a plugin's state is read from disk when the plugin reads it.
+//
+//   "CWBS" | version u32 | chunk count u32 | reserved u32
+//   chunk count x { type u32 | reserved u32 | offset u64 | size u64 }
+//   chunks, each starting on an 8 byte boundary
+//
+// Everything is little endian.
+class SessionFile
+{
+  public:
+    // Gathers the blobs while the graph is built, then writes both out
+    class Writer
+    {
+      public:
+        // The index the graph should keep to find it again; identical blobs, the
+        // same plugin twice in its default state say, are written once
+        [[nodiscard]] int addBlob(QByteArray blob);
+
+        // Written to a temporary file first, so a failed save leaves the old one as it was
+        [[nodiscard]] bool write(const QString& path, const QJsonObject& graph) const;
+
+
+      private:
+        std::vector<QByteArray> m_blobs;
+        QHash<QByteArray, int> m_blobIndices;
+    };
+
+    ~SessionFile();
+    SessionFile(SessionFile&) = delete;
+    SessionFile(SessionFile&&) = delete;
+    SessionFile(const SessionFile&) = delete;
+    SessionFile(const SessionFile&&) = delete;
+
+    // Null when the file isn't a session container, or a broken one
+    [[nodiscard]] static std::unique_ptr<SessionFile> open(const QString& path);
+
+    [[nodiscard]] const QJsonObject& graph() const { return m_graph; }
+
+    // Valid for as long as the SessionFile is; empty for indices it doesn't have
+    [[nodiscard]] QByteArrayView blob(int index) const;
+    [[nodiscard]] int blobCount() const { return static_cast<int>(m_blobs.size()); }
+
+
+  private:
+    explicit SessionFile(const QString& path);
+
+    QFile m_file;
+    uchar* m_mapped = nullptr;
+    QByteArray m_contents;
+
+    QJsonObject m_graph;
+    std::vector<QByteArrayView> m_blobs;
+};
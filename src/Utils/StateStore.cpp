@@ -0,0 +1,78 @@
+#include "StateStore.h"
+#include <algorithm>
+#include <QCryptographicHash>
+
+
+QByteArray StateStore::Blob::data() const
+{
+    if (m_size == 0)
+        return {};
+
+    return qUncompress(m_compressed);
+}
+
+StateStore::Ref StateStore::put(const QByteArrayView state)
+{
+    auto hash = hashOf(state);
+
+    if (auto blob = find(hash))
+        return blob;
+
+    auto blob = std::make_shared<Blob>();
+    blob->m_hash = hash;
+    blob->m_size = state.size();
+
+    // Plugin states are mostly parameter values and chunks of zeros, zlib's fastest does well on them
+    if (!state.isEmpty())
+        blob->m_compressed = qCompress(reinterpret_cast<const uchar*>(state.data()), state.size(), 1);
+
+    if (m_blobs.size() >= m_sweepAt)
+        sweep();
+
+    m_blobs.insert(std::move(hash), blob);
+
+    return blob;
+}
+
+StateStore::Ref StateStore::find(const QByteArray& hash) const
+{
+    const auto it = m_blobs.constFind(hash);
+    if (it == m_blobs.cend())
+        return nullptr;
+
+    return it->lock();
+}
+
+QByteArray StateStore::hashOf(const QByteArrayView state)
+{
+    return QCryptographicHash::hash(state, QCryptographicHash::Blake2b_256);
+}
+
+int StateStore::count() const
+{
+    return static_cast<int>(std::count_if(m_blobs.cbegin(), m_blobs.cend(), [](const std::weak_ptr<const Blob>& blob)
+    {
+        return !blob.expired();
+    }));
+}
+
+std::size_t StateStore::memoryUsed() const
+{
+    std::size_t memoryUsed = 0;
+    for (const auto& weakBlob : m_blobs)
+    {
+        if (const auto blob = weakBlob.lock())
+            memoryUsed += static_cast<std::size_t>(blob->compressedSize());
+    }
+
+    return memoryUsed;
+}
+
+void StateStore::sweep()
+{
+    for (auto it = m_blobs.begin(); it != m_blobs.end();)
+        it = it->expired()? m_blobs.erase(it) : std::next(it);
+
+    // Twice what's alive, so sweeping stays linear in the puts overall
+    m_sweepAt = std::max<qsizetype>(64, m_blobs.size() * 2);
+}
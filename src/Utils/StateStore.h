@@ -0,0 +1,59 @@
+#pragma once
+#include <memory>
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QHash>
+
+
+// Plugin states by their contents: every state is hashed and kept compressed, once,
+// however many undo steps and snapshots hold it. Holders keep a Ref; a state goes
+// away with the last Ref to it, the store only keeps track of which ones are alive.
+// Main thread only, a Ref can be read anywhere.
+class StateStore
+{
+  public:
+    class Blob
+    {
+      public:
+        // Decompressed, as it was put in
+        [[nodiscard]] QByteArray data() const;
+
+        [[nodiscard]] const QByteArray& hash() const { return m_hash; }
+        [[nodiscard]] qsizetype size() const { return m_size; }
+        [[nodiscard]] qsizetype compressedSize() const { return m_compressed.size(); }
+
+
+      private:
+        friend class StateStore;
+
+        QByteArray m_hash;
+        QByteArray m_compressed;
+        qsizetype m_size = 0;
+    };
+
+    using Ref = std::shared_ptr<const Blob>;
+
+    StateStore() = default;
+    StateStore(StateStore&) = delete;
+    StateStore(StateStore&&) = delete;
+    StateStore(const StateStore&) = delete;
+    StateStore(const StateStore&&) = delete;
+
+    // The one already there when the same bytes were put in before
+    [[nodiscard]] Ref put(QByteArrayView state);
+    [[nodiscard]] Ref find(const QByteArray& hash) const;
+
+    [[nodiscard]] static QByteArray hashOf(QByteArrayView state);
+
+    // Of the states someone still holds
+    [[nodiscard]] int count() const;
+    [[nodiscard]] std::size_t memoryUsed() const;
+
+
+  private:
+    QHash<QByteArray, std::weak_ptr<const Blob>> m_blobs;
+    // Forgotten states are swept out once there are this many entries
+    qsizetype m_sweepAt = 64;
+
+    void sweep();
+};